@@ -11,11 +11,23 @@ bits 32
 global start
 global inb
 global outb
+global isr_stub_table
 extern kmain
+extern exception_dispatch
 
 start:
     cli                  ; Disable interrupts
 
+    lgdt [gdt_descriptor] ; Our own flat GDT, the IDT gates refer to its selectors
+    jmp 0x08:.reload_segments
+.reload_segments:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
     finit           ; FPU init
     fldcw [fpu_cw]  ; FPU load control word
 
@@ -42,9 +54,90 @@ outb:
     out dx, al           ; Write the value to the port
     ret
 
+; CPU exception entry points. Every stub leaves the same frame behind:
+; vector, error code (0 if the CPU pushes none), eip, cs, eflags
+%macro ISR_NOERR 1
+isr%1:
+    push dword 0
+    push dword %1
+    jmp isr_common
+%endmacro
+
+%macro ISR_ERR 1
+isr%1:
+    push dword %1
+    jmp isr_common
+%endmacro
+
+ISR_NOERR 0
+ISR_NOERR 1
+ISR_NOERR 2
+ISR_NOERR 3
+ISR_NOERR 4
+ISR_NOERR 5
+ISR_NOERR 6
+ISR_NOERR 7
+ISR_ERR 8
+ISR_NOERR 9
+ISR_ERR 10
+ISR_ERR 11
+ISR_ERR 12
+ISR_ERR 13
+ISR_ERR 14
+ISR_NOERR 15
+ISR_NOERR 16
+ISR_ERR 17
+ISR_NOERR 18
+ISR_NOERR 19
+ISR_NOERR 20
+ISR_ERR 21
+ISR_NOERR 22
+ISR_NOERR 23
+ISR_NOERR 24
+ISR_NOERR 25
+ISR_NOERR 26
+ISR_NOERR 27
+ISR_NOERR 28
+ISR_ERR 29
+ISR_ERR 30
+ISR_NOERR 31
+
+; exception_dispatch(vector, error, eip, cr2) returns only if the fault was
+; resolved (e.g. a demand-zero page was mapped); the instruction is retried.
+isr_common:
+    pusha
+    mov eax, cr2
+    push eax
+    push dword [esp + 44] ; eip
+    push dword [esp + 44] ; error code
+    push dword [esp + 44] ; vector
+    call exception_dispatch
+    add esp, 16
+    popa
+    add esp, 8            ; Drop vector and error code
+    iret
+
 section .data
 fpu_cw: dw 0x37f
 
+align 8
+gdt_start:
+    dq 0x0000000000000000 ; null
+    dq 0x00CF9A000000FFFF ; 0x08: code, flat 4 GB, ring 0
+    dq 0x00CF92000000FFFF ; 0x10: data, flat 4 GB, ring 0
+gdt_end:
+
+gdt_descriptor:
+    dw gdt_end - gdt_start - 1
+    dd gdt_start
+
+isr_stub_table:
+%assign i 0
+%rep 32
+    dd isr%+i
+%assign i i + 1
+%endrep
+
 section .bss
 align 4
 stack_bottom:
@@ -0,0 +1,82 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/arch/idt.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/paging.h>
+#include <core/drivers/serial.h>
+
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+    uint8_t zero;
+    uint8_t type_attr;
+    uint16_t offset_high;
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uint32_t base;
+} __attribute__((packed)) idt_pointer_t;
+
+extern uint32_t isr_stub_table[EXCEPTION_COUNT];
+
+static idt_entry_t idt[IDT_SIZE];
+static idt_pointer_t idt_pointer;
+
+// Only CPU exceptions are routed; interrupts stay masked and devices are polled
+void idt_init(void) {
+    for (int i = 0; i < EXCEPTION_COUNT; i++) {
+        idt[i].offset_low = isr_stub_table[i] & 0xFFFF;
+        idt[i].selector = KERNEL_CODE_SEGMENT_OFFSET;
+        idt[i].zero = 0;
+        idt[i].type_attr = INTERRUPT_GATE;
+        idt[i].offset_high = isr_stub_table[i] >> 16;
+    }
+
+    idt_pointer.limit = sizeof(idt) - 1;
+    idt_pointer.base = (uint32_t)idt;
+    asm volatile ("lidt %0" : : "m"(idt_pointer));
+
+    kprint(":: IDT initialized\n", 7);
+}
+
+// itoa() is signed, kernel addresses are not
+static void exception_print_hex(const char* label, uint32_t value) {
+    char buf[9];
+    for (int i = 0; i < 8; i++) {
+        uint8_t nibble = (value >> (28 - i * 4)) & 0xF;
+        buf[i] = nibble < 10 ? '0' + nibble : 'a' + nibble - 10;
+    }
+    buf[8] = '\0';
+
+    kprint(label, 4);
+    kprint("0x", 4);
+    kprint(buf, 4);
+    serial_print(label);
+    serial_print("0x");
+    serial_print(buf);
+}
+
+void exception_dispatch(uint32_t vector, uint32_t error, uint32_t eip, uint32_t cr2) {
+    if (vector == EXCEPTION_PAGE_FAULT && paging_fault(cr2, error)) {
+        return;
+    }
+
+    char buf[16];
+    itoa(vector, buf, 10);
+    kprint("\nKernel panic - CPU exception ", 4);
+    kprint(buf, 4);
+    serial_print("\nKernel panic - CPU exception ");
+    serial_print(buf);
+    exception_print_hex(" at eip ", eip);
+    exception_print_hex(", error ", error);
+    if (vector == EXCEPTION_PAGE_FAULT) {
+        exception_print_hex(", address ", cr2);
+    }
+    kprint("\n", 4);
+    serial_print("\n");
+
+    while (1) {
+        asm volatile ("cli; hlt");
+    }
+}
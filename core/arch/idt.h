@@ -1,4 +1,8 @@
+#ifndef IDT_H
+#define IDT_H
+
 #include <stdint.h>
+#include <stdbool.h>
 
 #define IDT_SIZE 256
 #define INTERRUPT_GATE 0x8e
@@ -10,4 +14,12 @@
 
 #define SYSCALL_INTERRUPT 0x80
 
-extern char inb(int port);
\ No newline at end of file
+#define EXCEPTION_COUNT 32
+#define EXCEPTION_PAGE_FAULT 14
+
+extern char inb(int port);
+
+void idt_init(void);
+void exception_dispatch(uint32_t vector, uint32_t error, uint32_t eip, uint32_t cr2);
+
+#endif
@@ -8,4 +8,17 @@ unsigned short inw(unsigned short port) {
     unsigned short result;
     asm volatile ("inw %1, %0" : "=a"(result) : "Nd"(port));
     return result;
-}
\ No newline at end of file
+}
+void outw(unsigned short port, unsigned short val) {
+    asm volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+unsigned int inl(unsigned short port) {
+    unsigned int result;
+    asm volatile ("inl %1, %0" : "=a"(result) : "Nd"(port));
+    return result;
+}
+
+void outl(unsigned short port, unsigned int val) {
+    asm volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
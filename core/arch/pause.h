@@ -1,9 +1,12 @@
-#ifndef MULTIBOOT_H
-#define MULTIBOOT_H
+#ifndef PAUSE_H
+#define PAUSE_H
 
 #include <stdint.h>
 
 extern void pause();
 extern uint16_t inw(uint16_t port);
+extern void outw(uint16_t port, uint16_t val);
+extern uint32_t inl(uint16_t port);
+extern void outl(uint16_t port, uint32_t val);
 
 #endif
\ No newline at end of file
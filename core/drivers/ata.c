@@ -0,0 +1,405 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/drivers/ata.h>
+#include <core/drivers/block.h>
+#include <core/drivers/ide.h>
+#include <core/drivers/pci.h>
+#include <core/arch/pause.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/paging.h>
+
+extern uint8_t inb(uint16_t port);
+extern void outb(uint16_t port, uint8_t val);
+
+// Legacy IDE channels
+#define ATA_PRIMARY_IO      0x1F0
+#define ATA_PRIMARY_CTRL    0x3F6
+#define ATA_SECONDARY_IO    0x170
+#define ATA_SECONDARY_CTRL  0x376
+
+#define ATA_REG_DATA        0
+#define ATA_REG_SECCOUNT    2
+#define ATA_REG_LBA0        3
+#define ATA_REG_LBA1        4
+#define ATA_REG_LBA2        5
+#define ATA_REG_DRIVE       6
+#define ATA_REG_STATUS      7
+#define ATA_REG_COMMAND     7
+
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+#define ATA_CTRL_NIEN       0x02    // Interrupts stay masked, completion is polled
+#define ATA_CTRL_SRST       0x04
+
+#define ATA_CMD_READ_PIO    0x20
+#define ATA_CMD_WRITE_PIO   0x30
+#define ATA_CMD_READ_DMA    0xC8
+#define ATA_CMD_WRITE_DMA   0xCA
+#define ATA_CMD_FLUSH       0xE7
+#define ATA_CMD_IDENTIFY    0xEC
+
+// Bus master registers, relative to the channel's base
+#define BM_COMMAND          0
+#define BM_STATUS           2
+#define BM_PRDT             4
+
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08    // Device to memory
+#define BM_ST_ERROR         0x02
+#define BM_ST_IRQ           0x04
+
+#define PRD_END             0x8000
+
+#define ATA_TIMEOUT         1000000 // Status polls before a command is abandoned
+#define ATA_MAX_SECTORS     128     // Sectors per command (64 KB)
+#define ATA_MAX_PRD         8
+#define ATA_LBA28_LIMIT     0x10000000
+
+// Physical region descriptor; a region must not cross a 64 KB boundary
+typedef struct {
+    uint32_t base;
+    uint16_t bytes;                 // 0 means 64 KB
+    uint16_t flags;
+} __attribute__((packed)) prd_t;
+
+static struct {
+    bool present;
+    uint8_t channel;
+    uint16_t io;
+    uint16_t ctrl;
+    uint8_t slave;
+    uint16_t bm;                    // Bus master base of the channel, 0 without DMA
+    uint32_t sectors;
+} disk;
+
+static prd_t* prdt = NULL;
+static int block_dev = BLOCK_NONE;
+
+// The block layer keeps one transfer in flight; it is cut into commands
+static bool active = false;
+static bool active_waiting = false; // Transfer accepted, channel held by the CD-ROM
+static bool active_dma = false;
+static uint8_t active_op;
+static uint32_t active_lba;
+static uint32_t active_count;
+static uint8_t* active_buffer;
+static uint32_t active_done = 0;    // Sectors of the transfer already moved
+static uint32_t active_chunk = 0;   // Sectors asked for by the running command
+static uint32_t active_pio = 0;     // Sectors of the running command moved by PIO
+static uint32_t active_polls = 0;
+
+// 400 ns for the device to settle after a select or command
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(disk.ctrl);
+    }
+}
+
+static uint8_t ata_wait_ready(void) {
+    uint8_t status = inb(disk.io + ATA_REG_STATUS);
+    for (int i = 0; i < ATA_TIMEOUT && (status & ATA_SR_BSY); i++) {
+        status = inb(disk.io + ATA_REG_STATUS);
+    }
+    return status;
+}
+
+// Select the disk and pass bits 24-27 of the LBA
+static void ata_select(uint32_t lba) {
+    outb(disk.io + ATA_REG_DRIVE, 0xE0 | (disk.slave << 4) | ((lba >> 24) & 0x0F));
+    ata_delay();
+}
+
+static bool ata_channel_reset(void) {
+    outb(disk.ctrl, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    ata_delay();
+    outb(disk.ctrl, ATA_CTRL_NIEN);
+    ata_delay();
+
+    // A floating bus reads 0xFF: no devices on this channel
+    if (inb(disk.io + ATA_REG_STATUS) == 0xFF) {
+        return false;
+    }
+    return !(ata_wait_ready() & ATA_SR_BSY);
+}
+
+static bool ata_identify(void) {
+    ata_select(0);
+    // Packet and SATA devices leave a signature in the LBA registers
+    if (inb(disk.io + ATA_REG_LBA1) != 0 || inb(disk.io + ATA_REG_LBA2) != 0) {
+        return false;
+    }
+
+    outb(disk.io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+    ata_delay();
+    if (inb(disk.io + ATA_REG_STATUS) == 0) {
+        return false;   // No device
+    }
+    uint8_t status = ata_wait_ready();
+    if ((status & ATA_SR_ERR) || !(status & ATA_SR_DRQ)) {
+        return false;
+    }
+
+    uint16_t identify[256];
+    for (int i = 0; i < 256; i++) {
+        identify[i] = inw(disk.io + ATA_REG_DATA);
+    }
+    // Word 49 bit 9 = LBA, bit 8 = DMA; words 60-61 = LBA28 sectors
+    if (!(identify[49] & 0x200)) {
+        return false;
+    }
+    if (!(identify[49] & 0x100)) {
+        disk.bm = 0;
+    }
+    disk.sectors = identify[60] | ((uint32_t)identify[61] << 16);
+    if (disk.sectors > ATA_LBA28_LIMIT) {
+        disk.sectors = ATA_LBA28_LIMIT;
+    }
+    return disk.sectors != 0;
+}
+
+// Describe buffer in the PRDT. The heap is identity mapped, so virtual
+// addresses are physical; odd or windowed buffers go through PIO instead.
+static bool dma_build_prdt(uint8_t* buffer, uint32_t bytes) {
+    uint32_t addr = (uint32_t)buffer;
+    if ((addr & 1) || addr + bytes > VM_WINDOW_BASE) {
+        return false;
+    }
+
+    int n = 0;
+    while (bytes) {
+        if (n == ATA_MAX_PRD) {
+            return false;
+        }
+        uint32_t room = 0x10000 - (addr & 0xFFFF);
+        uint32_t len = bytes < room ? bytes : room;
+        prdt[n].base = addr;
+        prdt[n].bytes = len & 0xFFFF;
+        prdt[n].flags = 0;
+        addr += len;
+        bytes -= len;
+        n++;
+    }
+    prdt[n - 1].flags = PRD_END;
+    return true;
+}
+
+// Start the next command of the transfer in flight
+static bool ata_issue(void) {
+    uint32_t lba = active_lba + active_done;
+    uint32_t count = active_count - active_done;
+    if (count > ATA_MAX_SECTORS) {
+        count = ATA_MAX_SECTORS;
+    }
+    uint8_t* buffer = active_buffer + active_done * ATA_SECTOR_SIZE;
+    bool write = active_op == BLOCK_WRITE;
+
+    ata_select(lba);
+    if (ata_wait_ready() & ATA_SR_BSY) {
+        return false;
+    }
+
+    active_dma = disk.bm && dma_build_prdt(buffer, count * ATA_SECTOR_SIZE);
+    if (active_dma) {
+        outb(disk.bm + BM_COMMAND, 0);
+        outl(disk.bm + BM_PRDT, (uint32_t)prdt);
+        outb(disk.bm + BM_STATUS, BM_ST_ERROR | BM_ST_IRQ);     // Write 1 to clear
+        outb(disk.bm + BM_COMMAND, write ? 0 : BM_CMD_READ);
+    }
+
+    outb(disk.io + ATA_REG_SECCOUNT, count);
+    outb(disk.io + ATA_REG_LBA0, lba);
+    outb(disk.io + ATA_REG_LBA1, lba >> 8);
+    outb(disk.io + ATA_REG_LBA2, lba >> 16);
+    if (active_dma) {
+        outb(disk.io + ATA_REG_COMMAND, write ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA);
+        outb(disk.bm + BM_COMMAND, (write ? 0 : BM_CMD_READ) | BM_CMD_START);
+    } else {
+        outb(disk.io + ATA_REG_COMMAND, write ? ATA_CMD_WRITE_PIO : ATA_CMD_READ_PIO);
+    }
+    ata_delay();
+
+    active_chunk = count;
+    active_pio = 0;
+    active_polls = 0;
+    active = true;
+    return true;
+}
+
+static void ata_finish(int status) {
+    active = false;
+    if (status < 0) {
+        if (active_dma) {
+            outb(disk.bm + BM_COMMAND, 0);
+        }
+        ata_channel_reset();
+    }
+    ide_release(disk.channel, IDE_ATA);
+    block_complete(block_dev, status);
+}
+
+// One sector per DRQ; the device drops DRQ and BSY once the command is over
+static void ata_block_poll(int dev) {
+    (void)dev;
+    if (active_waiting) {
+        if (ide_claim(disk.channel, IDE_ATA)) {
+            active_waiting = false;
+            if (!ata_issue()) {
+                ata_finish(-1);
+            }
+        }
+        return;
+    }
+    if (!active) {
+        return;
+    }
+
+    uint8_t status = inb(disk.io + ATA_REG_STATUS);
+    if (++active_polls > ATA_TIMEOUT) {
+        ata_finish(-1);
+        return;
+    }
+    if (status & ATA_SR_BSY) {
+        return;
+    }
+    if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+        ata_finish(-1);
+        return;
+    }
+
+    if (!active_dma && (status & ATA_SR_DRQ)) {
+        if (active_pio == active_chunk) {
+            ata_finish(-1);     // The device wants more than was asked for
+            return;
+        }
+        uint16_t* words = (uint16_t*)(active_buffer + (active_done + active_pio) * ATA_SECTOR_SIZE);
+        for (int i = 0; i < ATA_SECTOR_SIZE / 2; i++) {
+            if (active_op == BLOCK_WRITE) {
+                outw(disk.io + ATA_REG_DATA, words[i]);
+            } else {
+                words[i] = inw(disk.io + ATA_REG_DATA);
+            }
+        }
+        active_pio++;
+        ata_delay();
+        return;
+    }
+
+    if (status & ATA_SR_DRQ) {
+        return;     // DMA data phase still running
+    }
+
+    // BSY and DRQ clear: the command is over
+    if (active_dma) {
+        bool failed = (inb(disk.bm + BM_STATUS) & BM_ST_ERROR) != 0;
+        outb(disk.bm + BM_COMMAND, 0);
+        outb(disk.bm + BM_STATUS, BM_ST_ERROR | BM_ST_IRQ);
+        if (failed) {
+            ata_finish(-1);
+            return;
+        }
+    } else if (active_pio < active_chunk) {
+        return;     // Between sectors
+    }
+
+    active_done += active_chunk;
+    active = false;
+    if (active_done == active_count) {
+        ata_finish(0);
+    } else if (!ata_issue()) {
+        ata_finish(-1);
+    }
+}
+
+static int ata_block_start(int dev, int op, uint32_t lba, uint32_t count, void* buffer) {
+    (void)dev;
+    active_op = op;
+    active_lba = lba;
+    active_count = count;
+    active_buffer = (uint8_t*)buffer;
+    active_done = 0;
+    if (!ide_claim(disk.channel, IDE_ATA)) {
+        active_waiting = true;  // Issued from poll once the CD-ROM lets go
+        return 0;
+    }
+    if (!ata_issue()) {
+        ide_release(disk.channel, IDE_ATA);
+        return -1;
+    }
+    return 0;
+}
+
+// Synchronous; the block layer has drained the queue
+static int ata_block_flush(int dev) {
+    (void)dev;
+    while (!ide_claim(disk.channel, IDE_ATA)) {
+        block_poll();
+    }
+    int result = -1;
+    ata_select(0);
+    if (!(ata_wait_ready() & ATA_SR_BSY)) {
+        outb(disk.io + ATA_REG_COMMAND, ATA_CMD_FLUSH);
+        ata_delay();
+        uint8_t status = ata_wait_ready();
+        result = (status & (ATA_SR_BSY | ATA_SR_ERR | ATA_SR_DF)) ? -1 : 0;
+    }
+    ide_release(disk.channel, IDE_ATA);
+    return result;
+}
+
+static const block_driver_t ata_block = {
+    "hd0", ATA_SECTOR_SIZE, ATA_MAX_SECTORS, false, ata_block_start, ata_block_poll, ata_block_flush
+};
+
+bool ata_init(void) {
+    static const uint16_t channels[2][2] = {
+        { ATA_PRIMARY_IO, ATA_PRIMARY_CTRL },
+        { ATA_SECONDARY_IO, ATA_SECONDARY_CTRL },
+    };
+    uint16_t bm = pci_ide_bus_master();
+
+    disk.present = false;
+    for (int ch = 0; ch < IDE_CHANNELS && !disk.present; ch++) {
+        if (!ide_claim(ch, IDE_ATA)) {
+            continue;
+        }
+        disk.channel = ch;
+        disk.io = channels[ch][0];
+        disk.ctrl = channels[ch][1];
+        if (ata_channel_reset()) {
+            for (int slave = 0; slave < 2 && !disk.present; slave++) {
+                disk.slave = slave;
+                disk.bm = bm ? bm + ch * 8 : 0;
+                disk.present = ata_identify();
+            }
+        }
+        ide_release(ch, IDE_ATA);
+    }
+
+    if (!disk.present) {
+        return false;
+    }
+    ide_set_disk(disk.channel, disk.slave);
+
+    if (disk.bm) {
+        prdt = (prd_t*)frame_alloc();   // Page aligned, so it cannot cross 64 KB
+        if (!prdt) {
+            disk.bm = 0;
+        }
+    }
+    block_dev = block_register(&ata_block, disk.sectors);
+
+    kprint(":: Disk: ATA, ", 7);
+    char buf[16];
+    itoa(disk.sectors / 2048, buf, 10);     // Sectors to MB
+    kprint(buf, 7);
+    kprint(disk.bm ? " MB, bus-master DMA\n" : " MB, PIO\n", 7);
+    return block_dev != BLOCK_NONE;
+}
+
+bool ata_present(void) {
+    return disk.present;
+}
@@ -0,0 +1,16 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ATA_SECTOR_SIZE 512
+
+// Probe the IDE channels for an ATA hard disk and register the first one
+// found as block device hd0
+bool ata_init(void);
+
+// Is there a disk behind the driver?
+bool ata_present(void);
+
+#endif // ATA_H
@@ -0,0 +1,367 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/drivers/block.h>
+#include <core/kernel/mem.h>
+
+typedef struct {
+    bool used;
+    bool active;            // Part of the transfer in flight
+    uint8_t op;
+    uint32_t lba;
+    uint32_t count;
+    uint8_t* buffer;
+    block_callback_t done;
+    void* ctx;
+} block_request_t;
+
+typedef struct {
+    const block_driver_t* driver;
+    uint32_t sectors;
+    block_request_t queue[BLOCK_QUEUE_DEPTH];
+    int queued;             // Used slots, including the transfer in flight
+    int plugged;
+    bool busy;
+    bool kicking;           // Dispatch loop running, completions must not recurse
+    uint32_t head;          // Sector after the last dispatched transfer
+
+    // Transfer in flight
+    int8_t batch[BLOCK_QUEUE_DEPTH];
+    int batch_count;
+    uint8_t op;
+    bool bounced;
+
+    uint8_t* bounce;        // max_sectors worth, allocated on the first scattered merge
+    block_stats_t stats;
+} block_device_t;
+
+static block_device_t devices[BLOCK_MAX_DEVICES];
+static int device_count = 0;
+
+static int block_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+static block_device_t* block_dev(int dev) {
+    if (dev < 0 || dev >= device_count) {
+        return NULL;
+    }
+    return &devices[dev];
+}
+
+void block_init(void) {
+    memset(devices, 0, sizeof(devices));
+    device_count = 0;
+}
+
+int block_register(const block_driver_t* driver, uint32_t sectors) {
+    if (device_count == BLOCK_MAX_DEVICES || !driver->start || driver->sector_size == 0) {
+        return BLOCK_NONE;
+    }
+    block_device_t* d = &devices[device_count];
+    memset(d, 0, sizeof(*d));
+    d->driver = driver;
+    d->sectors = sectors;
+    return device_count++;
+}
+
+int block_find(const char* name) {
+    for (int i = 0; i < device_count; i++) {
+        if (block_strcmp(devices[i].driver->name, name) == 0) {
+            return i;
+        }
+    }
+    return BLOCK_NONE;
+}
+
+int block_count(void) {
+    return device_count;
+}
+
+const block_driver_t* block_driver(int dev) {
+    block_device_t* d = block_dev(dev);
+    return d ? d->driver : NULL;
+}
+
+uint32_t block_sectors(int dev) {
+    block_device_t* d = block_dev(dev);
+    return d ? d->sectors : 0;
+}
+
+// C-LOOK: the lowest LBA at or past the head, else wrap to the lowest one
+static int block_pick(block_device_t* d) {
+    int ahead = -1, lowest = -1;
+    for (int i = 0; i < BLOCK_QUEUE_DEPTH; i++) {
+        block_request_t* r = &d->queue[i];
+        if (!r->used || r->active) {
+            continue;
+        }
+        if (r->lba >= d->head && (ahead < 0 || r->lba < d->queue[ahead].lba)) {
+            ahead = i;
+        }
+        if (lowest < 0 || r->lba < d->queue[lowest].lba) {
+            lowest = i;
+        }
+    }
+    return ahead >= 0 ? ahead : lowest;
+}
+
+static int block_next_adjacent(block_device_t* d, uint8_t op, uint32_t lba) {
+    for (int i = 0; i < BLOCK_QUEUE_DEPTH; i++) {
+        block_request_t* r = &d->queue[i];
+        if (r->used && !r->active && r->op == op && r->lba == lba) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Gather the picked request and the ones that continue it on disk into one
+// transfer. Requests whose buffers also follow each other go out as they are;
+// the rest are staged through the bounce buffer.
+static void block_dispatch(int dev) {
+    block_device_t* d = &devices[dev];
+    const block_driver_t* drv = d->driver;
+    block_request_t* first = &d->queue[block_pick(d)];
+
+    first->active = true;
+    d->batch[0] = (int8_t)(first - d->queue);
+    d->batch_count = 1;
+    d->op = first->op;
+    d->bounced = false;
+
+    uint32_t total = first->count;
+    uint8_t* tail = first->buffer + first->count * drv->sector_size;
+    while (total < drv->max_sectors) {
+        int idx = block_next_adjacent(d, d->op, first->lba + total);
+        if (idx < 0 || total + d->queue[idx].count > drv->max_sectors) {
+            break;
+        }
+        block_request_t* r = &d->queue[idx];
+        if (r->buffer != tail && !d->bounced) {
+            if (!d->bounce) {
+                d->bounce = (uint8_t*)kmalloc(drv->max_sectors * drv->sector_size);
+                if (!d->bounce) {
+                    break;
+                }
+            }
+            d->bounced = true;
+        }
+        r->active = true;
+        d->batch[d->batch_count++] = (int8_t)idx;
+        tail = r->buffer + r->count * drv->sector_size;
+        total += r->count;
+    }
+
+    uint8_t* buffer = first->buffer;
+    if (d->bounced) {
+        buffer = d->bounce;
+        if (d->op == BLOCK_WRITE) {
+            for (int i = 0, off = 0; i < d->batch_count; i++) {
+                block_request_t* r = &d->queue[d->batch[i]];
+                memcpy(d->bounce + off, r->buffer, r->count * drv->sector_size);
+                off += r->count * drv->sector_size;
+            }
+        }
+        d->stats.bounced++;
+    }
+
+    d->busy = true;
+    d->head = first->lba + total;
+    d->stats.dispatches++;
+    d->stats.merges += d->batch_count - 1;
+    if (drv->start(dev, d->op, first->lba, total, buffer) < 0) {
+        block_complete(dev, -1);
+    }
+}
+
+// Dispatch until the backend is busy. A forced kick ignores the plug so a
+// full queue can drain.
+static void block_kick(int dev, bool force) {
+    block_device_t* d = &devices[dev];
+    if (d->kicking) {
+        return;
+    }
+    d->kicking = true;
+    while (!d->busy && d->queued > 0 && (force || d->plugged == 0)) {
+        block_dispatch(dev);
+    }
+    d->kicking = false;
+}
+
+int block_submit(int dev, int op, uint32_t lba, uint32_t count, void* buffer, block_callback_t done, void* ctx) {
+    block_device_t* d = block_dev(dev);
+    if (!d || count == 0 || !buffer || d->queued == BLOCK_QUEUE_DEPTH) {
+        return -1;
+    }
+    if (op != BLOCK_READ && (op != BLOCK_WRITE || d->driver->read_only)) {
+        return -1;
+    }
+    if (d->sectors && (lba >= d->sectors || count > d->sectors - lba)) {
+        return -1;
+    }
+
+    block_request_t* r = d->queue;
+    while (r->used) {
+        r++;
+    }
+    r->used = true;
+    r->active = false;
+    r->op = (uint8_t)op;
+    r->lba = lba;
+    r->count = count;
+    r->buffer = (uint8_t*)buffer;
+    r->done = done;
+    r->ctx = ctx;
+    d->queued++;
+    d->stats.requests++;
+
+    block_kick(dev, false);
+    return 0;
+}
+
+void block_plug(int dev) {
+    block_device_t* d = block_dev(dev);
+    if (d) {
+        d->plugged++;
+    }
+}
+
+void block_unplug(int dev) {
+    block_device_t* d = block_dev(dev);
+    if (d && d->plugged > 0 && --d->plugged == 0) {
+        block_kick(dev, false);
+    }
+}
+
+void block_complete(int dev, int status) {
+    block_device_t* d = block_dev(dev);
+    if (!d || !d->busy) {
+        return;
+    }
+    uint32_t sector_size = d->driver->sector_size;
+
+    block_callback_t done[BLOCK_QUEUE_DEPTH];
+    void* ctx[BLOCK_QUEUE_DEPTH];
+    int count = d->batch_count;
+    uint32_t off = 0;
+    for (int i = 0; i < count; i++) {
+        block_request_t* r = &d->queue[d->batch[i]];
+        uint32_t bytes = r->count * sector_size;
+        if (status == 0 && d->bounced && d->op == BLOCK_READ) {
+            memcpy(r->buffer, d->bounce + off, bytes);
+        }
+        off += bytes;
+        done[i] = r->done;
+        ctx[i] = r->ctx;
+        r->used = false;
+        r->active = false;
+        d->queued--;
+    }
+
+    if (status < 0) {
+        d->stats.errors++;
+    } else if (d->op == BLOCK_WRITE) {
+        d->stats.write_sectors += off / sector_size;
+    } else {
+        d->stats.read_sectors += off / sector_size;
+    }
+    d->batch_count = 0;
+    d->busy = false;
+
+    // Slots are free again, so callbacks may queue follow-up requests
+    for (int i = 0; i < count; i++) {
+        if (done[i]) {
+            done[i](ctx[i], status);
+        }
+    }
+    block_kick(dev, false);
+}
+
+void block_poll(void) {
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i].busy && devices[i].driver->poll) {
+            devices[i].driver->poll(i);
+        }
+    }
+}
+
+static void block_batch_done(void* ctx, int status) {
+    block_batch_t* batch = (block_batch_t*)ctx;
+    if (status < 0) {
+        batch->status = -1;
+    }
+    batch->pending--;
+}
+
+void block_batch_init(block_batch_t* batch) {
+    batch->pending = 0;
+    batch->status = 0;
+}
+
+// Not for completion callbacks: a full queue is drained by polling here
+int block_batch_submit(block_batch_t* batch, int dev, int op, uint32_t lba, uint32_t count, void* buffer) {
+    block_device_t* d = block_dev(dev);
+    if (!d) {
+        batch->status = -1;
+        return -1;
+    }
+    while (d->queued == BLOCK_QUEUE_DEPTH) {
+        block_kick(dev, true);
+        block_poll();
+    }
+
+    batch->pending++;
+    if (block_submit(dev, op, lba, count, buffer, block_batch_done, batch) < 0) {
+        batch->pending--;
+        batch->status = -1;
+        return -1;
+    }
+    return 0;
+}
+
+// The devices involved must be unplugged, or the batch never starts
+int block_batch_wait(block_batch_t* batch) {
+    while (batch->pending > 0) {
+        block_poll();
+    }
+    return batch->status;
+}
+
+int block_read(int dev, uint32_t lba, uint32_t count, void* buffer) {
+    block_batch_t batch;
+    block_batch_init(&batch);
+    block_batch_submit(&batch, dev, BLOCK_READ, lba, count, buffer);
+    return block_batch_wait(&batch);
+}
+
+int block_write(int dev, uint32_t lba, uint32_t count, const void* buffer) {
+    block_batch_t batch;
+    block_batch_init(&batch);
+    block_batch_submit(&batch, dev, BLOCK_WRITE, lba, count, (void*)buffer);
+    return block_batch_wait(&batch);
+}
+
+int block_flush(int dev) {
+    block_device_t* d = block_dev(dev);
+    if (!d) {
+        return -1;
+    }
+    while (d->queued > 0) {
+        block_kick(dev, true);
+        block_poll();
+    }
+    return d->driver->flush ? d->driver->flush(dev) : 0;
+}
+
+void block_get_stats(int dev, block_stats_t* stats) {
+    block_device_t* d = block_dev(dev);
+    if (d) {
+        *stats = d->stats;
+    } else {
+        memset(stats, 0, sizeof(*stats));
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BLOCK_MAX_DEVICES 4
+#define BLOCK_QUEUE_DEPTH 32    // Pending requests per device
+#define BLOCK_NONE        -1
+
+#define BLOCK_READ  0
+#define BLOCK_WRITE 1
+
+// Called once a request finished; status is 0 or -1 on a device error
+typedef void (*block_callback_t)(void* ctx, int status);
+
+// A backend moves sectors between its medium and memory. start begins one
+// transfer and reports it through block_complete(), either before returning
+// (memory-backed devices) or later from poll. Only one transfer per device
+// is in flight; the queue in front of it merges and orders the rest. flush,
+// if set, empties the device's write cache and returns when it is done.
+typedef struct {
+    const char* name;
+    uint32_t sector_size;
+    uint32_t max_sectors;   // Merged transfers stay below this; 0 disables merging
+    bool read_only;
+    int (*start)(int dev, int op, uint32_t lba, uint32_t count, void* buffer);
+    void (*poll)(int dev);
+    int (*flush)(int dev);
+} block_driver_t;
+
+typedef struct {
+    uint32_t requests;      // Submitted
+    uint32_t dispatches;    // Transfers handed to the backend
+    uint32_t merges;        // Requests folded into another transfer
+    uint32_t bounced;       // Merged transfers that needed the bounce buffer
+    uint32_t read_sectors;
+    uint32_t write_sectors;
+    uint32_t errors;
+} block_stats_t;
+
+// Tracks a group of requests submitted together
+typedef struct {
+    volatile int pending;
+    volatile int status;
+} block_batch_t;
+
+void block_init(void);
+int block_register(const block_driver_t* driver, uint32_t sectors);
+int block_find(const char* name);
+int block_count(void);
+const block_driver_t* block_driver(int dev);
+uint32_t block_sectors(int dev);
+
+// Queue count sectors at lba. Requests wait while the device is busy or
+// plugged; the queue dispatches them in ascending LBA order (C-LOOK) and
+// merges same-direction requests for adjacent sectors into one transfer.
+int block_submit(int dev, int op, uint32_t lba, uint32_t count, void* buffer, block_callback_t done, void* ctx);
+
+// Hold dispatch while a batch is queued so it can be merged and sorted
+void block_plug(int dev);
+void block_unplug(int dev);
+
+// Finish the transfer in flight; called by backends
+void block_complete(int dev, int status);
+
+// Drive backends with transfers in flight; called from the scheduler tick
+void block_poll(void);
+
+// Count requests into a batch, then wait for all of them; block_batch_wait
+// returns 0 or -1 if any request failed
+void block_batch_init(block_batch_t* batch);
+int block_batch_submit(block_batch_t* batch, int dev, int op, uint32_t lba, uint32_t count, void* buffer);
+int block_batch_wait(block_batch_t* batch);
+
+// Synchronous transfers; 0 on success
+int block_read(int dev, uint32_t lba, uint32_t count, void* buffer);
+int block_write(int dev, uint32_t lba, uint32_t count, const void* buffer);
+
+// Wait for the queue to drain, then flush the device cache; 0 on success
+int block_flush(int dev);
+
+void block_get_stats(int dev, block_stats_t* stats);
+
+#endif // BLOCK_H
@@ -1,35 +1,529 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
 #include <core/drivers/cdrom.h>
+#include <core/drivers/pci.h>
+#include <core/drivers/block.h>
+#include <core/drivers/ide.h>
+#include <core/arch/pause.h>
 #include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/paging.h>
+
+extern uint8_t inb(uint16_t port);
+extern void outb(uint16_t port, uint8_t val);
+
+// Legacy IDE channels
+#define ATA_PRIMARY_IO      0x1F0
+#define ATA_PRIMARY_CTRL    0x3F6
+#define ATA_SECONDARY_IO    0x170
+#define ATA_SECONDARY_CTRL  0x376
+
+#define ATA_REG_DATA        0
+#define ATA_REG_FEATURES    1
+#define ATA_REG_SECCOUNT    2
+#define ATA_REG_LBA0        3
+#define ATA_REG_LBA1        4       // Byte count low for PACKET
+#define ATA_REG_LBA2        5       // Byte count high for PACKET
+#define ATA_REG_DRIVE       6
+#define ATA_REG_STATUS      7
+#define ATA_REG_COMMAND     7
+
+#define ATA_SR_BSY          0x80
+#define ATA_SR_DF           0x20
+#define ATA_SR_DRQ          0x08
+#define ATA_SR_ERR          0x01
+
+#define ATA_CTRL_NIEN       0x02    // Interrupts stay masked, completion is polled
+#define ATA_CTRL_SRST       0x04
+
+#define ATA_CMD_PACKET          0xA0
+#define ATA_CMD_IDENTIFY_PACKET 0xA1
+
+#define SCSI_READ_CAPACITY  0x25
+#define SCSI_READ_12        0xA8
+
+// Bus master IDE registers, 8 bytes per channel
+#define BM_COMMAND          0
+#define BM_STATUS           2
+#define BM_PRDT             4
+
+#define BM_CMD_START        0x01
+#define BM_CMD_READ         0x08    // Device to memory
+#define BM_ST_ERROR         0x02
+#define BM_ST_IRQ           0x04
+
+#define PRD_END             0x8000
+
+#define CDROM_TIMEOUT       1000000 // Status polls before a command is abandoned
+#define CDROM_MAX_SECTORS   32      // Sectors per command (64 KB)
+#define CDROM_MAX_PRD       8
+#define CDROM_QUEUE         16
+
+// Physical region descriptor; a region must not cross a 64 KB boundary
+typedef struct {
+    uint32_t base;
+    uint16_t bytes;                 // 0 means 64 KB
+    uint16_t flags;
+} __attribute__((packed)) prd_t;
+
+typedef struct {
+    uint32_t lba;
+    uint32_t count;
+    uint8_t* buffer;
+    cdrom_callback_t done;
+    void* ctx;
+} cdrom_request_t;
 
 static void* iso_memory = NULL;
 static size_t iso_size = 0;
 
+static struct {
+    bool present;
+    uint8_t channel;
+    uint16_t io;
+    uint16_t ctrl;
+    uint8_t slave;
+    uint16_t bm;                    // Bus master base of the channel, 0 without DMA
+    uint32_t capacity;              // Sectors
+} drive;
+
+static prd_t* prdt = NULL;
+
+static cdrom_request_t queue[CDROM_QUEUE];
+static int queue_head = 0;
+static int queue_count = 0;
+
+// State of the command in flight for queue[queue_head]
+static bool active = false;
+static bool active_dma = false;
+static uint32_t active_done = 0;    // Sectors of the request already read
+static uint32_t active_chunk = 0;   // Sectors asked for by the running command
+static uint32_t active_bytes = 0;   // PIO bytes received for the running command
+static uint32_t active_polls = 0;
+
+static uint8_t* scratch = NULL;     // Backs cdrom_read_sectors for the drive
+static uint32_t scratch_sectors = 0;
+
+// 400 ns for the device to settle after a select or command
+static void ata_delay(void) {
+    for (int i = 0; i < 4; i++) {
+        inb(drive.ctrl);
+    }
+}
+
+static uint8_t ata_wait_ready(void) {
+    uint8_t status = inb(drive.io + ATA_REG_STATUS);
+    for (int i = 0; i < CDROM_TIMEOUT && (status & ATA_SR_BSY); i++) {
+        status = inb(drive.io + ATA_REG_STATUS);
+    }
+    return status;
+}
+
+static void ata_select(void) {
+    outb(drive.io + ATA_REG_DRIVE, 0xA0 | (drive.slave << 4));
+    ata_delay();
+}
+
+static bool ata_channel_reset(void) {
+    outb(drive.ctrl, ATA_CTRL_SRST | ATA_CTRL_NIEN);
+    ata_delay();
+    outb(drive.ctrl, ATA_CTRL_NIEN);
+    ata_delay();
+
+    // A floating bus reads 0xFF: no devices on this channel
+    if (inb(drive.io + ATA_REG_STATUS) == 0xFF) {
+        return false;
+    }
+    return !(ata_wait_ready() & ATA_SR_BSY);
+}
+
+// Issue PACKET and hand over the 12-byte command block
+static bool atapi_send_packet(const uint8_t* packet, bool dma, uint16_t byte_count) {
+    ata_select();
+    if (ata_wait_ready() & ATA_SR_BSY) {
+        return false;
+    }
+
+    outb(drive.io + ATA_REG_FEATURES, dma ? 1 : 0);
+    outb(drive.io + ATA_REG_LBA1, byte_count & 0xFF);
+    outb(drive.io + ATA_REG_LBA2, byte_count >> 8);
+    outb(drive.io + ATA_REG_COMMAND, ATA_CMD_PACKET);
+    ata_delay();
+
+    for (int i = 0; i < CDROM_TIMEOUT; i++) {
+        uint8_t status = inb(drive.io + ATA_REG_STATUS);
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) {
+            return false;
+        }
+        if (!(status & ATA_SR_BSY) && (status & ATA_SR_DRQ)) {
+            for (int w = 0; w < 6; w++) {
+                outw(drive.io + ATA_REG_DATA, packet[2 * w] | (packet[2 * w + 1] << 8));
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+// Read words of a PIO data phase; bytes beyond max are drained
+static uint32_t atapi_pio_in(uint8_t* buffer, uint32_t max) {
+    uint32_t bytes = inb(drive.io + ATA_REG_LBA1) | (inb(drive.io + ATA_REG_LBA2) << 8);
+    for (uint32_t i = 0; i < bytes; i += 2) {
+        uint16_t word = inw(drive.io + ATA_REG_DATA);
+        if (i < max) buffer[i] = word & 0xFF;
+        if (i + 1 < max) buffer[i + 1] = word >> 8;
+    }
+    return bytes < max ? bytes : max;
+}
+
+// A channel with a disk on it is not reset, so the signature may have been
+// overwritten by the disk's commands; IDENTIFY PACKET alone tells then
+static bool atapi_identify(bool check_signature) {
+    ata_select();
+    // ATAPI devices leave this signature in the LBA registers
+    if (check_signature &&
+        (inb(drive.io + ATA_REG_LBA1) != 0x14 || inb(drive.io + ATA_REG_LBA2) != 0xEB)) {
+        return false;
+    }
+
+    outb(drive.io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY_PACKET);
+    ata_delay();
+    uint8_t status = ata_wait_ready();
+    if ((status & ATA_SR_ERR) || !(status & ATA_SR_DRQ)) {
+        return false;
+    }
+
+    uint16_t identify[256];
+    for (int i = 0; i < 256; i++) {
+        identify[i] = inw(drive.io + ATA_REG_DATA);
+    }
+    // Word 0 bits 15:14 = 10b for packet devices, word 49 bit 8 = DMA
+    if ((identify[0] >> 14) != 2) {
+        return false;
+    }
+    if (!(identify[49] & 0x100)) {
+        drive.bm = 0;
+    }
+    return true;
+}
+
+static void atapi_read_capacity(void) {
+    uint8_t packet[12] = { SCSI_READ_CAPACITY };
+    uint8_t reply[8];
+
+    drive.capacity = 0;
+    if (!atapi_send_packet(packet, false, sizeof(reply))) {
+        return;
+    }
+    uint8_t status = ata_wait_ready();
+    if ((status & ATA_SR_ERR) || !(status & ATA_SR_DRQ)) {
+        return;
+    }
+    if (atapi_pio_in(reply, sizeof(reply)) == sizeof(reply)) {
+        // Big-endian last LBA
+        drive.capacity = ((uint32_t)reply[0] << 24 | (uint32_t)reply[1] << 16 |
+                          (uint32_t)reply[2] << 8 | reply[3]) + 1;
+    }
+    ata_wait_ready();
+}
+
+// Block layer backend: the queue above merges and orders reads, this driver
+// splits them into commands
+static void cdrom_block_done(void* ctx, int status) {
+    block_complete((int)(intptr_t)ctx, status);
+}
+
+static int cdrom_block_start(int dev, int op, uint32_t lba, uint32_t count, void* buffer) {
+    if (op != BLOCK_READ) {
+        return -1;
+    }
+    return cdrom_submit(lba, count, buffer, cdrom_block_done, (void*)(intptr_t)dev);
+}
+
+static void cdrom_block_poll(int dev) {
+    (void)dev;
+    cdrom_poll();
+}
+
+static const block_driver_t cdrom_block = {
+    "cd0", CDROM_SECTOR_SIZE, CDROM_MAX_SECTORS, true, cdrom_block_start, cdrom_block_poll, NULL
+};
+
 bool cdrom_init(void) {
+    static const uint16_t channels[2][2] = {
+        { ATA_PRIMARY_IO, ATA_PRIMARY_CTRL },
+        { ATA_SECONDARY_IO, ATA_SECONDARY_CTRL },
+    };
+    uint16_t bm = pci_ide_bus_master();
+
+    drive.present = false;
+    for (int ch = 0; ch < IDE_CHANNELS && !drive.present; ch++) {
+        // The disk may be mid-transfer; wait for it to let go of the channel
+        while (!ide_claim(ch, IDE_ATAPI)) {
+            block_poll();
+        }
+        drive.channel = ch;
+        drive.io = channels[ch][0];
+        drive.ctrl = channels[ch][1];
+        int disk = ide_disk_slave(ch);
+        bool usable = disk == IDE_NO_DISK ? ata_channel_reset() : inb(drive.io + ATA_REG_STATUS) != 0xFF;
+        for (int slave = 0; slave < 2 && usable && !drive.present; slave++) {
+            if (slave == disk) {
+                continue;
+            }
+            drive.slave = slave;
+            drive.bm = bm ? bm + ch * 8 : 0;
+            drive.present = atapi_identify(disk == IDE_NO_DISK);
+        }
+        if (drive.present) {
+            if (drive.bm && !prdt) {
+                prdt = (prd_t*)frame_alloc();   // Page aligned, so it cannot cross 64 KB
+                if (!prdt) {
+                    drive.bm = 0;
+                }
+            }
+            atapi_read_capacity();
+        }
+        ide_release(ch, IDE_ATAPI);
+    }
+
+    if (!drive.present) {
+        return true;    // The in-memory ISO still works
+    }
+
+    block_register(&cdrom_block, drive.capacity);
+
+    kprint(":: CD-ROM: ATAPI drive, ", 7);
+    char buf[16];
+    itoa(drive.capacity / 512, buf, 10);   // Sectors to MB
+    kprint(buf, 7);
+    kprint(drive.bm ? " MB, bus-master DMA\n" : " MB, PIO\n", 7);
+    return true;
+}
+
+bool cdrom_present(void) {
+    return drive.present;
+}
+
+// Describe buffer in the PRDT. The heap is identity mapped, so virtual
+// addresses are physical; odd or windowed buffers go through PIO instead.
+static bool dma_build_prdt(uint8_t* buffer, uint32_t bytes) {
+    uint32_t addr = (uint32_t)buffer;
+    if ((addr & 1) || addr + bytes > VM_WINDOW_BASE) {
+        return false;
+    }
+
+    int n = 0;
+    while (bytes) {
+        if (n == CDROM_MAX_PRD) {
+            return false;
+        }
+        uint32_t room = 0x10000 - (addr & 0xFFFF);
+        uint32_t len = bytes < room ? bytes : room;
+        prdt[n].base = addr;
+        prdt[n].bytes = len & 0xFFFF;
+        prdt[n].flags = 0;
+        addr += len;
+        bytes -= len;
+        n++;
+    }
+    prdt[n - 1].flags = PRD_END;
     return true;
 }
 
+// Start the next command of the request at the head of the queue
+static bool cdrom_issue(void) {
+    cdrom_request_t* req = &queue[queue_head];
+    uint32_t lba = req->lba + active_done;
+    uint32_t count = req->count - active_done;
+    if (count > CDROM_MAX_SECTORS) {
+        count = CDROM_MAX_SECTORS;
+    }
+    uint8_t* buffer = req->buffer + active_done * CDROM_SECTOR_SIZE;
+
+    uint8_t packet[12] = {
+        SCSI_READ_12, 0,
+        lba >> 24, lba >> 16, lba >> 8, lba,
+        count >> 24, count >> 16, count >> 8, count,
+        0, 0
+    };
+
+    active_dma = drive.bm && dma_build_prdt(buffer, count * CDROM_SECTOR_SIZE);
+    if (active_dma) {
+        outb(drive.bm + BM_COMMAND, 0);
+        outl(drive.bm + BM_PRDT, (uint32_t)prdt);
+        outb(drive.bm + BM_STATUS, BM_ST_ERROR | BM_ST_IRQ);     // Write 1 to clear
+        outb(drive.bm + BM_COMMAND, BM_CMD_READ);
+    }
+
+    if (!atapi_send_packet(packet, active_dma, CDROM_SECTOR_SIZE)) {
+        if (active_dma) {
+            outb(drive.bm + BM_COMMAND, 0);
+        }
+        return false;
+    }
+    if (active_dma) {
+        outb(drive.bm + BM_COMMAND, BM_CMD_READ | BM_CMD_START);
+    }
+
+    active_chunk = count;
+    active_bytes = 0;
+    active_polls = 0;
+    active = true;
+    return true;
+}
+
+static void cdrom_finish(int status) {
+    cdrom_request_t req = queue[queue_head];
+    queue_head = (queue_head + 1) % CDROM_QUEUE;
+    queue_count--;
+    active = false;
+    active_done = 0;
+
+    if (status < 0) {
+        ata_channel_reset();
+    }
+    ide_release(drive.channel, IDE_ATAPI);
+    if (req.done) {
+        req.done(req.ctx, status);
+    }
+}
+
+// Start queued requests until one is in flight or the queue is empty
+static void cdrom_kick(void) {
+    while (!active && queue_count) {
+        if (!ide_claim(drive.channel, IDE_ATAPI)) {
+            return;     // The disk has the channel; poll tries again
+        }
+        if (!cdrom_issue()) {
+            cdrom_finish(-1);
+        }
+    }
+}
+
+int cdrom_submit(uint32_t lba, uint32_t count, void* buffer, cdrom_callback_t done, void* ctx) {
+    if (!drive.present || count == 0 || queue_count == CDROM_QUEUE) {
+        return -1;
+    }
+    if (drive.capacity && (lba >= drive.capacity || count > drive.capacity - lba)) {
+        return -1;
+    }
+
+    cdrom_request_t* req = &queue[(queue_head + queue_count) % CDROM_QUEUE];
+    req->lba = lba;
+    req->count = count;
+    req->buffer = (uint8_t*)buffer;
+    req->done = done;
+    req->ctx = ctx;
+    queue_count++;
+
+    cdrom_kick();
+    return 0;
+}
+
+void cdrom_poll(void) {
+    if (!active) {
+        cdrom_kick();
+        return;
+    }
+
+    uint8_t status = inb(drive.io + ATA_REG_STATUS);
+    if (++active_polls > CDROM_TIMEOUT) {
+        if (active_dma) {
+            outb(drive.bm + BM_COMMAND, 0);
+        }
+        cdrom_finish(-1);
+        cdrom_kick();
+        return;
+    }
+    if (status & ATA_SR_BSY) {
+        return;
+    }
+
+    if (!active_dma && (status & ATA_SR_DRQ)) {
+        uint32_t want = active_chunk * CDROM_SECTOR_SIZE;
+        uint8_t* buffer = queue[queue_head].buffer + active_done * CDROM_SECTOR_SIZE;
+        active_bytes += atapi_pio_in(buffer + active_bytes, want - active_bytes);
+        return;
+    }
+
+    // BSY and DRQ clear: the command is over
+    bool failed = status & (ATA_SR_ERR | ATA_SR_DF);
+    if (active_dma) {
+        failed |= (inb(drive.bm + BM_STATUS) & BM_ST_ERROR) != 0;
+        outb(drive.bm + BM_COMMAND, 0);
+        outb(drive.bm + BM_STATUS, BM_ST_ERROR | BM_ST_IRQ);
+    } else if (active_bytes < active_chunk * CDROM_SECTOR_SIZE) {
+        failed = true;
+    }
+
+    if (failed) {
+        cdrom_finish(-1);
+    } else {
+        active_done += active_chunk;
+        active = false;
+        if (active_done == queue[queue_head].count) {
+            cdrom_finish(0);
+        } else if (!cdrom_issue()) {
+            cdrom_finish(-1);
+        }
+    }
+    cdrom_kick();
+}
+
+static void cdrom_sync_done(void* ctx, int status) {
+    *(int*)ctx = status;
+}
+
+int cdrom_read(uint32_t lba, uint32_t count, void* buffer) {
+    volatile int status = 1;
+    if (cdrom_submit(lba, count, buffer, cdrom_sync_done, (void*)&status) < 0) {
+        return -1;
+    }
+    while (status > 0) {
+        // Also drives the disk, which may hold the channel
+        block_poll();
+        cdrom_poll();
+    }
+    return status;
+}
+
 void cdrom_set_iso_data(void* data, size_t size) {
     iso_memory = data;
     iso_size = size;
 }
 
 void* cdrom_read_sectors(uint32_t lba, uint32_t count) {
-    if (!iso_memory) {
-        return NULL;
+    if (iso_memory) {
+        uint32_t offset = lba * CDROM_SECTOR_SIZE;
+        if (offset >= iso_size) {
+            return NULL;
+        }
+        return (void*)((uint8_t*)iso_memory + offset);
     }
-    
-    uint32_t offset = lba * 2048;
-    if (offset >= iso_size) {
+
+    if (!drive.present || count == 0) {
         return NULL;
     }
-    
-    return (void*)((uint8_t*)iso_memory + offset);
+    if (count > scratch_sectors) {
+        uint8_t* grown = (uint8_t*)kmalloc(count * CDROM_SECTOR_SIZE);
+        if (!grown) {
+            return NULL;
+        }
+        if (scratch) {
+            kfree(scratch);
+        }
+        scratch = grown;
+        scratch_sectors = count;
+    }
+    return cdrom_read(lba, count, scratch) == 0 ? scratch : NULL;
 }
 
 size_t cdrom_get_iso_size(void) {
-    return iso_size;
+    if (iso_memory) {
+        return iso_size;
+    }
+    return (size_t)drive.capacity * CDROM_SECTOR_SIZE;
 }
 
 void* cdrom_get_iso_data(void) {
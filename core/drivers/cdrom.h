@@ -5,13 +5,33 @@
 #include <stddef.h>
 #include <stdbool.h>
 
-// Initialize CD-ROM driver and detect the boot ISO
+#define CDROM_SECTOR_SIZE 2048
+
+// Called once a request finished; status is 0 or -1 on a device error
+typedef void (*cdrom_callback_t)(void* ctx, int status);
+
+// Initialize CD-ROM driver: probes the IDE channels for an ATAPI drive and
+// the PCI IDE controller for bus-master DMA
 bool cdrom_init(void);
 
 // Read sectors from CD-ROM
-// Returns pointer to data in memory (allocated statically)
+// Returns pointer to data in memory: into the boot ISO when GRUB loaded it,
+// else into a driver buffer that stays valid until the next call
 void* cdrom_read_sectors(uint32_t lba, uint32_t count);
 
+// Queue a read of count sectors from the drive into buffer. Requests run in
+// order; cdrom_poll() advances them and calls done from the polling context.
+int cdrom_submit(uint32_t lba, uint32_t count, void* buffer, cdrom_callback_t done, void* ctx);
+
+// Drive the request queue; called from the scheduler tick
+void cdrom_poll(void);
+
+// Submit and poll until the read completed; 0 on success
+int cdrom_read(uint32_t lba, uint32_t count, void* buffer);
+
+// Is there an ATAPI drive behind the driver?
+bool cdrom_present(void);
+
 // Get the size of the boot ISO in bytes (if available)
 size_t cdrom_get_iso_size(void);
 
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/drivers/ide.h>
+
+static uint8_t owners[IDE_CHANNELS] = { IDE_FREE, IDE_FREE };
+static int disks[IDE_CHANNELS] = { IDE_NO_DISK, IDE_NO_DISK };
+
+bool ide_claim(int channel, uint8_t owner) {
+    if (owners[channel] != IDE_FREE && owners[channel] != owner) {
+        return false;
+    }
+    owners[channel] = owner;
+    return true;
+}
+
+void ide_release(int channel, uint8_t owner) {
+    if (owners[channel] == owner) {
+        owners[channel] = IDE_FREE;
+    }
+}
+
+void ide_set_disk(int channel, int slave) {
+    disks[channel] = slave;
+}
+
+int ide_disk_slave(int channel) {
+    return disks[channel];
+}
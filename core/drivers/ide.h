@@ -0,0 +1,26 @@
+#ifndef IDE_H
+#define IDE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// The ATA and ATAPI drivers share the two legacy IDE channels. Only one
+// device per channel may have a command in flight, and a channel reset hits
+// both devices, so a driver owns the channel from issuing a command until
+// it completed or was reset.
+#define IDE_CHANNELS 2
+#define IDE_FREE     0
+#define IDE_ATA      1
+#define IDE_ATAPI    2
+#define IDE_NO_DISK  -1
+
+// Take channel for owner; false while the other driver holds it
+bool ide_claim(int channel, uint8_t owner);
+void ide_release(int channel, uint8_t owner);
+
+// A registered disk sits at slave (0 or 1) on channel; probes must neither
+// reset the channel nor send commands to that position
+void ide_set_disk(int channel, int slave);
+int ide_disk_slave(int channel);
+
+#endif // IDE_H
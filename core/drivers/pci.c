@@ -0,0 +1,68 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/drivers/pci.h>
+#include <core/arch/pause.h>
+
+static uint32_t pci_address(uint8_t bus, uint8_t device, uint8_t function, uint8_t offset) {
+    return 0x80000000u | ((uint32_t)bus << 16) | ((uint32_t)device << 11) |
+           ((uint32_t)function << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_read32(const pci_device_t* dev, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev->bus, dev->device, dev->function, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_write32(const pci_device_t* dev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev->bus, dev->device, dev->function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_device_t* out) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int device = 0; device < 32; device++) {
+            for (int function = 0; function < 8; function++) {
+                pci_device_t dev = { (uint8_t)bus, (uint8_t)device, (uint8_t)function, 0 };
+                uint32_t id = pci_read32(&dev, PCI_VENDOR_ID);
+                if ((id & 0xFFFF) == 0xFFFF) {
+                    if (function == 0) break;   // No device in this slot
+                    continue;
+                }
+
+                uint32_t class_reg = pci_read32(&dev, PCI_CLASS);
+                if ((class_reg >> 24) == class_code && ((class_reg >> 16) & 0xFF) == subclass) {
+                    dev.prog_if = (class_reg >> 8) & 0xFF;
+                    *out = dev;
+                    return true;
+                }
+
+                // Single-function devices only answer on function 0
+                if (function == 0 && !((pci_read32(&dev, PCI_HEADER_TYPE) >> 16) & 0x80)) {
+                    break;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// Bus-master base of the PCI IDE controller, or 0
+uint16_t pci_ide_bus_master(void) {
+    pci_device_t ide;
+    if (!pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, &ide)) {
+        return 0;
+    }
+    // Prog IF bit 7: the controller can bus master
+    if (!(ide.prog_if & 0x80)) {
+        return 0;
+    }
+
+    uint32_t bar4 = pci_read32(&ide, PCI_BAR4);
+    if (!(bar4 & 1)) {
+        return 0;   // Only I/O space bus master registers are handled
+    }
+
+    uint32_t command = pci_read32(&ide, PCI_COMMAND);
+    pci_write32(&ide, PCI_COMMAND, command | PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    return bar4 & 0xFFFC;
+}
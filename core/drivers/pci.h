@@ -0,0 +1,42 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Configuration mechanism #1
+#define PCI_CONFIG_ADDRESS 0xCF8
+#define PCI_CONFIG_DATA    0xCFC
+
+// Configuration space offsets
+#define PCI_VENDOR_ID      0x00
+#define PCI_COMMAND        0x04
+#define PCI_CLASS          0x08     // Revision, prog IF, subclass, class
+#define PCI_HEADER_TYPE    0x0C     // Byte 2 of the dword
+#define PCI_BAR0           0x10
+#define PCI_BAR4           0x20
+
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_BUS_MASTER  0x0004
+
+#define PCI_CLASS_STORAGE  0x01
+#define PCI_SUBCLASS_IDE   0x01
+
+typedef struct {
+    uint8_t bus;
+    uint8_t device;
+    uint8_t function;
+    uint8_t prog_if;
+} pci_device_t;
+
+uint32_t pci_read32(const pci_device_t* dev, uint8_t offset);
+void pci_write32(const pci_device_t* dev, uint8_t offset, uint32_t value);
+
+// First function with the given class and subclass
+bool pci_find_class(uint8_t class_code, uint8_t subclass, pci_device_t* out);
+
+// I/O base of the bus-master registers of the PCI IDE controller (primary
+// channel; the secondary one is 8 ports above), or 0. Enables bus mastering.
+uint16_t pci_ide_bus_master(void);
+
+#endif // PCI_H
@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/drivers/ramdisk.h>
+#include <core/drivers/block.h>
+#include <core/kernel/mem.h>
+
+static uint8_t* disk = NULL;
+
+// Memory transfers finish before start returns
+static int ramdisk_start(int dev, int op, uint32_t lba, uint32_t count, void* buffer) {
+    uint8_t* data = disk + lba * RAMDISK_SECTOR_SIZE;
+    if (op == BLOCK_WRITE) {
+        memcpy(data, buffer, count * RAMDISK_SECTOR_SIZE);
+    } else {
+        memcpy(buffer, data, count * RAMDISK_SECTOR_SIZE);
+    }
+    block_complete(dev, 0);
+    return 0;
+}
+
+static const block_driver_t ramdisk_driver = {
+    RAMDISK_NAME, RAMDISK_SECTOR_SIZE, RAMDISK_MAX_MERGE, false, ramdisk_start, NULL, NULL
+};
+
+bool ramdisk_init(uint32_t sectors) {
+    disk = (uint8_t*)kmalloc(sectors * RAMDISK_SECTOR_SIZE);
+    if (!disk) {
+        return false;
+    }
+    memset(disk, 0, sectors * RAMDISK_SECTOR_SIZE);
+
+    if (block_register(&ramdisk_driver, sectors) < 0) {
+        kfree(disk);
+        disk = NULL;
+        return false;
+    }
+    return true;
+}
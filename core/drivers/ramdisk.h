@@ -0,0 +1,15 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RAMDISK_NAME        "ram0"
+#define RAMDISK_SECTOR_SIZE 512
+#define RAMDISK_SECTORS     2048    // 1 MB
+#define RAMDISK_MAX_MERGE   128     // Sectors per merged transfer
+
+// Allocate a heap-backed disk of sectors sectors and register it as RAMDISK_NAME
+bool ramdisk_init(uint32_t sectors);
+
+#endif // RAMDISK_H
@@ -3,11 +3,53 @@
 #include <core/drivers/timer.h>
 #include <core/arch/idt.h>
 
+#define PIT_FREQUENCY      1193182
+#define CALIBRATE_MS       10
+
+static uint32_t tsc_per_us = 0;
+
+uint64_t timer_read_tsc(void) {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+// Count TSC cycles over a one-shot PIT channel 2 countdown (gate via port 0x61)
+static void timer_calibrate_tsc(void) {
+    uint16_t latch = PIT_FREQUENCY / (1000 / CALIBRATE_MS);
+
+    outb(0x61, (inb(0x61) & ~0x02) | 0x01);
+    outb(0x43, 0xB0);
+    outb(0x42, latch & 0xFF);
+    outb(0x42, latch >> 8);
+
+    uint64_t start = timer_read_tsc();
+    while (!(inb(0x61) & 0x20));
+    uint64_t cycles = timer_read_tsc() - start;
+
+    tsc_per_us = udiv64_32(cycles, CALIBRATE_MS * 1000);
+    if (tsc_per_us == 0) {
+        tsc_per_us = 1;
+    }
+}
+
+uint32_t timer_tsc_per_us(void) {
+    return tsc_per_us;
+}
+
+uint32_t timer_elapsed_us(uint64_t start_tsc) {
+    if (tsc_per_us == 0) {
+        return 0;
+    }
+    return udiv64_32(timer_read_tsc() - start_tsc, tsc_per_us);
+}
+
 void pit_init() {
-    uint16_t divisor = 1193182 / 1000; // 1000 Hz
+    uint16_t divisor = PIT_FREQUENCY / 1000; // 1000 Hz
     outb(0x43, 0x36);
     outb(0x40, divisor & 0xFF);
     outb(0x40, divisor >> 8);
+    timer_calibrate_tsc();
     kprint(":: PIT Setup\n", 7);
 }
 
@@ -7,3 +7,8 @@ void pit_init();
 extern void outb(uint16_t port, uint8_t val);
 extern void nvm_scheduler_tick();
 extern void pit_polling_loop();
+
+// TSC based time source, calibrated against PIT channel 2 in pit_init()
+uint64_t timer_read_tsc(void);
+uint32_t timer_elapsed_us(uint64_t start_tsc);
+uint32_t timer_tsc_per_us(void);
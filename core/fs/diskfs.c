@@ -0,0 +1,609 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/fs/diskfs.h>
+#include <core/fs/pagecache.h>
+#include <core/drivers/block.h>
+#include <core/drivers/timer.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <usr/vfs.h>
+
+#define DISKFS_INODES_PER_BLOCK (DISKFS_BLOCK_SIZE / sizeof(diskfs_inode_t))
+#define DISKFS_INODE_BLOCKS     (DISKFS_INODES / DISKFS_INODES_PER_BLOCK)
+
+// Write-back phases: file data first, then the bitmap and inodes that point
+// at it, so the metadata on disk never names blocks that were not written
+#define DISKFS_IDLE 0
+#define DISKFS_DATA 1
+#define DISKFS_META 2
+
+static int dev = BLOCK_NONE;
+static uint32_t sectors_per_block;
+static diskfs_super_t super;
+static diskfs_inode_t* inodes = NULL;
+static bool inode_dirty[DISKFS_INODE_BLOCKS];
+
+// Blocks in use now, and as the bitmap on disk records them. New extents
+// avoid both, so data the committed inodes point at is never overwritten
+// before the metadata that replaces them is on disk.
+static uint8_t* bitmap = NULL;
+static uint8_t* committed = NULL;
+static bool bitmap_dirty = false;
+
+static int store = PCACHE_NONE;
+
+static int phase = DISKFS_IDLE;
+static block_batch_t batch;
+static uint8_t* staged[MAX_FILES];  // Snapshots of file data being written
+static int staged_count = 0;
+static uint8_t* meta_staged = NULL;
+static bool meta_bitmap = false;    // meta_staged starts with the bitmap
+
+static uint32_t written_changes = 0;    // vfs_mount_changes() at the last write-back
+static bool retry = false;              // Entries left dirty by a failed write-back
+static bool changes_seen = false;
+static uint64_t changes_since = 0;
+static bool failed = false;            // This write-back ran into an error
+static bool reported = false;          // Reported since the last clean write-back
+
+static const vfs_driver_t diskfs_driver;
+
+static int diskfs_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+static bool diskfs_magic_ok(const char* magic) {
+    for (int i = 0; i < 8; i++) {
+        if (magic[i] != DISKFS_MAGIC[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void diskfs_strcpy(char* dest, const char* src, size_t size) {
+    size_t i = 0;
+    while (src[i] && i < size - 1) {
+        dest[i] = src[i];
+        i++;
+    }
+    while (i < size) {
+        dest[i++] = '\0';
+    }
+}
+
+static void diskfs_error(const char* message) {
+    if (!reported) {
+        kprint(":: diskfs: ", 12);
+        kprint(message, 12);
+        kprint("\n", 12);
+    }
+    failed = true;
+    reported = true;
+}
+
+static uint32_t diskfs_lba(uint32_t block) {
+    return block * sectors_per_block;
+}
+
+static bool diskfs_block_free(uint32_t block) {
+    uint8_t bit = 1 << (block % 8);
+    return !(bitmap[block / 8] & bit) && !(committed[block / 8] & bit);
+}
+
+static void diskfs_mark(uint32_t block, bool used) {
+    if (used) {
+        bitmap[block / 8] |= 1 << (block % 8);
+    } else {
+        bitmap[block / 8] &= ~(1 << (block % 8));
+    }
+    bitmap_dirty = true;
+}
+
+static void diskfs_touch_inode(uint32_t n) {
+    inode_dirty[n / DISKFS_INODES_PER_BLOCK] = true;
+}
+
+static void diskfs_free_extents(diskfs_inode_t* ino) {
+    for (int i = 0; i < ino->extent_count; i++) {
+        for (uint32_t b = 0; b < ino->extents[i].count; b++) {
+            diskfs_mark(ino->extents[i].start + b, false);
+        }
+    }
+    ino->extent_count = 0;
+}
+
+// Next run of free blocks from *pos; false when the disk has none left
+static bool diskfs_next_run(uint32_t* pos, uint32_t* len) {
+    uint32_t b = *pos;
+    while (b < super.blocks && !diskfs_block_free(b)) {
+        b++;
+    }
+    if (b == super.blocks) {
+        return false;
+    }
+    uint32_t end = b;
+    while (end < super.blocks && diskfs_block_free(end)) {
+        end++;
+    }
+    *pos = b;
+    *len = end - b;
+    return true;
+}
+
+static void diskfs_take(diskfs_inode_t* ino, uint32_t start, uint32_t count) {
+    for (uint32_t b = 0; b < count; b++) {
+        diskfs_mark(start + b, true);
+    }
+    ino->extents[ino->extent_count].start = start;
+    ino->extents[ino->extent_count].count = count;
+    ino->extent_count++;
+}
+
+// One extent from the first run that is long enough, else first fit over
+// as many runs as the inode has extents for
+static bool diskfs_alloc_extents(diskfs_inode_t* ino, uint32_t blocks) {
+    uint32_t pos, len;
+
+    ino->extent_count = 0;
+    if (blocks == 0) {
+        return true;
+    }
+    for (pos = super.data_start; diskfs_next_run(&pos, &len); pos += len) {
+        if (len >= blocks) {
+            diskfs_take(ino, pos, blocks);
+            return true;
+        }
+    }
+
+    uint32_t left = blocks;
+    for (pos = super.data_start; left && ino->extent_count < DISKFS_EXTENTS && diskfs_next_run(&pos, &len); pos += len) {
+        if (len > left) {
+            len = left;
+        }
+        diskfs_take(ino, pos, len);
+        left -= len;
+    }
+    if (left) {
+        diskfs_free_extents(ino);
+        return false;
+    }
+    return true;
+}
+
+static int diskfs_alloc_inode(void) {
+    for (int n = DISKFS_ROOT + 1; n < DISKFS_INODES; n++) {
+        if (inodes[n].type == DISKFS_FREE) {
+            memset(&inodes[n], 0, sizeof(diskfs_inode_t));
+            return n;
+        }
+    }
+    return -1;
+}
+
+// Page cache store: pages of a file are its blocks in extent order
+static int diskfs_read_page(uint32_t file, uint32_t page, void* frame) {
+    if (file >= DISKFS_INODES || inodes[file].type != DISKFS_FILE) {
+        return -1;
+    }
+    diskfs_inode_t* ino = &inodes[file];
+    for (int i = 0; i < ino->extent_count; i++) {
+        if (page < ino->extents[i].count) {
+            return block_read(dev, diskfs_lba(ino->extents[i].start + page), sectors_per_block, frame);
+        }
+        page -= ino->extents[i].count;
+    }
+    return -1;
+}
+
+static const pcache_store_t diskfs_store_ops = { "diskfs", NULL, diskfs_read_page };
+
+static int diskfs_populate(int dir, uint32_t node) {
+    for (uint32_t n = 0; n < DISKFS_INODES; n++) {
+        diskfs_inode_t* ino = &inodes[n];
+        if (n != node && ino->type != DISKFS_FREE && ino->parent == node) {
+            vfs_mount_add(dir, ino->name, ino->type == DISKFS_DIR ? VFS_TYPE_DIR : VFS_TYPE_FILE,
+                          n, ino->type == DISKFS_FILE ? ino->size : 0);
+        }
+    }
+    return 0;
+}
+
+static void diskfs_remove(uint32_t node) {
+    if (node == DISKFS_ROOT || node >= DISKFS_INODES || inodes[node].type == DISKFS_FREE) {
+        return;
+    }
+    diskfs_free_extents(&inodes[node]);
+    inodes[node].type = DISKFS_FREE;
+    diskfs_touch_inode(node);
+    pcache_invalidate(store, node);
+}
+
+static bool diskfs_owns(vfs_file_t* file) {
+    return vfs_mount_driver(file->mount) == &diskfs_driver;
+}
+
+// Give the file new extents and queue a snapshot of its contents for them;
+// the VFS copy may change while the writes are in flight
+static bool diskfs_write_data(diskfs_inode_t* ino, uint32_t n, vfs_file_t* file) {
+    uint32_t blocks = (file->size + DISKFS_BLOCK_SIZE - 1) / DISKFS_BLOCK_SIZE;
+
+    pcache_invalidate(store, n);
+    diskfs_free_extents(ino);
+    ino->size = 0;
+    if (blocks == 0) {
+        return true;
+    }
+
+    uint8_t* data = (uint8_t*)kmalloc(blocks * DISKFS_BLOCK_SIZE);
+    if (!data) {
+        diskfs_error("out of memory for write-back");
+        return false;
+    }
+    if (!diskfs_alloc_extents(ino, blocks)) {
+        kfree(data);
+        diskfs_error("disk full");
+        return false;
+    }
+    memcpy(data, file->data, file->size);
+    memset(data + file->size, 0, blocks * DISKFS_BLOCK_SIZE - file->size);
+    staged[staged_count++] = data;
+    ino->size = file->size;
+
+    uint32_t offset = 0;
+    for (int i = 0; i < ino->extent_count; i++) {
+        block_batch_submit(&batch, dev, BLOCK_WRITE, diskfs_lba(ino->extents[i].start),
+                           ino->extents[i].count * sectors_per_block, data + offset);
+        offset += ino->extents[i].count * DISKFS_BLOCK_SIZE;
+    }
+    return true;
+}
+
+// Store one dirty entry, giving it (and new parents first) an inode
+static void diskfs_write_entry(int slot) {
+    vfs_file_t* files = vfs_get_files();
+    vfs_file_t* file = &files[slot];
+
+    if (files[file->parent].node == VFS_NEW_NODE && diskfs_owns(&files[file->parent])) {
+        diskfs_write_entry(file->parent);
+    }
+    uint32_t parent = files[file->parent].node;
+    if (parent == VFS_NEW_NODE) {
+        retry = true;
+        return;
+    }
+
+    int n = file->node;
+    if (file->node == VFS_NEW_NODE) {
+        n = diskfs_alloc_inode();
+        if (n < 0) {
+            diskfs_error("out of inodes");
+            retry = true;
+            return;
+        }
+        file->node = n;
+        file->dirty |= VFS_DIRTY_DATA;
+    }
+
+    diskfs_inode_t* ino = &inodes[n];
+    ino->type = file->type == VFS_TYPE_DIR ? DISKFS_DIR : DISKFS_FILE;
+    ino->parent = parent;
+    diskfs_strcpy(ino->name, file->name, DISKFS_NAME_MAX);
+    diskfs_touch_inode(n);
+
+    // Files still backed by the store are unchanged on disk
+    if (ino->type == DISKFS_FILE && (file->dirty & VFS_DIRTY_DATA) && file->store == VFS_NONE &&
+        !diskfs_write_data(ino, n, file)) {
+        file->dirty = VFS_DIRTY_DATA;
+        retry = true;
+        return;
+    }
+    file->dirty = 0;
+}
+
+static bool diskfs_meta_dirty(void) {
+    for (uint32_t i = 0; i < DISKFS_INODE_BLOCKS; i++) {
+        if (inode_dirty[i]) {
+            return true;
+        }
+    }
+    return bitmap_dirty;
+}
+
+static bool diskfs_has_changes(void) {
+    return vfs_mount_changes(&diskfs_driver) != written_changes || retry || diskfs_meta_dirty();
+}
+
+static void diskfs_writeback_start(void) {
+    vfs_file_t* files = vfs_get_files();
+
+    written_changes = vfs_mount_changes(&diskfs_driver);
+    changes_seen = false;
+    retry = false;
+    failed = false;
+    block_batch_init(&batch);
+    block_plug(dev);
+    for (int slot = 0; slot < MAX_FILES; slot++) {
+        if (files[slot].used && files[slot].dirty && diskfs_owns(&files[slot])) {
+            diskfs_write_entry(slot);
+        }
+    }
+    block_unplug(dev);
+    phase = DISKFS_DATA;
+}
+
+static void diskfs_release_staged(void) {
+    for (int i = 0; i < staged_count; i++) {
+        kfree(staged[i]);
+    }
+    staged_count = 0;
+}
+
+// Snapshot the bitmap and the changed inode blocks and queue them
+static void diskfs_commit(void) {
+    uint32_t blocks = bitmap_dirty ? super.bitmap_blocks : 0;
+    for (uint32_t i = 0; i < DISKFS_INODE_BLOCKS; i++) {
+        blocks += inode_dirty[i];
+    }
+    if (blocks == 0) {
+        phase = DISKFS_IDLE;
+        return;
+    }
+
+    meta_staged = (uint8_t*)kmalloc(blocks * DISKFS_BLOCK_SIZE);
+    if (!meta_staged) {
+        diskfs_error("out of memory for write-back");
+        phase = DISKFS_IDLE;
+        return;
+    }
+
+    block_batch_init(&batch);
+    block_plug(dev);
+    uint8_t* out = meta_staged;
+    meta_bitmap = bitmap_dirty;
+    if (bitmap_dirty) {
+        memcpy(out, bitmap, super.bitmap_blocks * DISKFS_BLOCK_SIZE);
+        block_batch_submit(&batch, dev, BLOCK_WRITE, diskfs_lba(super.bitmap_start),
+                           super.bitmap_blocks * sectors_per_block, out);
+        out += super.bitmap_blocks * DISKFS_BLOCK_SIZE;
+        bitmap_dirty = false;
+    }
+    for (uint32_t i = 0; i < DISKFS_INODE_BLOCKS; i++) {
+        if (inode_dirty[i]) {
+            memcpy(out, (uint8_t*)inodes + i * DISKFS_BLOCK_SIZE, DISKFS_BLOCK_SIZE);
+            block_batch_submit(&batch, dev, BLOCK_WRITE, diskfs_lba(super.inode_start + i),
+                               sectors_per_block, out);
+            out += DISKFS_BLOCK_SIZE;
+            inode_dirty[i] = false;
+        }
+    }
+    block_unplug(dev);
+    phase = DISKFS_META;
+}
+
+// Move the write-back on once the batch in flight is done
+static void diskfs_advance(void) {
+    if (phase == DISKFS_IDLE || batch.pending > 0) {
+        return;
+    }
+
+    if (phase == DISKFS_DATA) {
+        diskfs_release_staged();
+        if (batch.status < 0) {
+            // Rewrite everything rather than commit inodes naming bad blocks
+            vfs_file_t* files = vfs_get_files();
+            for (int slot = 0; slot < MAX_FILES; slot++) {
+                if (files[slot].used && diskfs_owns(&files[slot]) && files[slot].type == VFS_TYPE_FILE) {
+                    files[slot].dirty |= VFS_DIRTY_DATA;
+                }
+            }
+            diskfs_error("write error");
+            retry = true;
+            phase = DISKFS_IDLE;
+            return;
+        }
+        diskfs_commit();
+        return;
+    }
+
+    if (batch.status < 0) {
+        for (uint32_t i = 0; i < DISKFS_INODE_BLOCKS; i++) {
+            inode_dirty[i] = true;
+        }
+        bitmap_dirty = true;
+        diskfs_error("write error");
+    } else if (meta_bitmap) {
+        memcpy(committed, meta_staged, super.bitmap_blocks * DISKFS_BLOCK_SIZE);
+    }
+    if (!failed) {
+        reported = false;
+    }
+    kfree(meta_staged);
+    meta_staged = NULL;
+    phase = DISKFS_IDLE;
+}
+
+static void diskfs_wait(void) {
+    while (phase != DISKFS_IDLE) {
+        block_poll();
+        diskfs_advance();
+    }
+}
+
+void diskfs_poll(void) {
+    if (dev == BLOCK_NONE) {
+        return;
+    }
+    if (phase != DISKFS_IDLE) {
+        diskfs_advance();
+        return;
+    }
+    if (!diskfs_has_changes()) {
+        return;
+    }
+    if (!changes_seen) {
+        changes_seen = true;
+        changes_since = timer_read_tsc();
+    } else if (timer_elapsed_us(changes_since) >= DISKFS_WRITEBACK_US) {
+        diskfs_writeback_start();
+    }
+}
+
+int diskfs_sync(bool wait) {
+    if (dev == BLOCK_NONE) {
+        return -1;
+    }
+    if (phase != DISKFS_IDLE) {
+        if (!wait) {
+            return 0;
+        }
+        diskfs_wait();      // May predate the latest changes
+    }
+    if (diskfs_has_changes()) {
+        diskfs_writeback_start();
+    }
+    if (!wait) {
+        return 0;
+    }
+    diskfs_wait();
+    if (failed) {
+        return -1;
+    }
+    return block_flush(dev);
+}
+
+static const vfs_driver_t diskfs_driver = {
+    "diskfs", diskfs_populate, diskfs_remove, diskfs_sync
+};
+
+static bool diskfs_blank(const uint8_t* block) {
+    for (int i = 0; i < DISKFS_BLOCK_SIZE; i++) {
+        if (block[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool diskfs_alloc_tables(void) {
+    uint32_t bitmap_bytes = super.bitmap_blocks * DISKFS_BLOCK_SIZE;
+    bitmap = (uint8_t*)kmalloc(bitmap_bytes);
+    committed = (uint8_t*)kmalloc(bitmap_bytes);
+    inodes = (diskfs_inode_t*)kmalloc(DISKFS_INODE_BLOCKS * DISKFS_BLOCK_SIZE);
+    return bitmap && committed && inodes;
+}
+
+// Lay out an empty filesystem over the whole device and write it
+static bool diskfs_format(uint8_t* block) {
+    uint32_t blocks = block_sectors(dev) / sectors_per_block;
+
+    memset(&super, 0, sizeof(super));
+    memcpy(super.magic, DISKFS_MAGIC, 8);
+    super.block_size = DISKFS_BLOCK_SIZE;
+    super.blocks = blocks;
+    super.inodes = DISKFS_INODES;
+    super.bitmap_start = 1;
+    super.bitmap_blocks = (blocks + DISKFS_BLOCK_SIZE * 8 - 1) / (DISKFS_BLOCK_SIZE * 8);
+    super.inode_start = super.bitmap_start + super.bitmap_blocks;
+    super.inode_blocks = DISKFS_INODE_BLOCKS;
+    super.data_start = super.inode_start + super.inode_blocks;
+    if (blocks < super.data_start + 16 || !diskfs_alloc_tables()) {
+        return false;
+    }
+
+    memset(bitmap, 0, super.bitmap_blocks * DISKFS_BLOCK_SIZE);
+    memset(inodes, 0, DISKFS_INODE_BLOCKS * DISKFS_BLOCK_SIZE);
+    for (uint32_t b = 0; b < super.data_start; b++) {
+        diskfs_mark(b, true);
+    }
+    inodes[DISKFS_ROOT].type = DISKFS_DIR;
+    inodes[DISKFS_ROOT].parent = DISKFS_ROOT;
+
+    memset(block, 0, DISKFS_BLOCK_SIZE);
+    memcpy(block, &super, sizeof(super));
+    if (block_write(dev, diskfs_lba(super.bitmap_start), super.bitmap_blocks * sectors_per_block, bitmap) < 0 ||
+        block_write(dev, diskfs_lba(super.inode_start), DISKFS_INODE_BLOCKS * sectors_per_block, inodes) < 0 ||
+        block_write(dev, 0, sectors_per_block, block) < 0) {
+        return false;
+    }
+    bitmap_dirty = false;
+    return true;
+}
+
+bool diskfs_init(const char* device) {
+    dev = block_find(device);
+    if (dev == BLOCK_NONE) {
+        return false;
+    }
+    uint32_t sector_size = block_driver(dev)->sector_size;
+    if (sector_size > DISKFS_BLOCK_SIZE || DISKFS_BLOCK_SIZE % sector_size) {
+        dev = BLOCK_NONE;
+        return false;
+    }
+    sectors_per_block = DISKFS_BLOCK_SIZE / sector_size;
+
+    uint8_t* block = (uint8_t*)kmalloc(DISKFS_BLOCK_SIZE);
+    bool ok = block && block_read(dev, 0, sectors_per_block, block) == 0;
+    if (ok) {
+        memcpy(&super, block, sizeof(super));
+        if (!diskfs_magic_ok(super.magic)) {
+            // Only a blank device is formatted, anything else is left alone
+            ok = diskfs_blank(block) && diskfs_format(block);
+            if (ok) {
+                kprint(":: diskfs: formatted ", 7);
+                kprint(device, 7);
+                kprint("\n", 7);
+            }
+        } else if (super.block_size != DISKFS_BLOCK_SIZE || super.inodes != DISKFS_INODES ||
+                   super.inode_blocks != DISKFS_INODE_BLOCKS ||
+                   super.blocks > block_sectors(dev) / sectors_per_block) {
+            ok = false;
+        } else {
+            ok = diskfs_alloc_tables() &&
+                 block_read(dev, diskfs_lba(super.bitmap_start), super.bitmap_blocks * sectors_per_block, bitmap) == 0 &&
+                 block_read(dev, diskfs_lba(super.inode_start), DISKFS_INODE_BLOCKS * sectors_per_block, inodes) == 0;
+        }
+    }
+    if (block) {
+        kfree(block);
+    }
+
+    if (ok) {
+        memcpy(committed, bitmap, super.bitmap_blocks * DISKFS_BLOCK_SIZE);
+        store = pcache_register(&diskfs_store_ops);
+        ok = store != PCACHE_NONE;
+    }
+    if (!ok) {
+        dev = BLOCK_NONE;
+    }
+    return ok;
+}
+
+int diskfs_mount(const char* path, const char* name) {
+    if (dev == BLOCK_NONE) {
+        return -1;
+    }
+
+    int n = -1;
+    for (int i = DISKFS_ROOT + 1; i < DISKFS_INODES && n < 0; i++) {
+        if (inodes[i].type == DISKFS_DIR && inodes[i].parent == DISKFS_ROOT &&
+            diskfs_strcmp(inodes[i].name, name) == 0) {
+            n = i;
+        }
+    }
+    if (n < 0) {
+        n = diskfs_alloc_inode();
+        if (n < 0) {
+            return -1;
+        }
+        inodes[n].type = DISKFS_DIR;
+        inodes[n].parent = DISKFS_ROOT;
+        diskfs_strcpy(inodes[n].name, name, DISKFS_NAME_MAX);
+        diskfs_touch_inode(n);
+    }
+    return vfs_mount(path, &diskfs_driver, store, n);
+}
@@ -0,0 +1,66 @@
+#ifndef DISKFS_H
+#define DISKFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Extent-based filesystem on a block device. Block 0 holds the superblock,
+// followed by the block bitmap, the inode table and the data blocks. Every
+// file is a list of extents; a directory is an inode that other inodes name
+// as their parent.
+#define DISKFS_MAGIC          "NOVAFS01"
+#define DISKFS_BLOCK_SIZE     4096
+#define DISKFS_INODES         256
+#define DISKFS_EXTENTS        22
+#define DISKFS_NAME_MAX       64
+#define DISKFS_ROOT           0         // Inode of the root directory
+#define DISKFS_WRITEBACK_US   5000000   // Age of changes before they are written back
+
+#define DISKFS_FREE 0
+#define DISKFS_FILE 1
+#define DISKFS_DIR  2
+
+typedef struct {
+    char magic[8];
+    uint32_t block_size;
+    uint32_t blocks;            // Whole filesystem
+    uint32_t inodes;
+    uint32_t bitmap_start;
+    uint32_t bitmap_blocks;
+    uint32_t inode_start;
+    uint32_t inode_blocks;
+    uint32_t data_start;
+} __attribute__((packed)) diskfs_super_t;
+
+typedef struct {
+    uint32_t start;             // First block
+    uint32_t count;             // Blocks
+} __attribute__((packed)) diskfs_extent_t;
+
+typedef struct {
+    uint8_t type;               // DISKFS_FREE, DISKFS_FILE or DISKFS_DIR
+    uint8_t extent_count;
+    uint16_t reserved;
+    uint32_t parent;            // Inode of the containing directory
+    uint32_t size;              // Bytes, files only
+    char name[DISKFS_NAME_MAX];
+    diskfs_extent_t extents[DISKFS_EXTENTS];
+    uint32_t reserved2;
+} __attribute__((packed)) diskfs_inode_t;   // 256 bytes
+
+// Open the filesystem on block device name, formatting it if the device is
+// blank. Returns false if there is no such device or it holds something else.
+bool diskfs_init(const char* device);
+
+// Mount the top-level directory called name at path, creating it if needed
+int diskfs_mount(const char* path, const char* name);
+
+// Start a background write-back once changes are DISKFS_WRITEBACK_US old and
+// advance the one in flight; called from the scheduler tick
+void diskfs_poll(void);
+
+// Write back every change, wait for it and flush the device cache
+int diskfs_sync(bool wait);
+
+#endif // DISKFS_H
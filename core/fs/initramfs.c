@@ -2,187 +2,336 @@
 
 #include <core/fs/initramfs.h>
 #include <core/fs/ramfs.h>
+#include <core/fs/pagecache.h>
+#include <core/drivers/timer.h>
+#include <core/kernel/paging.h>
 #include <core/arch/multiboot.h>
 #include <core/kernel/mem.h>
 #include <stdint.h>
 #include <stddef.h>
 #include <core/kernel/kstd.h>
-#include <core/kernel/mem.h>
+#include <core/kernel/lz4.h>
+#include <core/kernel/nvm/nvm.h>
+#include <core/kernel/nvm/caps.h>
+#include <usr/vfs.h>
 
 #define MAX_PROGRAMS 64
+#define INITRAMFS_BUCKETS 128   // Power of two, twice MAX_PROGRAMS
 
 static struct program programs[MAX_PROGRAMS];
 static size_t program_count = 0;
+static int initramfs_store = PCACHE_NONE;
+static const uint8_t* module_base = NULL;
+static size_t verify_next = 0;
+static size_t inflated_bytes = 0;
+static uint32_t inflate_us = 0;
+
+// Open addressing over program indices, -1 marks an empty bucket
+static int8_t name_index[INITRAMFS_BUCKETS];
+
+static uint32_t crc_table[256];
+static bool crc_ready = false;
+
+static int initramfs_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+static bool initramfs_magic_ok(const char* magic) {
+    const char* expected = INITRAMFS_MAGIC;
+    for (int i = 0; i < 8; i++) {
+        if (magic[i] != expected[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// CRC-32 (IEEE 802.3), as Zlib.crc32 computes it in the packer
+static uint32_t initramfs_crc32(const void* data, size_t size) {
+    if (!crc_ready) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc_table[i] = c;
+        }
+        crc_ready = true;
+    }
+
+    const uint8_t* p = (const uint8_t*)data;
+    uint32_t crc = 0xFFFFFFFFu;
+    while (size--) {
+        crc = crc_table[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// FNV-1a
+static uint32_t initramfs_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    while (*name) {
+        hash = (hash ^ (uint8_t)*name++) * 16777619u;
+    }
+    return hash;
+}
+
+static bool initramfs_index_name(int index) {
+    uint32_t b = initramfs_hash(programs[index].entry->name) & (INITRAMFS_BUCKETS - 1);
+    while (name_index[b] >= 0) {
+        if (initramfs_strcmp(programs[name_index[b]].entry->name, programs[index].entry->name) == 0) {
+            return false;
+        }
+        b = (b + 1) & (INITRAMFS_BUCKETS - 1);
+    }
+    name_index[b] = (int8_t)index;
+    return true;
+}
+
+int initramfs_find(const char* name) {
+    uint32_t b = initramfs_hash(name) & (INITRAMFS_BUCKETS - 1);
+    while (name_index[b] >= 0) {
+        if (initramfs_strcmp(programs[name_index[b]].entry->name, name) == 0) {
+            return name_index[b];
+        }
+        b = (b + 1) & (INITRAMFS_BUCKETS - 1);
+    }
+    return -1;
+}
+
+// Data checksums are checked on first use or by the background pass,
+// whichever comes first, so boot only pays for the table of contents
+static bool initramfs_verify(struct program* prog) {
+    if (prog->state == INITRAMFS_UNVERIFIED) {
+        const initramfs_entry_t* entry = prog->entry;
+        const char* stored = (const char*)module_base + entry->offset;
+        if (initramfs_crc32(stored, entry->stored_size) == entry->crc32) {
+            prog->state = INITRAMFS_VERIFIED;
+            if (!(entry->flags & INITRAMFS_FLAG_LZ4)) {
+                prog->data = stored;
+            }
+        } else {
+            prog->state = INITRAMFS_CORRUPT;
+            kprint("initramfs: checksum mismatch in ", 14);
+            kprint(entry->name, 14);
+            kprint("\n", 14);
+        }
+    }
+    return prog->state == INITRAMFS_VERIFIED;
+}
+
+bool initramfs_verify_step(void) {
+    if (verify_next < program_count) {
+        initramfs_verify(&programs[verify_next++]);
+    }
+    return verify_next >= program_count;
+}
+
+// Compressed entries are decoded straight from the module into a RamFS
+// object, the first time anything needs their bytes
+const char* initramfs_get_data(size_t index) {
+    if (index >= program_count) {
+        return NULL;
+    }
+    struct program* prog = &programs[index];
+    if (!initramfs_verify(prog)) {
+        return NULL;
+    }
+    if (prog->data) {
+        return prog->data;
+    }
+
+    const initramfs_entry_t* entry = prog->entry;
+    int slot = ramfs_create(prog->size);
+    uint8_t* out = (uint8_t*)ramfs_data(slot);
+    if (!out) {
+        ramfs_delete(slot);
+        kprint("Not enough memory to inflate ", 14);
+        kprint(entry->name, 14);
+        kprint("\n", 14);
+        return NULL;
+    }
+    uint64_t start = timer_read_tsc();
+    int n = lz4_decompress(module_base + entry->offset, entry->stored_size, out, prog->size);
+    uint32_t us = timer_elapsed_us(start);
+    if (n != (int)prog->size) {
+        kprint("Corrupt LZ4 data in ", 14);
+        kprint(entry->name, 14);
+        kprint("\n", 14);
+        ramfs_delete(slot);
+        return NULL;
+    }
+    prog->data = (const char*)out;
+    inflated_bytes += prog->size;
+    inflate_us += us;
+    return prog->data;
+}
+
+// Programs are read in place from the module; file ids are program indices
+static const void* initramfs_map_page(uint32_t index, uint32_t page) {
+    if (index >= program_count || (size_t)page * PAGE_SIZE >= programs[index].size) {
+        return NULL;
+    }
+    const char* data = initramfs_get_data(index);
+    return data ? data + (size_t)page * PAGE_SIZE : NULL;
+}
+
+static const pcache_store_t initramfs_store_ops = { "initramfs", initramfs_map_page, NULL };
 
+// Read-only VFS view of the programs. Entries point at the store, so reading
+// them maps module pages and nothing is copied until a file is written.
+static int initramfs_populate(int dir, uint32_t node) {
+    (void)node;
+    int added = 0;
+    for (size_t i = 0; i < program_count; i++) {
+        if (vfs_mount_add(dir, programs[i].entry->name, VFS_TYPE_FILE, (uint32_t)i, programs[i].size) >= 0) {
+            added++;
+        }
+    }
+    return added;
+}
+
+static const vfs_driver_t initramfs_driver = {
+    .name = "initramfs",
+    .populate = initramfs_populate,
+};
+
+static void initramfs_print_number(const char* label, uint32_t value, const char* unit) {
+    char buf[16];
+    kprint(label, 7);
+    itoa((int)value, buf, 10);
+    kprint(buf, 7);
+    kprint(unit, 7);
+}
+
+static void initramfs_reject(const char* name, const char* reason) {
+    kprint("Skipping initramfs entry ", 14);
+    kprint(name, 14);
+    kprint(": ", 14);
+    kprint(reason, 14);
+    kprint("\n", 14);
+}
+
+// Check the header and table of contents; returns the entries or NULL
+static const initramfs_entry_t* initramfs_check_header(const uint8_t* data, size_t size, uint32_t* count) {
+    const initramfs_header_t* header = (const initramfs_header_t*)data;
+    if (size < sizeof(initramfs_header_t) || !initramfs_magic_ok(header->magic)) {
+        kprint("Initramfs has no archive header\n", 14);
+        return NULL;
+    }
+    if (header->version != INITRAMFS_VERSION) {
+        initramfs_print_number("Unsupported initramfs version ", header->version, "\n");
+        return NULL;
+    }
+    if (header->header_crc32 != initramfs_crc32(header, sizeof(*header) - sizeof(uint32_t))) {
+        kprint("Initramfs header checksum mismatch\n", 14);
+        return NULL;
+    }
+    if (header->header_size < sizeof(initramfs_header_t) || header->entry_size < sizeof(initramfs_entry_t) ||
+        header->size > size || header->header_size > header->size ||
+        header->count > (header->size - header->header_size) / header->entry_size) {
+        kprint("Initramfs table of contents out of bounds\n", 14);
+        return NULL;
+    }
+    const uint8_t* toc = data + header->header_size;
+    if (header->toc_crc32 != initramfs_crc32(toc, header->count * header->entry_size)) {
+        kprint("Initramfs table of contents checksum mismatch\n", 14);
+        return NULL;
+    }
+    *count = header->count;
+    return (const initramfs_entry_t*)toc;
+}
+
+// The index is built once, here; programs stay where GRUB loaded them
 void initramfs_load(multiboot_info_t* mb_info) {
     if (!(mb_info->flags & 0x08)) {
         kprint("No modules found in multiboot info\n", 14);
         return;
     }
-    
+
     if (mb_info->mods_count == 0) {
         kprint("No modules to load\n", 14);
         return;
     }
-    
+
     module_t* modules = (module_t*)mb_info->mods_addr;
     module_t* module = &modules[0];
-    
+
     uint8_t *initramfs_data = (uint8_t*)module->mod_start;
     size_t initramfs_size = module->mod_end - module->mod_start;
-    
+
     kprint(":: Loading initramfs..\n", 7);
-    
-    ramfs_init();
-    
-    size_t offset = 0;
+
+    if (initramfs_store == PCACHE_NONE) {
+        initramfs_store = pcache_register(&initramfs_store_ops);
+    }
+
+    uint64_t start = timer_read_tsc();
+    size_t total = 0, compressed = 0, stored = 0;
+    module_base = initramfs_data;
     program_count = 0;
-    
-    while (offset < initramfs_size && program_count < MAX_PROGRAMS) {
-        if (offset + 4 > initramfs_size) {
-            kprint("Incomplete size field in initramfs\n", 14);
-            break;
-        }
-        
-        uint32_t prog_size = 0;
-        for (int i = 0; i < 4; i++) {
-            prog_size = (prog_size << 8) | initramfs_data[offset++];
-        }
-        
-        if (prog_size == 0) {
-            kprint("Zero-sized program encountered\n", 14);
-            break;
+    verify_next = 0;
+    memset(name_index, -1, sizeof(name_index));
+
+    uint32_t count;
+    const initramfs_entry_t* toc = initramfs_check_header(initramfs_data, initramfs_size, &count);
+    if (!toc) {
+        return;
+    }
+    const initramfs_header_t* header = (const initramfs_header_t*)initramfs_data;
+
+    for (uint32_t i = 0; i < count && program_count < MAX_PROGRAMS; i++) {
+        const initramfs_entry_t* entry = (const initramfs_entry_t*)((const uint8_t*)toc + i * header->entry_size);
+
+        if (entry->name[0] == '\0' || entry->name[INITRAMFS_NAME_MAX - 1] != '\0') {
+            initramfs_reject("?", "bad name");
+            continue;
         }
-        
-        if (prog_size > initramfs_size - offset) {
-            kprint("Program size exceeds available data\n", 14);
-            break;
+        bool lz4 = (entry->flags & INITRAMFS_FLAG_LZ4) != 0;
+        if (entry->offset % INITRAMFS_ALIGN != 0 || entry->offset > header->size ||
+            entry->stored_size > header->size - entry->offset || entry->cap_count > INITRAMFS_MAX_CAPS ||
+            (lz4 ? entry->size == 0 : entry->stored_size != entry->size)) {
+            initramfs_reject(entry->name, "bad entry");
+            continue;
         }
-        
-        programs[program_count].data = (const char*)&initramfs_data[offset];
-        programs[program_count].size = prog_size;
-        programs[program_count].ramfs_sector = -1;
-        
-        int sector = ramfs_write((const char*)&initramfs_data[offset], prog_size);
-        if (sector >= 0) {
-            programs[program_count].ramfs_sector = sector;
-            
-            kprint(":: Loaded program ", 7);
-            
-            char buf[16];
-            memset(buf, 0, sizeof(buf));
-            size_t n = program_count;
-            char* p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            
-            kprint(" (size=", 7);
-            
-            memset(buf, 0, sizeof(buf));
-            n = prog_size;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(", sector=", 7);
-            
-            memset(buf, 0, sizeof(buf));
-            n = sector;
-            p = buf;
-            if (n == 0) {
-                *p++ = '0';
-            } else {
-                char* start = p;
-                while (n > 0) {
-                    *p++ = '0' + n % 10;
-                    n /= 10;
-                }
-                p--;
-                while (start < p) {
-                    char temp = *start;
-                    *start = *p;
-                    *p = temp;
-                    start++;
-                    p--;
-                }
-                p = buf + 15;
-            }
-            *p = '\0';
-            kprint(buf, 7);
-            kprint(")\n", 7);
-        } else {
-            kprint("Failed to load program to RamFS\n", 14);
+        programs[program_count].data = NULL;
+        programs[program_count].size = entry->size;
+        programs[program_count].entry = entry;
+        programs[program_count].state = INITRAMFS_UNVERIFIED;
+        if (!initramfs_index_name((int)program_count)) {
+            initramfs_reject(entry->name, "duplicate name");
+            continue;
         }
-        
+
+        initramfs_print_number(":: Loaded program ", program_count, " (");
+        kprint(entry->name, 7);
+        initramfs_print_number(", size=", entry->size, ")\n");
+
         program_count++;
-        offset += prog_size;
-        
-        if (offset % 4 != 0) {
-            offset += 4 - (offset % 4);
+        if (lz4) {
+            compressed += entry->size;
+            stored += entry->stored_size;
+        } else {
+            total += entry->size;
         }
     }
+    uint32_t us = timer_elapsed_us(start);
 
-    kprint(":: Total programs loaded: ", 7);
-    char count_buf[16];
-    memset(count_buf, 0, sizeof(count_buf));
-    size_t n = program_count;
-    char* p = count_buf;
-    if (n == 0) {
-        *p++ = '0';
-    } else {
-        char* start = p;
-        while (n > 0) {
-            *p++ = '0' + n % 10;
-            n /= 10;
-        }
-        p--;
-        while (start < p) {
-            char temp = *start;
-            *start = *p;
-            *p = temp;
-            start++;
-            p--;
-        }
-        p = count_buf + 15;
+    initramfs_print_number(":: Total programs loaded: ", program_count, "\n");
+    initramfs_print_number(":: Initramfs indexed in place: ", (uint32_t)total, " bytes mapped, none copied");
+    initramfs_print_number(", ", us, " us\n");
+    if (compressed > 0) {
+        initramfs_print_number(":: Initramfs LZ4: ", (uint32_t)compressed, " bytes stored in ");
+        initramfs_print_number("", (uint32_t)stored, ", inflated on first use\n");
+    }
+
+    if (program_count > 0 && vfs_mount(INITRAMFS_MOUNT, &initramfs_driver, initramfs_store, 0) < 0) {
+        kprint("Cannot mount initramfs at " INITRAMFS_MOUNT "\n", 14);
     }
-    *p = '\0';
-    kprint(count_buf, 7);
-    kprint("\n", 7);
 }
 
 struct program* initramfs_get_program(size_t index) {
@@ -194,19 +343,32 @@ size_t initramfs_get_count(void) {
     return program_count;
 }
 
-int initramfs_load_to_ramfs(size_t index) {
-    if (index >= program_count) return -1;
-    
-    struct program* prog = &programs[index];
-    
-    if (prog->ramfs_sector >= 0) {
-        return prog->ramfs_sector;
-    }
+int initramfs_get_store(void) {
+    return initramfs_store;
+}
+
+void initramfs_inflate_stats(size_t* bytes, uint32_t* us) {
+    *bytes = inflated_bytes;
+    *us = inflate_us;
+}
 
-    int sector = ramfs_write(prog->data, prog->size);
-    if (sector >= 0) {
-        prog->ramfs_sector = sector;
+bool initramfs_execute(size_t index) {
+    if (index >= program_count) {
+        return false;
+    }
+    const initramfs_entry_t* entry = programs[index].entry;
+    uint16_t caps[INITRAMFS_MAX_CAPS] = { CAP_ALL };
+    uint8_t caps_count = 1;
+    if (entry->cap_count > 0) {
+        for (int i = 0; i < entry->cap_count; i++) {
+            caps[i] = entry->caps[i];
+        }
+        caps_count = (uint8_t)entry->cap_count;
+    }
+    const char* data = initramfs_get_data(index);
+    if (!data) {
+        return false;
     }
-    
-    return sector;
+    nvm_execute((uint8_t*)data, programs[index].size, caps, caps_count);
+    return true;
 }
@@ -3,18 +3,79 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 #include <core/arch/multiboot.h>
 
+// Archive written by initramfs-rebuild.rb. All fields are little-endian. The
+// header is followed by the table of contents, then the entries' data, each
+// starting on a page boundary so it can be mapped where the module sits.
+// Compressed entries are one LZ4 block, inflated to the heap on first use.
+#define INITRAMFS_MAGIC       "NVINITRD"
+#define INITRAMFS_VERSION     2
+#define INITRAMFS_ALIGN       4096
+#define INITRAMFS_NAME_MAX    64
+#define INITRAMFS_MAX_CAPS    7
+
+#define INITRAMFS_FLAG_BOOT   0x0001    // Run at boot
+#define INITRAMFS_FLAG_LZ4    0x0002    // Stored as an LZ4 block
+
+typedef struct {
+    char magic[8];
+    uint16_t version;
+    uint16_t header_size;
+    uint16_t entry_size;        // Readers skip fields past the ones they know
+    uint16_t reserved;
+    uint32_t count;
+    uint32_t size;              // Whole archive
+    uint32_t toc_crc32;         // Table of contents
+    uint32_t header_crc32;      // Header up to this field
+} __attribute__((packed)) initramfs_header_t;
+
+typedef struct {
+    char name[INITRAMFS_NAME_MAX];  // NUL-terminated
+    uint32_t offset;            // From the start of the archive, page aligned
+    uint32_t size;              // Uncompressed
+    uint32_t flags;             // INITRAMFS_FLAG_*
+    uint32_t crc32;             // Data as stored
+    uint16_t cap_count;         // Suggested capabilities; none means CAP_ALL
+    uint16_t caps[INITRAMFS_MAX_CAPS];
+    uint32_t stored_size;       // Bytes in the archive
+} __attribute__((packed)) initramfs_entry_t;   // 100 bytes
+
+#define INITRAMFS_UNVERIFIED 0
+#define INITRAMFS_VERIFIED   1
+#define INITRAMFS_CORRUPT    2
+
 struct program {
-    const char* data;
+    const char* data;       // In place inside the module, or the inflated copy;
+                            // NULL until initramfs_get_data has checked it
     size_t size;
-    int ramfs_sector; 
+    const initramfs_entry_t* entry;
+    uint8_t state;          // INITRAMFS_UNVERIFIED etc.
 };
 
+#define INITRAMFS_MOUNT "/initrd"   // Read-only view of the programs
+
 void initramfs_load(multiboot_info_t* mb_info);
 struct program* initramfs_get_program(size_t index);
 size_t initramfs_get_count(void);
-int initramfs_load_to_ramfs(size_t index);
-void initramfs_list_programs(void);
+int initramfs_get_store(void);      // Page cache store over the programs
+
+// Index of the program called name, or -1; constant time on average
+int initramfs_find(const char* name);
+
+// The program's bytes, checking the checksum and inflating a compressed
+// one on first use; NULL if either fails
+const char* initramfs_get_data(size_t index);
+
+// Check the next unchecked program; true once all are. Boot runs it in the
+// background so corrupt programs are reported without waiting for a run.
+bool initramfs_verify_step(void);
+
+// Bytes inflated so far and the time it took
+void initramfs_inflate_stats(size_t* bytes, uint32_t* us);
+
+// Start a program with its suggested capabilities; false if its data is bad
+bool initramfs_execute(size_t index);
 
-#endif
\ No newline at end of file
+#endif
@@ -3,12 +3,49 @@
 #include <core/fs/iso9660.h>
 #include <core/kernel/kstd.h>
 #include <core/kernel/mem.h>
+#include <core/fs/pagecache.h>
+#include <core/drivers/cdrom.h>
+#include <core/drivers/block.h>
+#include <core/kernel/paging.h>
+#include <usr/vfs.h>
 
 static void* iso_data = NULL;
 static size_t iso_data_size = 0;
+static bool on_device = false;      // Read through the ATAPI driver, not from memory
+static int iso_dev = BLOCK_NONE;    // Block device of the drive
+static iso9660_pvd_t volume;        // Copies, device blocks do not stay around
+static uint8_t root_record[34];
 static iso9660_pvd_t* primary_volume = NULL;
 static uint16_t block_size = 2048;
 static bool initialized = false;
+static int iso_store = PCACHE_NONE;
+
+// Where entry names come from
+#define ISO_NAMES_PLAIN      0  // ISO 9660 identifiers without ";1" and a trailing dot
+#define ISO_NAMES_ROCK_RIDGE 1  // NM entries in the System Use area
+#define ISO_NAMES_JOLIET     2  // UCS-2 identifiers of the Joliet volume
+
+static iso9660_dir_entry_t* root_entry = NULL;
+static uint8_t name_mode = ISO_NAMES_PLAIN;
+
+// Files recorded as several extents, keyed by their first extent. Entries
+// are never dropped since VFS files keep referring to them.
+#define ISO_MAX_MULTI 32
+#define ISO_MAX_PARTS 8
+
+typedef struct {
+    uint32_t extent;
+    uint32_t size;
+} iso_part_t;
+
+typedef struct {
+    uint32_t count;
+    uint32_t size;          // Sum of the parts
+    iso_part_t parts[ISO_MAX_PARTS];
+} iso_multi_t;
+
+static iso_multi_t multi_files[ISO_MAX_MULTI];
+static int multi_count = 0;
 
 static int strcmp(const char* s1, const char* s2) {
     while (*s1 && (*s1 == *s2)) {
@@ -34,86 +71,557 @@ static size_t strlen(const char* s) {
     return len;
 }
 
-static void* read_block(uint32_t lba) {
-    if (!iso_data || lba * block_size >= iso_data_size) {
+// On the drive the blocks land in the driver's buffer and are only valid
+// until the next read
+static void* read_blocks(uint32_t lba, uint32_t count) {
+    if ((size_t)lba * block_size >= iso_data_size) {
+        return NULL;
+    }
+    if (on_device) {
+        return cdrom_read_sectors(lba, count ? count : 1);
+    }
+    if (!iso_data) {
         return NULL;
     }
     return (void*)((uint8_t*)iso_data + lba * block_size);
 }
 
+static void* read_block(uint32_t lba) {
+    return read_blocks(lba, 1);
+}
+
+static iso_multi_t* multi_find(uint32_t extent) {
+    for (int i = 0; i < multi_count; i++) {
+        if (multi_files[i].parts[0].extent == extent) {
+            return &multi_files[i];
+        }
+    }
+    return NULL;
+}
+
+// Image position of byte offset of the file starting at extent; false
+// outside the image or past the last part
+static bool file_pos(uint32_t extent, uint32_t offset, size_t* out) {
+    iso_multi_t* multi = multi_find(extent);
+    if (multi) {
+        uint32_t i = 0;
+        while (i < multi->count && offset >= multi->parts[i].size) {
+            offset -= multi->parts[i].size;
+            i++;
+        }
+        if (i == multi->count) {
+            return false;
+        }
+        extent = multi->parts[i].extent;
+    }
+
+    *out = (size_t)extent * block_size + offset;
+    return *out < iso_data_size;
+}
+
+// Address of the byte for an image in memory
+static const uint8_t* file_byte(uint32_t extent, uint32_t offset) {
+    size_t pos;
+    if (on_device || !iso_data || !file_pos(extent, offset, &pos)) {
+        return NULL;
+    }
+    return (const uint8_t*)iso_data + pos;
+}
+
+// Page cache store over the image; file ids are first extents. A page is
+// mapped in place unless it straddles two parts that are not adjacent in
+// the image, or the image is on the drive; then read copies it.
+static const void* iso_map_page(uint32_t extent, uint32_t page) {
+    uint32_t start = page * PAGE_SIZE;
+    const uint8_t* first = file_byte(extent, start);
+    if (!first) {
+        return NULL;
+    }
+
+    iso_multi_t* multi = multi_find(extent);
+    if (multi) {
+        uint32_t last = start + PAGE_SIZE - 1;
+        if (last >= multi->size) {
+            last = multi->size - 1;
+        }
+        if (file_byte(extent, last) != first + (last - start)) {
+            return NULL;
+        }
+    }
+    return first;
+}
+
+// On the drive the blocks of a page are queued together, so parts that lie
+// next to each other go out as one merged transfer
+static int iso_read_page(uint32_t extent, uint32_t page, void* frame) {
+    uint8_t* out = (uint8_t*)frame;
+    uint32_t start = page * PAGE_SIZE;
+    int status = 0;
+    block_batch_t batch;
+
+    block_batch_init(&batch);
+    if (on_device) {
+        block_plug(iso_dev);
+    }
+    for (uint32_t done = 0; done < PAGE_SIZE;) {
+        size_t pos;
+        if (!file_pos(extent, start + done, &pos)) {
+            if (done == 0) {
+                status = -1;
+            } else {
+                memset(out + done, 0, PAGE_SIZE - done);
+            }
+            break;
+        }
+
+        // Copy up to the next block boundary, parts are whole blocks
+        uint32_t chunk = block_size - (start + done) % block_size;
+        if (chunk > PAGE_SIZE - done) {
+            chunk = PAGE_SIZE - done;
+        }
+        if (!on_device) {
+            memcpy(out + done, (const uint8_t*)iso_data + pos, chunk);
+        } else if (chunk != CDROM_SECTOR_SIZE ||
+                   block_batch_submit(&batch, iso_dev, BLOCK_READ, pos / CDROM_SECTOR_SIZE, 1, out + done) < 0) {
+            status = -1;
+            break;
+        }
+        done += chunk;
+    }
+    if (on_device) {
+        block_unplug(iso_dev);
+        if (block_batch_wait(&batch) < 0) {
+            status = -1;
+        }
+    }
+    return status;
+}
+
+static const pcache_store_t iso_store_ops = { "iso9660", iso_map_page, iso_read_page };
+
 static void normalize_filename(const char* iso_name, size_t iso_len, char* out, size_t out_size) {
     size_t i;
     for (i = 0; i < iso_len && i < out_size - 1; i++) {
         if (iso_name[i] == ';') break;
         out[i] = iso_name[i];
     }
+    // "README." is how a name without an extension is recorded
+    if (i > 1 && out[i - 1] == '.') {
+        i--;
+    }
     out[i] = '\0';
 }
 
-static iso9660_dir_entry_t* find_entry_in_dir(uint32_t dir_extent, uint32_t dir_size, const char* name) {
-    uint8_t* dir_data = (uint8_t*)read_block(dir_extent);
-    if (!dir_data) return NULL;
-    
-    size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-        if (entry->length == 0) break;
-        
+// System Use area of a record, after the identifier and its padding byte
+static uint8_t* system_use(iso9660_dir_entry_t* entry, size_t* len) {
+    size_t start = sizeof(iso9660_dir_entry_t) + entry->name_len + ((entry->name_len & 1) ? 0 : 1);
+    *len = entry->length > start ? entry->length - start : 0;
+    return (uint8_t*)entry + start;
+}
+
+// Rock Ridge alternate name, possibly split over several NM entries.
+// Continuation areas (CE) are not followed.
+static bool rock_ridge_name(iso9660_dir_entry_t* entry, char* out, size_t out_size) {
+    size_t su_len;
+    uint8_t* su = system_use(entry, &su_len);
+    size_t len = 0;
+
+    for (size_t pos = 0; pos + 4 <= su_len;) {
+        uint8_t* field = su + pos;
+        uint8_t field_len = field[2];
+        if (field_len < 4 || pos + field_len > su_len) {
+            break;
+        }
+        if (field[0] == 'S' && field[1] == 'T') {
+            break;
+        }
+        // Flags 0x02 and 0x04 name "." and ".."
+        if (field[0] == 'N' && field[1] == 'M' && field_len > 5 && !(field[4] & 0x06)) {
+            for (size_t i = 5; i < field_len && len < out_size - 1; i++) {
+                out[len++] = field[i];
+            }
+        }
+        pos += field_len;
+    }
+
+    out[len] = '\0';
+    return len > 0;
+}
+
+// Joliet identifiers are UCS-2 big-endian; stored here as UTF-8
+static void joliet_name(const uint8_t* name, size_t name_len, char* out, size_t out_size) {
+    size_t len = 0;
+    for (size_t i = 0; i + 1 < name_len; i += 2) {
+        uint16_t c = (uint16_t)(name[i] << 8) | name[i + 1];
+        if (c == ';') {
+            break;
+        }
+        if (c < 0x80) {
+            if (len + 1 >= out_size) break;
+            out[len++] = (char)c;
+        } else if (c < 0x800) {
+            if (len + 2 >= out_size) break;
+            out[len++] = (char)(0xC0 | (c >> 6));
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        } else {
+            if (len + 3 >= out_size) break;
+            out[len++] = (char)(0xE0 | (c >> 12));
+            out[len++] = (char)(0x80 | ((c >> 6) & 0x3F));
+            out[len++] = (char)(0x80 | (c & 0x3F));
+        }
+    }
+    out[len] = '\0';
+}
+
+static void entry_name(iso9660_dir_entry_t* entry, char* out, size_t out_size) {
+    const char* name = (const char*)(entry + 1);
+    if (name_mode == ISO_NAMES_JOLIET) {
+        joliet_name((const uint8_t*)name, entry->name_len, out, out_size);
+    } else if (name_mode != ISO_NAMES_ROCK_RIDGE || !rock_ridge_name(entry, out, out_size)) {
+        normalize_filename(name, entry->name_len, out, out_size);
+    }
+}
+
+// Next file record at *offset, skipping "." and "..". Records never cross a
+// block; a zero length pads to the next one.
+static iso9660_dir_entry_t* next_entry(uint8_t* dir_data, size_t dir_size, size_t* offset) {
+    while (*offset + sizeof(iso9660_dir_entry_t) <= dir_size) {
+        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + *offset);
+        if (entry->length == 0) {
+            *offset = (*offset / block_size + 1) * block_size;
+            continue;
+        }
+        *offset += entry->length;
+
         char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-        
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
+        if (entry->name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
             continue;
         }
-        
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
-        
-        if (strcmp(normalized, name) == 0) {
-            return entry;
+        return entry;
+    }
+    return NULL;
+}
+
+// Directory bytes that lie inside the image
+static size_t dir_extent_size(uint32_t extent, uint32_t size) {
+    if ((size_t)extent * block_size >= iso_data_size) {
+        return 0;
+    }
+    size_t available = iso_data_size - (size_t)extent * block_size;
+    return size < available ? size : available;
+}
+
+static uint32_t name_hash(const char* name, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Directory indexes: built the first time a directory is searched, then a
+// component costs one probe instead of a parse of every record
+typedef struct {
+    uint32_t hash;
+    uint32_t extent;
+    uint32_t size;
+    uint32_t name;          // Offset into the names pool
+    uint8_t name_len;
+    uint8_t flags;
+} iso_dirent_t;
+
+typedef struct {
+    uint32_t extent;
+    uint32_t count;
+    uint32_t mask;          // Slots - 1
+    iso_dirent_t* entries;
+    int16_t* slots;         // Entry numbers, -1 when empty
+    char* names;
+} iso_dir_index_t;
+
+#define ISO_MAX_DIRS    64      // Indexes kept before all are dropped
+#define ISO_DIR_SLOTS   128     // Power of two, extent -> index
+#define ISO_PATH_CACHE  64      // Power of two, direct mapped
+#define ISO_PATH_MAX    128
+
+static iso_dir_index_t dir_indexes[ISO_MAX_DIRS];
+static int dir_index_count = 0;
+static int16_t dir_slots[ISO_DIR_SLOTS];
+
+// Resolved paths, keyed by the path with duplicate slashes removed
+typedef struct {
+    bool valid;
+    uint32_t hash;
+    uint32_t extent;
+    uint32_t size;
+    bool dir;
+    char path[ISO_PATH_MAX];
+} iso_path_entry_t;
+
+static iso_path_entry_t path_cache[ISO_PATH_CACHE];
+
+static void dir_cache_reset(void) {
+    for (int i = 0; i < dir_index_count; i++) {
+        kfree(dir_indexes[i].entries);
+    }
+    dir_index_count = 0;
+    for (int i = 0; i < ISO_DIR_SLOTS; i++) {
+        dir_slots[i] = -1;
+    }
+}
+
+// Collect one record of a multi-extent file; false once it cannot be kept
+static bool multi_add_part(iso_multi_t* parts, iso9660_dir_entry_t* entry) {
+    if (parts->count == 0) {
+        parts->size = 0;
+    }
+    if (parts->count >= ISO_MAX_PARTS || parts->size + entry->size_le < parts->size) {
+        return false;
+    }
+    parts->parts[parts->count].extent = entry->extent_le;
+    parts->parts[parts->count].size = entry->size_le;
+    parts->size += entry->size_le;
+    parts->count++;
+    return true;
+}
+
+static bool multi_register(const iso_multi_t* parts) {
+    if (multi_find(parts->parts[0].extent)) {
+        return true;    // Seen before the directory index was rebuilt
+    }
+    if (multi_count == ISO_MAX_MULTI) {
+        return false;
+    }
+    multi_files[multi_count++] = *parts;
+    return true;
+}
+
+static iso_dir_index_t* dir_index_build(uint32_t extent, uint32_t size) {
+    size_t dir_size = dir_extent_size(extent, size);
+    uint8_t* dir_data = (uint8_t*)read_blocks(extent, (dir_size + block_size - 1) / block_size);
+    if (!dir_data) {
+        return NULL;
+    }
+
+    if (dir_index_count == ISO_MAX_DIRS) {
+        dir_cache_reset();
+    }
+
+    // First pass sizes the single allocation holding entries, slots and names
+    char normalized[256];
+    uint32_t count = 0;
+    size_t name_bytes = 0;
+    size_t offset = 0;
+    iso9660_dir_entry_t* entry;
+    while ((entry = next_entry(dir_data, dir_size, &offset))) {
+        // A multi-extent file is one entry, closed by its last record
+        if (entry->flags & ISO_FLAG_MULTIEXTENT) {
+            continue;
+        }
+        entry_name(entry, normalized, sizeof(normalized));
+        name_bytes += strlen(normalized);
+        count++;
+    }
+
+    uint32_t slots = 8;
+    while (slots < count * 2) {
+        slots *= 2;
+    }
+
+    size_t entries_bytes = count * sizeof(iso_dirent_t);
+    uint8_t* block = (uint8_t*)kmalloc(entries_bytes + slots * sizeof(int16_t) + name_bytes);
+    if (!block) {
+        return NULL;
+    }
+
+    iso_dir_index_t* index = &dir_indexes[dir_index_count];
+    index->extent = extent;
+    index->count = count;
+    index->mask = slots - 1;
+    index->entries = (iso_dirent_t*)block;
+    index->slots = (int16_t*)(block + entries_bytes);
+    index->names = (char*)(block + entries_bytes + slots * sizeof(int16_t));
+    for (uint32_t i = 0; i < slots; i++) {
+        index->slots[i] = -1;
+    }
+
+    uint32_t n = 0;
+    size_t name = 0;
+    iso_multi_t parts;
+    parts.count = 0;
+    offset = 0;
+    while ((entry = next_entry(dir_data, dir_size, &offset)) && n < count) {
+        if (parts.count || (entry->flags & ISO_FLAG_MULTIEXTENT)) {
+            if (!multi_add_part(&parts, entry)) {
+                parts.count = ISO_MAX_PARTS + 1;    // Unusable, dropped at its last record
+            }
+            if (entry->flags & ISO_FLAG_MULTIEXTENT) {
+                continue;
+            }
+        }
+
+        uint32_t file_extent = entry->extent_le;
+        uint32_t file_size = entry->size_le;
+        if (parts.count) {
+            bool usable = parts.count <= ISO_MAX_PARTS && multi_register(&parts);
+            file_extent = parts.parts[0].extent;
+            file_size = parts.size;
+            parts.count = 0;
+            if (!usable) {
+                continue;
+            }
+        }
+
+        entry_name(entry, normalized, sizeof(normalized));
+        size_t len = strlen(normalized);
+        memcpy(index->names + name, normalized, len);
+
+        iso_dirent_t* e = &index->entries[n];
+        e->hash = name_hash(normalized, len);
+        e->extent = file_extent;
+        e->size = file_size;
+        e->name = name;
+        e->name_len = len;
+        e->flags = entry->flags;
+
+        uint32_t h = e->hash & index->mask;
+        while (index->slots[h] >= 0) {
+            h = (h + 1) & index->mask;
+        }
+        index->slots[h] = n;
+
+        name += len;
+        n++;
+    }
+    index->count = n;
+
+    uint32_t h = (extent * 2654435761u) & (ISO_DIR_SLOTS - 1);
+    while (dir_slots[h] >= 0) {
+        h = (h + 1) & (ISO_DIR_SLOTS - 1);
+    }
+    dir_slots[h] = dir_index_count++;
+    return index;
+}
+
+static iso_dir_index_t* dir_index_get(uint32_t extent, uint32_t size) {
+    uint32_t h = (extent * 2654435761u) & (ISO_DIR_SLOTS - 1);
+    while (dir_slots[h] >= 0) {
+        if (dir_indexes[dir_slots[h]].extent == extent) {
+            return &dir_indexes[dir_slots[h]];
+        }
+        h = (h + 1) & (ISO_DIR_SLOTS - 1);
+    }
+    return dir_index_build(extent, size);
+}
+
+static iso_dirent_t* dir_index_lookup(iso_dir_index_t* index, const char* name, size_t len) {
+    uint32_t hash = name_hash(name, len);
+    for (uint32_t h = hash & index->mask; index->slots[h] >= 0; h = (h + 1) & index->mask) {
+        iso_dirent_t* e = &index->entries[index->slots[h]];
+        if (e->hash == hash && e->name_len == len && strncmp(index->names + e->name, name, len) == 0) {
+            return e;
         }
-        
-        offset += entry->length;
     }
-    
     return NULL;
 }
 
-void iso9660_init(void* iso_start, size_t iso_size) {
-    iso_data = iso_start;
-    iso_data_size = iso_size;
+// SUSP "SP" in the root "." record marks a Rock Ridge volume
+static bool has_rock_ridge(iso9660_dir_entry_t* root) {
+    iso9660_dir_entry_t* self = (iso9660_dir_entry_t*)read_block(root->extent_le);
+    if (!self || self->length < sizeof(iso9660_dir_entry_t)) {
+        return false;
+    }
+    size_t su_len;
+    uint8_t* su = system_use(self, &su_len);
+    return su_len >= 7 && su[0] == 'S' && su[1] == 'P' && su[4] == 0xBE && su[5] == 0xEF;
+}
+
+// Joliet is a supplementary descriptor with a UCS-2 escape sequence
+static bool is_joliet(iso9660_pvd_t* vd) {
+    const uint8_t* esc = vd->unused3;
+    return vd->type == 2 && esc[0] == '%' && esc[1] == '/' &&
+           (esc[2] == '@' || esc[2] == 'C' || esc[2] == 'E');
+}
+
+// Names come from Rock Ridge if present, else from a Joliet volume, else
+// from the primary volume's identifiers
+static void iso9660_scan(void) {
+    primary_volume = NULL;
+    initialized = false;
+    block_size = CDROM_SECTOR_SIZE;
     
+    bool joliet = false;
+    uint8_t joliet_root[sizeof(root_record)];
     for (int i = 16; i < 32; i++) {
         iso9660_pvd_t* vd = (iso9660_pvd_t*)read_block(i);
-        if (!vd) return;
+        if (!vd || strncmp(vd->identifier, "CD001", 5) != 0) break;
         
-        if (vd->type == 1 && strncmp(vd->identifier, "CD001", 5) == 0) {
-            primary_volume = vd;
-            block_size = vd->logical_block_size_le;
-            initialized = true;
-            return;
+        if (vd->type == 1 && !primary_volume) {
+            memcpy(&volume, vd, sizeof(volume));
+            primary_volume = &volume;
+        } else if (is_joliet(vd) && !joliet) {
+            memcpy(joliet_root, vd->root_directory_entry, sizeof(joliet_root));
+            joliet = true;
         }
         
         if (vd->type == 255) break;
     }
-}
-
-const void* iso9660_find_file(const char* path, size_t* size) {
-    if (!initialized || !primary_volume) {
-        if (size) *size = 0;
-        return NULL;
+    if (!primary_volume) {
+        return;
     }
     
-    iso9660_dir_entry_t* root = (iso9660_dir_entry_t*)primary_volume->root_directory_entry;
-    uint32_t current_extent = root->extent_le;
-    uint32_t current_size = root->size_le;
+    block_size = primary_volume->logical_block_size_le;
+    if (on_device && block_size != CDROM_SECTOR_SIZE) {
+        return;
+    }
+    memcpy(root_record, primary_volume->root_directory_entry, sizeof(root_record));
+    root_entry = (iso9660_dir_entry_t*)root_record;
+    name_mode = ISO_NAMES_PLAIN;
+    if (has_rock_ridge(root_entry)) {
+        name_mode = ISO_NAMES_ROCK_RIDGE;
+    } else if (joliet) {
+        memcpy(root_record, joliet_root, sizeof(root_record));
+        name_mode = ISO_NAMES_JOLIET;
+    }
     
+    if (iso_store == PCACHE_NONE) {
+        iso_store = pcache_register(&iso_store_ops);
+    }
+    dir_cache_reset();
+    for (int j = 0; j < ISO_PATH_CACHE; j++) {
+        path_cache[j].valid = false;
+    }
+    multi_count = 0;
+    initialized = true;
+}
+
+void iso9660_init(void* iso_start, size_t iso_size) {
+    iso_data = iso_start;
+    iso_data_size = iso_size;
+    on_device = false;
+    iso9660_scan();
+}
+
+// Read the volume from the ATAPI drive on demand instead of from memory
+void iso9660_init_cdrom(void) {
+    iso_dev = block_find("cd0");
+    if (!cdrom_present() || iso_dev == BLOCK_NONE) {
+        return;
+    }
+    iso_data = NULL;
+    iso_data_size = cdrom_get_iso_size();
+    on_device = true;
+    iso9660_scan();
+}
+
+// Cached paths cost one probe; others one index probe per component.
+// Only directories are descended into; is_dir may be NULL.
+static bool resolve_path(const char* path, uint32_t* extent, uint32_t* size, bool* is_dir) {
     char path_copy[256];
     size_t path_len = strlen(path);
     if (path_len >= sizeof(path_copy)) {
-        if (size) *size = 0;
-        return NULL;
+        return false;
     }
     
     size_t j = 0;
@@ -126,40 +634,66 @@ const void* iso9660_find_file(const char* path, size_t* size) {
     char* search_path = path_copy;
     if (search_path[0] == '/') search_path++;
     
-    if (search_path[0] == '\0') {
-        if (size) *size = current_size;
-        return read_block(current_extent);
+    size_t search_len = strlen(search_path);
+    uint32_t hash = name_hash(search_path, search_len);
+    iso_path_entry_t* cached = &path_cache[hash & (ISO_PATH_CACHE - 1)];
+    if (cached->valid && cached->hash == hash && strcmp(cached->path, search_path) == 0) {
+        *extent = cached->extent;
+        *size = cached->size;
+        if (is_dir) *is_dir = cached->dir;
+        return true;
     }
     
+    uint32_t current_extent = root_entry->extent_le;
+    uint32_t current_size = root_entry->size_le;
+    bool current_dir = true;
+    
     char* token = search_path;
     while (*token) {
         char* next_slash = token;
         while (*next_slash && *next_slash != '/') next_slash++;
         
-        char component[256];
-        size_t comp_len = next_slash - token;
-        if (comp_len >= sizeof(component)) {
-            if (size) *size = 0;
-            return NULL;
+        if (!current_dir) {
+            return false;
         }
-        memcpy(component, token, comp_len);
-        component[comp_len] = '\0';
-        
-        iso9660_dir_entry_t* entry = find_entry_in_dir(current_extent, current_size, component);
+        iso_dir_index_t* index = dir_index_get(current_extent, current_size);
+        iso_dirent_t* entry = index ? dir_index_lookup(index, token, next_slash - token) : NULL;
         if (!entry) {
-            if (size) *size = 0;
-            return NULL;
+            return false;
         }
         
-        current_extent = entry->extent_le;
-        current_size = entry->size_le;
+        current_extent = entry->extent;
+        current_size = entry->size;
+        current_dir = (entry->flags & ISO_FLAG_DIRECTORY) != 0;
         
         token = next_slash;
         if (*token == '/') token++;
     }
     
-    if (size) *size = current_size;
-    return read_block(current_extent);
+    if (search_len < ISO_PATH_MAX) {
+        memcpy(cached->path, search_path, search_len + 1);
+        cached->hash = hash;
+        cached->extent = current_extent;
+        cached->size = current_size;
+        cached->dir = current_dir;
+        cached->valid = true;
+    }
+    
+    *extent = current_extent;
+    *size = current_size;
+    if (is_dir) *is_dir = current_dir;
+    return true;
+}
+
+const void* iso9660_find_file(const char* path, size_t* size) {
+    uint32_t extent, extent_size;
+    if (!initialized || !primary_volume || !resolve_path(path, &extent, &extent_size, NULL)) {
+        if (size) *size = 0;
+        return NULL;
+    }
+    
+    if (size) *size = extent_size;
+    return read_blocks(extent, (extent_size + block_size - 1) / block_size);
 }
 
 void iso9660_list_dir(const char* path) {
@@ -168,10 +702,14 @@ void iso9660_list_dir(const char* path) {
         return;
     }
     
-    size_t dir_size;
-    const void* dir_data = iso9660_find_file(path, &dir_size);
+    uint32_t extent, dir_size;
+    bool is_dir;
+    iso_dir_index_t* index = NULL;
+    if (resolve_path(path, &extent, &dir_size, &is_dir) && is_dir) {
+        index = dir_index_get(extent, dir_size);
+    }
     
-    if (!dir_data) {
+    if (!index) {
         kprint("Directory not found: ", 14);
         kprint(path, 14);
         kprint("\n", 14);
@@ -182,21 +720,12 @@ void iso9660_list_dir(const char* path) {
     kprint(path, 7);
     kprint(":\n", 7);
     
-    size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)((uint8_t*)dir_data + offset);
-        if (entry->length == 0) break;
+    for (uint32_t i = 0; i < index->count; i++) {
+        iso_dirent_t* entry = &index->entries[i];
         
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-        
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-        
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
+        char name[256];
+        memcpy(name, index->names + entry->name, entry->name_len);
+        name[entry->name_len] = '\0';
         
         kprint("  ", 7);
         if (entry->flags & ISO_FLAG_DIRECTORY) {
@@ -204,129 +733,89 @@ void iso9660_list_dir(const char* path) {
         } else {
             kprint("[FILE] ", 7);
         }
-        kprint(normalized, 11);
+        kprint(name, 11);
         
         if (!(entry->flags & ISO_FLAG_DIRECTORY)) {
             kprint(" (", 7);
             char buf[32];
-            itoa(entry->size_le, buf, 10);
+            itoa(entry->size, buf, 10);
             kprint(buf, 7);
             kprint(" bytes)", 7);
         }
         kprint("\n", 7);
-        
-        offset += entry->length;
     }
 }
 
+bool iso9660_open(const char* path, iso9660_file_t* file) {
+    uint32_t extent, size;
+    if (!initialized || !resolve_path(path, &extent, &size, NULL)) {
+        return false;
+    }
+    
+    file->extent = extent;
+    file->size = size;
+    return true;
+}
+
+// Streams through the page cache: pages inside one extent are read in
+// place, pages across the parts of a multi-extent file are assembled once
+size_t iso9660_read_at(const iso9660_file_t* file, uint32_t offset, void* buffer, size_t count) {
+    if (!initialized) {
+        return 0;
+    }
+    return pcache_read(iso_store, file->extent, file->size, offset, buffer, count);
+}
+
 bool iso9660_is_initialized(void) {
     return initialized;
 }
 
-static void mount_dir_recursive(const char* mount_point, const char* iso_path, uint32_t dir_extent, uint32_t dir_size);
-
-void iso9660_mount_to_vfs(const char* mount_point, const char* iso_path) {
-    if (!initialized || !primary_volume) {
-        return;
+// VFS driver: node ids are directory extents. A directory is listed from
+// its index the first time it is looked into; its files stay in the image.
+static int iso_populate(int dir, uint32_t extent) {
+    // The "." record at the start of the extent carries the directory size
+    iso9660_dir_entry_t* self = (iso9660_dir_entry_t*)read_block(extent);
+    iso_dir_index_t* index = self ? dir_index_get(extent, self->size_le) : NULL;
+    if (!index) {
+        return -1;
     }
-    
-    extern void vfs_create(const char* filename, const char* data, size_t size);
-    extern void vfs_mkdir(const char* dirname);
-    
-    size_t dir_size;
-    const void* dir_data = iso9660_find_file(iso_path, &dir_size);
-    if (!dir_data) return;
-    
-    vfs_mkdir(mount_point);
-    size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)((uint8_t*)dir_data + offset);
-        if (entry->length == 0) break;
-        
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-        
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-        
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
-        char vfs_path[512];
-        int idx = 0;
-        for (int i = 0; mount_point[i] && idx < 510; i++) {
-            vfs_path[idx++] = mount_point[i];
-        }
-        if (vfs_path[idx-1] != '/') {
-            vfs_path[idx++] = '/';
-        }
-        for (int i = 0; normalized[i] && idx < 511; i++) {
-            vfs_path[idx++] = normalized[i];
-        }
-        vfs_path[idx] = '\0';
-        
+
+    int added = 0;
+    size_t last;
+    for (uint32_t i = 0; i < index->count; i++) {
+        iso_dirent_t* entry = &index->entries[i];
+        char name[256];
+        memcpy(name, index->names + entry->name, entry->name_len);
+        name[entry->name_len] = '\0';
+
+        int slot = -1;
         if (entry->flags & ISO_FLAG_DIRECTORY) {
-            vfs_mkdir(vfs_path);
-            mount_dir_recursive(vfs_path, iso_path, entry->extent_le, entry->size_le);
-        } else {
-            void* file_data = read_block(entry->extent_le);
-            if (file_data && entry->size_le <= 4096) {
-                vfs_create(vfs_path, (const char*)file_data, entry->size_le);
-            }
+            slot = vfs_mount_add(dir, name, VFS_TYPE_DIR, entry->extent, 0);
+        } else if (entry->size == 0 || file_pos(entry->extent, entry->size - 1, &last)) {
+            slot = vfs_mount_add(dir, name, VFS_TYPE_FILE, entry->extent, entry->size);
+        }
+        if (slot >= 0) {
+            added++;
         }
-        
-        offset += entry->length;
     }
+
+    return added;
 }
 
-static void mount_dir_recursive(const char* mount_point, const char* iso_path, uint32_t dir_extent, uint32_t dir_size) {
-    extern void vfs_create(const char* filename, const char* data, size_t size);
-    extern void vfs_mkdir(const char* dirname);
+static const vfs_driver_t iso_driver = {
+    .name = "iso9660",
+    .populate = iso_populate,
+};
+
+// Only the mount point is created here, directories are read on demand
+void iso9660_mount_to_vfs(const char* mount_point, const char* iso_path) {
+    if (!initialized || !primary_volume) {
+        return;
+    }
     
-    uint8_t* dir_data = (uint8_t*)read_block(dir_extent);
-    if (!dir_data) return;
+    uint32_t extent, dir_size;
+    bool is_dir;
+    if (!resolve_path(iso_path, &extent, &dir_size, &is_dir) || !is_dir) return;
     
-    size_t offset = 0;
-    while (offset < dir_size) {
-        iso9660_dir_entry_t* entry = (iso9660_dir_entry_t*)(dir_data + offset);
-        
-        if (entry->length == 0) break;
-        
-        char* entry_name = (char*)(entry + 1);
-        uint8_t name_len = entry->name_len;
-        
-        if (name_len == 1 && (entry_name[0] == 0 || entry_name[0] == 1)) {
-            offset += entry->length;
-            continue;
-        }
-        
-        char normalized[256];
-        normalize_filename(entry_name, name_len, normalized, sizeof(normalized));
-        
-        char vfs_path[512];
-        int idx = 0;
-        for (int i = 0; mount_point[i] && idx < 510; i++) {
-            vfs_path[idx++] = mount_point[i];
-        }
-        if (vfs_path[idx-1] != '/') {
-            vfs_path[idx++] = '/';
-        }
-        for (int i = 0; normalized[i] && idx < 511; i++) {
-            vfs_path[idx++] = normalized[i];
-        }
-        vfs_path[idx] = '\0';
-        
-        if (entry->flags & ISO_FLAG_DIRECTORY) {
-            vfs_mkdir(vfs_path);
-            mount_dir_recursive(vfs_path, iso_path, entry->extent_le, entry->size_le);
-        } else {
-            void* file_data = read_block(entry->extent_le);
-            if (file_data && entry->size_le <= 4096) {
-                vfs_create(vfs_path, (const char*)file_data, entry->size_le);
-            }
-        }
-        
-        offset += entry->length;
-    }
+    vfs_mount(mount_point, &iso_driver, iso_store, extent);
 }
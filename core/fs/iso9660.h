@@ -73,13 +73,32 @@ typedef struct {
 #define ISO_FLAG_PROTECTION 0x10
 #define ISO_FLAG_MULTIEXTENT 0x80
 
+// A resolved file. Multi-extent files are identified by their first extent
+// and size covers all of their parts.
+typedef struct {
+    uint32_t extent;
+    uint32_t size;
+} iso9660_file_t;
+
 // Initialize ISO9660 filesystem (reads from the boot ISO)
 void iso9660_init(void* iso_start, size_t iso_size);
 
+// Initialize from the ATAPI drive; blocks are read on demand
+void iso9660_init_cdrom(void);
+
 // Find a file in the ISO filesystem
-// Returns pointer to file data and sets size, or NULL if not found
+// Returns pointer to file data and sets size, or NULL if not found.
+// The data is only contiguous for single-extent files; use iso9660_read_at
+// for anything else. When reading from the drive it stays valid until the
+// next read.
 const void* iso9660_find_file(const char* path, size_t* size);
 
+// Resolve path for iso9660_read_at
+bool iso9660_open(const char* path, iso9660_file_t* file);
+
+// Copy up to count bytes starting at offset; returns the bytes copied
+size_t iso9660_read_at(const iso9660_file_t* file, uint32_t offset, void* buffer, size_t count);
+
 // List files in a directory
 void iso9660_list_dir(const char* path);
 
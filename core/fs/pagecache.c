@@ -0,0 +1,202 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/fs/pagecache.h>
+#include <core/kernel/paging.h>
+#include <core/kernel/mem.h>
+
+typedef struct {
+    int8_t store;           // PCACHE_NONE while the descriptor is free
+    bool referenced;        // Clock bit, set on every hit
+    uint32_t file;
+    uint32_t page;
+    const uint8_t* data;    // Store memory or the descriptor's frame
+    uint8_t* frame;         // Allocated on first copy and kept for reuse
+    int16_t next;           // Bucket chain
+} pcache_entry_t;
+
+static const pcache_store_t* stores[PCACHE_MAX_STORES];
+static int store_count = 0;
+
+static pcache_entry_t entries[PCACHE_PAGES];
+static int16_t buckets[PCACHE_BUCKETS];
+static int clock_hand = 0;
+static pcache_stats_t stats;
+
+static uint32_t pcache_bucket(int store, uint32_t file, uint32_t page) {
+    uint32_t hash = (uint32_t)store * 31u + file * 2654435761u + page;
+    return (hash ^ (hash >> 16)) & (PCACHE_BUCKETS - 1);
+}
+
+static const pcache_store_t* pcache_store(int store) {
+    if (store < 0 || store >= store_count) {
+        return NULL;
+    }
+    return stores[store];
+}
+
+static void pcache_unlink(int idx) {
+    pcache_entry_t* e = &entries[idx];
+    int16_t* link = &buckets[pcache_bucket(e->store, e->file, e->page)];
+    while (*link != idx) {
+        link = &entries[*link].next;
+    }
+    *link = e->next;
+    e->store = PCACHE_NONE;
+    e->data = NULL;
+}
+
+// Free descriptor, or the first one the clock finds unreferenced
+static int pcache_victim(void) {
+    for (int n = 0; n < 2 * PCACHE_PAGES; n++) {
+        int idx = clock_hand;
+        clock_hand = (clock_hand + 1) % PCACHE_PAGES;
+
+        if (entries[idx].store == PCACHE_NONE) {
+            return idx;
+        }
+        if (entries[idx].referenced) {
+            entries[idx].referenced = false;
+            continue;
+        }
+        pcache_unlink(idx);
+        stats.evictions++;
+        return idx;
+    }
+    return -1;
+}
+
+void pcache_init(void) {
+    for (int i = 0; i < PCACHE_PAGES; i++) {
+        entries[i].store = PCACHE_NONE;
+        entries[i].data = NULL;
+        entries[i].frame = NULL;
+        entries[i].next = PCACHE_NONE;
+    }
+    for (int i = 0; i < PCACHE_BUCKETS; i++) {
+        buckets[i] = PCACHE_NONE;
+    }
+    store_count = 0;
+    clock_hand = 0;
+    memset(&stats, 0, sizeof(stats));
+}
+
+int pcache_register(const pcache_store_t* store) {
+    if (store_count == PCACHE_MAX_STORES || (!store->map && !store->read)) {
+        return PCACHE_NONE;
+    }
+    stores[store_count] = store;
+    return store_count++;
+}
+
+const void* pcache_page(int store, uint32_t file, uint32_t page) {
+    const pcache_store_t* s = pcache_store(store);
+    if (!s) {
+        return NULL;
+    }
+
+    int16_t* head = &buckets[pcache_bucket(store, file, page)];
+    for (int idx = *head; idx != PCACHE_NONE; idx = entries[idx].next) {
+        pcache_entry_t* e = &entries[idx];
+        if (e->store == store && e->file == file && e->page == page) {
+            e->referenced = true;
+            stats.hits++;
+            return e->data;
+        }
+    }
+
+    stats.misses++;
+    int idx = pcache_victim();
+    if (idx < 0) {
+        return NULL;
+    }
+    pcache_entry_t* e = &entries[idx];
+
+    e->data = s->map ? (const uint8_t*)s->map(file, page) : NULL;
+    if (e->data) {
+        stats.mapped++;
+    } else {
+        if (!s->read) {
+            return NULL;
+        }
+        if (!e->frame) {
+            e->frame = (uint8_t*)frame_alloc();
+            if (!e->frame) {
+                return NULL;
+            }
+            stats.frames++;
+        }
+        if (s->read(file, page, e->frame) < 0) {
+            return NULL;
+        }
+        e->data = e->frame;
+        stats.copied++;
+    }
+
+    e->store = store;
+    e->file = file;
+    e->page = page;
+    e->referenced = true;
+    e->next = *head;
+    *head = idx;
+    return e->data;
+}
+
+size_t pcache_read(int store, uint32_t file, size_t file_size, size_t offset, void* buffer, size_t count) {
+    if (offset >= file_size) {
+        return 0;
+    }
+    if (count > file_size - offset) {
+        count = file_size - offset;
+    }
+
+    size_t done = 0;
+    while (done < count) {
+        size_t pos = offset + done;
+        const uint8_t* page = (const uint8_t*)pcache_page(store, file, pos / PAGE_SIZE);
+        if (!page) {
+            break;
+        }
+
+        size_t chunk = PAGE_SIZE - pos % PAGE_SIZE;
+        if (chunk > count - done) {
+            chunk = count - done;
+        }
+        memcpy((uint8_t*)buffer + done, page + pos % PAGE_SIZE, chunk);
+        done += chunk;
+    }
+    return done;
+}
+
+// Only mapped stores qualify. The later pages are checked against the store
+// directly so a large file does not flush the cache just to be viewed.
+const void* pcache_map(int store, uint32_t file, size_t size) {
+    const pcache_store_t* s = pcache_store(store);
+    if (!s || !s->map) {
+        return NULL;
+    }
+
+    const uint8_t* base = (const uint8_t*)pcache_page(store, file, 0);
+    if (!base) {
+        return NULL;
+    }
+
+    uint32_t pages = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+    for (uint32_t p = 1; p < pages; p++) {
+        if ((const uint8_t*)s->map(file, p) != base + p * PAGE_SIZE) {
+            return NULL;
+        }
+    }
+    return base;
+}
+
+void pcache_invalidate(int store, uint32_t file) {
+    for (int i = 0; i < PCACHE_PAGES; i++) {
+        if (entries[i].store == store && entries[i].file == file) {
+            pcache_unlink(i);
+        }
+    }
+}
+
+void pcache_get_stats(pcache_stats_t* out) {
+    *out = stats;
+}
@@ -0,0 +1,52 @@
+#ifndef PAGECACHE_H
+#define PAGECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PCACHE_MAX_STORES 8
+#define PCACHE_PAGES      128   // Cached page descriptors
+#define PCACHE_BUCKETS    64    // Power of two
+#define PCACHE_NONE       -1
+
+// A backing store hands out the pages of its files. Stores whose bytes are
+// already in memory (boot modules) implement map and are never copied; the
+// cache only remembers where each page lives. Device-backed stores implement
+// read instead and get a cache frame filled. A store with both falls back to
+// read for pages map returns NULL for.
+typedef struct {
+    const char* name;
+    const void* (*map)(uint32_t file, uint32_t page);
+    int (*read)(uint32_t file, uint32_t page, void* frame);
+} pcache_store_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t mapped;        // Pages served straight from store memory
+    uint32_t copied;        // Pages read into cache frames
+    uint32_t evictions;
+    uint32_t frames;        // Cache frames allocated
+} pcache_stats_t;
+
+void pcache_init(void);
+int pcache_register(const pcache_store_t* store);
+
+// Page number page of (store, file), or NULL if the store has no such page
+const void* pcache_page(int store, uint32_t file, uint32_t page);
+
+// Copy count bytes at offset of a file that is file_size long; returns the
+// number of bytes copied
+size_t pcache_read(int store, uint32_t file, size_t file_size, size_t offset, void* buffer, size_t count);
+
+// Contiguous view of the first size bytes of a file, or NULL if the store
+// cannot provide one without copying
+const void* pcache_map(int store, uint32_t file, size_t size);
+
+// Drop cached pages of a file whose contents changed in the store
+void pcache_invalidate(int store, uint32_t file);
+
+void pcache_get_stats(pcache_stats_t* stats);
+
+#endif // PAGECACHE_H
@@ -4,58 +4,108 @@
 #include <core/kernel/kstd.h>
 #include <core/kernel/mem.h>
 
-static ramfs_sector_t sectors[MAX_SECTORS];
+typedef struct {
+    char* data;             // NULL for empty objects
+    size_t size;
+    int next_free;          // Free slots only
+    bool used;
+} ramfs_slot_t;
+
+static ramfs_slot_t* slots = NULL;
+static int slot_count = 0;
+static int free_head = RAMFS_NONE;
+static uint32_t object_count = 0;
+static size_t object_bytes = 0;
+
+// Double the table and chain the new slots, lowest first, onto the free list
+static bool ramfs_grow(void) {
+    int count = slot_count ? slot_count * 2 : RAMFS_MIN_SLOTS;
+    if (count > RAMFS_MAX_SLOTS) {
+        return false;
+    }
+    ramfs_slot_t* table = (ramfs_slot_t*)kmalloc(count * sizeof(ramfs_slot_t));
+    if (!table) {
+        return false;
+    }
+    if (slots) {
+        memcpy(table, slots, slot_count * sizeof(ramfs_slot_t));
+        kfree(slots);
+    }
+    for (int i = count - 1; i >= slot_count; i--) {
+        table[i].data = NULL;
+        table[i].size = 0;
+        table[i].used = false;
+        table[i].next_free = free_head;
+        free_head = i;
+    }
+    slots = table;
+    slot_count = count;
+    return true;
+}
 
 void ramfs_init() {
-    for(int i = 0; i < MAX_SECTORS; i++) {
-        sectors[i].used = false;
-        sectors[i].size = 0;
-        sectors[i].data[0] = '\0';
+    if (!slots && !ramfs_grow()) {
+        kprint("Error: Cannot allocate the RamFS slot table\n", 14);
+        return;
     }
     kprint(":: RamFS initialized\n", 7);
 }
 
-int ramfs_write(const char* data, size_t size) {
-    if (size > SECTOR_SIZE) {
-        kprint("Error: Data too large for sector\n", 14);
-        return -1;
-    }
-    
-    for(int i = 0; i < MAX_SECTORS; i++) {
-        if(!sectors[i].used) {
-            memcpy(sectors[i].data, data, size);
-            sectors[i].size = size;
-            sectors[i].used = true;
-            
-            return i;
+int ramfs_create(size_t size) {
+    if (free_head == RAMFS_NONE && !ramfs_grow()) {
+        kprint("Error: No free slots in RamFS\n", 14);
+        return RAMFS_NONE;
+    }
+
+    char* data = NULL;
+    if (size > 0) {
+        data = (char*)kmalloc(size);
+        if (!data) {
+            kprint("Error: Not enough memory for RamFS object\n", 14);
+            return RAMFS_NONE;
         }
     }
-    
-    kprint("Error: No free sectors in RamFS\n", 14);
-    return -1;
+
+    int slot = free_head;
+    free_head = slots[slot].next_free;
+    slots[slot].data = data;
+    slots[slot].size = size;
+    slots[slot].used = true;
+    object_count++;
+    object_bytes += size;
+    return slot;
 }
 
-const char* ramfs_read(int sector, size_t* size) {
-    if(sector < 0 || sector >= MAX_SECTORS || !sectors[sector].used) {
-        if (size) *size = 0;
+char* ramfs_data(int slot) {
+    if (slot < 0 || slot >= slot_count || !slots[slot].used) {
         return NULL;
     }
-    
-    if (size) *size = sectors[sector].size;
-    return sectors[sector].data;
+    return slots[slot].data;
 }
 
-void ramfs_delete(int sector) {
-    if(sector >= 0 && sector < MAX_SECTORS) {
-        sectors[sector].used = false;
-        sectors[sector].size = 0;
-        sectors[sector].data[0] = '\0';
+void ramfs_delete(int slot) {
+    if (slot < 0 || slot >= slot_count || !slots[slot].used) {
+        return;
     }
+    kfree(slots[slot].data);
+    object_count--;
+    object_bytes -= slots[slot].size;
+    slots[slot].data = NULL;
+    slots[slot].size = 0;
+    slots[slot].used = false;
+    slots[slot].next_free = free_head;
+    free_head = slot;
 }
 
-size_t ramfs_get_size(int sector) {
-    if(sector < 0 || sector >= MAX_SECTORS || !sectors[sector].used) {
-        return 0;
+void ramfs_get_stats(ramfs_stats_t* stats) {
+    stats->objects = object_count;
+    stats->slots = slot_count;
+    stats->bytes = object_bytes;
+    stats->largest = 0;
+    stats->table_bytes = slot_count * sizeof(ramfs_slot_t);
+    for (int i = 0; i < slot_count; i++) {
+        if (slots[i].used && slots[i].size > stats->largest) {
+            stats->largest = slots[i].size;
+        }
     }
-    return sectors[sector].size;
 }
@@ -5,19 +5,29 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define MAX_SECTORS 256
-#define SECTOR_SIZE 4096
+// Variable-size objects on the kernel heap, addressed by slot number. Free
+// slots are chained through the table, so taking or returning one is O(1);
+// the table doubles when it runs out.
+#define RAMFS_MIN_SLOTS 64
+#define RAMFS_MAX_SLOTS 4096
+#define RAMFS_NONE      -1
 
 typedef struct {
-    char data[SECTOR_SIZE];
-    size_t size;
-    bool used;
-} ramfs_sector_t;
+    uint32_t objects;
+    uint32_t slots;         // Table capacity
+    size_t bytes;           // Object data
+    size_t largest;         // Biggest object
+    size_t table_bytes;     // Slot table itself
+} ramfs_stats_t;
 
 void ramfs_init(void);
-int ramfs_write(const char* data, size_t size);
-const char* ramfs_read(int sector, size_t* size);
-void ramfs_delete(int sector);
-size_t ramfs_get_size(int sector);
 
-#endif
\ No newline at end of file
+// Reserve an object of size bytes; returns its slot or RAMFS_NONE. Holds the
+// inflated copies of compressed initramfs programs.
+int ramfs_create(size_t size);
+char* ramfs_data(int slot);
+void ramfs_delete(int slot);
+
+void ramfs_get_stats(ramfs_stats_t* stats);
+
+#endif
@@ -0,0 +1,728 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/bench.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/nvm/nvm.h>
+#include <core/kernel/nvm/syscall.h>
+#include <core/kernel/nvm/caps.h>
+#include <core/drivers/timer.h>
+#include <core/drivers/block.h>
+#include <core/drivers/ramdisk.h>
+#include <core/kernel/lz4.h>
+#include <core/fs/initramfs.h>
+#include <usr/vfs.h>
+#include <stddef.h>
+
+#define BENCH_IPC_BYTES (64 * 1024)
+#define BENCH_VECTOR_BATCH 16
+#define BENCH_CALLS 2000
+#define BENCH_SPAWNS 500
+#define BENCH_TICK_LIMIT 10000000
+#define BENCH_WORKER_PATH "/bw"
+#define BENCH_VFS_ROUNDS 20
+#define BENCH_VFS_DIR "/tmp/bench"
+#define BENCH_BLK_OPS 512               // 4 KB requests per pattern
+#define BENCH_BLK_BATCH 16              // Requests queued per plug
+#define BENCH_BLK_IO_SIZE 4096
+#define BENCH_LZ4_SAMPLE 0x100000       // Kernel code, loaded at 1 MB
+#define BENCH_LZ4_WINDOW (64 * 1024)    // Tiled; copies lie past LZ4's 64 KB reach
+#define BENCH_LZ4_MAX (1024 * 1024)
+
+int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc);
+
+// Server: reply_wait in a loop, answering every request with request + 1
+static uint8_t bench_server_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x02, 0xFF, 0xFF, 0xFF, 0xFF,   // push -1 (no client yet)
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push 0
+    0x50, SYS_MSG_REPLY_WAIT,       // 14: reply_wait
+    0x02, 0x00, 0x00, 0x00, 0x01,   // push 1
+    0x10,                           // add
+    0x30, 0x00, 0x00, 0x00, 0x0E    // jmp 14
+};
+
+// Client: locals[0] counts down the calls left; the server pid is patched in
+static uint8_t bench_client_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push BENCH_CALLS
+    0x41, 0x00,                     // store 0
+    0x02, 0x00, 0x00, 0x00, 0x00,   // 11: push server
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push 0
+    0x50, SYS_MSG_CALL,             // call
+    0x04,                           // pop
+    0x40, 0x00,                     // load 0
+    0x02, 0x00, 0x00, 0x00, 0x01,   // push 1
+    0x11,                           // sub
+    0x05,                           // dup
+    0x41, 0x00,                     // store 0
+    0x32, 0x00, 0x00, 0x00, 0x0B,   // jnz 11
+    0x00                            // halt
+};
+
+// Spinner: a runnable process that never blocks
+static uint8_t bench_spinner_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x30, 0x00, 0x00, 0x00, 0x04    // jmp 4
+};
+
+// Supervisor: exec the worker from the VFS and wait for it, BENCH_SPAWNS times
+static uint8_t bench_supervisor_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x02, 0x00, 0x77, 0x62, 0x2F,   // push "/bw\0" as raw local bytes
+    0x41, 0x01,                     // store 1
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push BENCH_SPAWNS
+    0x41, 0x00,                     // store 0
+    0x02, 0x00, 0x00, 0x00, 0x00,   // 18: push 0 (argc)
+    0x02, 0x00, 0x00, 0x00, EXEC_VFS_PATH,
+    0x02, 0x00, 0x00, 0x00, 0x01,   // push 1 (path local)
+    0x50, SYS_EXEC,                 // exec -> pid
+    0x50, SYS_WAIT,                 // wait -> pid, exit_code
+    0x04,                           // pop
+    0x04,                           // pop
+    0x40, 0x00,                     // load 0
+    0x02, 0x00, 0x00, 0x00, 0x01,   // push 1
+    0x11,                           // sub
+    0x05,                           // dup
+    0x41, 0x00,                     // store 0
+    0x32, 0x00, 0x00, 0x00, 0x12,   // jnz 18
+    0x00                            // halt
+};
+
+// Worker: exits straight away with argc as the exit code
+static uint8_t bench_worker_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x50, SYS_EXIT
+};
+
+// STORE_ABS with the address and value patched in
+static uint8_t bench_abs_store_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push address
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push value
+    0x45,                           // store_abs
+    0x00                            // halt
+};
+
+// LOAD_ABS with the address patched in
+static uint8_t bench_abs_load_code[] = {
+    0x4E, 0x56, 0x4D, 0x30,
+    0x02, 0x00, 0x00, 0x00, 0x00,   // push address
+    0x44,                           // load_abs
+    0x04,                           // pop
+    0x00                            // halt
+};
+
+// Kernel memory that bench abs tries to write through the high alias
+static volatile int32_t bench_abs_target = 0;
+
+static int bench_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+void bench_report(const char* label, uint32_t bytes, uint32_t us) {
+    char buf[16];
+
+    if (us == 0) us = 1;
+    // Hundredths of a MB/s, so the slow byte path still shows a rate
+    uint32_t rate = udiv64_32((uint64_t)bytes * 100000000, us) / (1024 * 1024);
+
+    kprint("  ", 7);
+    kprint(label, 11);
+    kprint(": ", 7);
+    itoa(rate / 100, buf, 10);
+    kprint(buf, 15);
+    kprint(rate % 100 < 10 ? ".0" : ".", 15);
+    itoa(rate % 100, buf, 10);
+    kprint(buf, 15);
+    kprint(" MB/s (", 7);
+    itoa(us, buf, 10);
+    kprint(buf, 7);
+    kprint(" us)\n", 7);
+}
+
+// Benchmark processes occupy real slots so message delivery finds them,
+// but stay blocked so the scheduler never runs them.
+static nvm_process_t* bench_claim_process(void) {
+    for (int i = 1; i < MAX_PROCESSES; i++) {
+        if (!processes[i].active && !processes[i].zombie) {
+            nvm_process_t* proc = &processes[i];
+            proc->active = true;
+            proc->blocked = true;
+            proc->wait_mask = 0;
+            proc->ipc_state = IPC_NONE;
+            proc->pid = i;
+            proc->sp = 0;
+            proc->ip = 0;
+            proc->size = 0;
+            proc->caps_mask = 0;
+            proc->caps_count = 0;
+            return proc;
+        }
+    }
+    return NULL;
+}
+
+static void bench_release_process(nvm_process_t* proc) {
+    proc->active = false;
+    proc->blocked = false;
+}
+
+static uint32_t bench_ipc_bytes(nvm_process_t* tx, nvm_process_t* rx) {
+    uint64_t start = timer_read_tsc();
+
+    for (uint32_t i = 0; i < BENCH_IPC_BYTES; i++) {
+        tx->stack[tx->sp++] = rx->pid;
+        tx->stack[tx->sp++] = i & 0xFF;
+        syscall_handler(SYS_MSG_SEND, tx);
+
+        syscall_handler(SYS_MSG_RECEIVE, rx);
+        rx->sp = 0;
+    }
+
+    return timer_elapsed_us(start);
+}
+
+static uint32_t bench_ipc_vector(nvm_process_t* tx, nvm_process_t* rx) {
+    uint64_t start = timer_read_tsc();
+
+    for (uint32_t i = 0; i < BENCH_IPC_BYTES; i += BENCH_VECTOR_BATCH) {
+        for (int j = 0; j < BENCH_VECTOR_BATCH; j++) {
+            tx->stack[tx->sp++] = rx->pid;
+            tx->stack[tx->sp++] = j;
+        }
+        tx->stack[tx->sp++] = BENCH_VECTOR_BATCH;
+        syscall_handler(SYS_MSG_SEND_V, tx);
+        tx->sp = 0;
+
+        for (int j = 0; j < BENCH_VECTOR_BATCH; j++) {
+            syscall_handler(SYS_MSG_RECEIVE, rx);
+            rx->sp = 0;
+        }
+    }
+
+    return timer_elapsed_us(start);
+}
+
+static uint32_t bench_ipc_bulk(nvm_process_t* tx, nvm_process_t* rx, uint32_t chunk) {
+    uint64_t start = timer_read_tsc();
+
+    for (uint32_t sent = 0; sent < BENCH_IPC_BYTES; sent += chunk) {
+        tx->stack[tx->sp++] = rx->pid;
+        tx->stack[tx->sp++] = 0;
+        tx->stack[tx->sp++] = chunk;
+        syscall_handler(SYS_MSG_SEND_BULK, tx);
+        tx->sp = 0;
+
+        rx->stack[rx->sp++] = 0;
+        rx->stack[rx->sp++] = chunk;
+        syscall_handler(SYS_MSG_RECV_BULK, rx);
+        rx->sp = 0;
+    }
+
+    return timer_elapsed_us(start);
+}
+
+static void bench_put32(uint8_t* at, uint32_t value) {
+    at[0] = value >> 24;
+    at[1] = value >> 16;
+    at[2] = value >> 8;
+    at[3] = value;
+}
+
+// Call-to-reply time per completed call, measured by the kernel from the
+// MSG_CALL to the reply landing on the client's stack. The direct switch runs
+// the server on a fresh slice, so it should not change with the number of
+// spinners; the wall time per call does, since the client's own instructions
+// between calls still share the CPU with them.
+static void bench_call_with_spinners(int spinners) {
+    int spinner_pids[16];
+    int server = nvm_create_process(bench_server_code, sizeof(bench_server_code), NULL, 0);
+
+    bench_put32(&bench_client_code[5], BENCH_CALLS);
+    bench_put32(&bench_client_code[12], server);
+    int client = nvm_create_process(bench_client_code, sizeof(bench_client_code), NULL, 0);
+
+    for (int i = 0; i < spinners; i++) {
+        spinner_pids[i] = nvm_create_process(bench_spinner_code, sizeof(bench_spinner_code), NULL, 0);
+    }
+
+    if (server < 0 || client < 0) {
+        kprint("bench: no free process slots\n", 12);
+    }
+
+    uint32_t calls_before, call_us_before;
+    ipc_get_call_stats(&calls_before, &call_us_before);
+    uint64_t start = timer_read_tsc();
+    for (uint32_t tick = 0; server >= 0 && client >= 0 && nvm_is_process_active(client) && tick < BENCH_TICK_LIMIT; tick++) {
+        nvm_scheduler_tick();
+    }
+    uint32_t us = timer_elapsed_us(start);
+    uint32_t calls, call_us;
+    ipc_get_call_stats(&calls, &call_us);
+    calls -= calls_before;
+    call_us -= call_us_before;
+    if (calls == 0) calls = 1;
+
+    char buf[16];
+    kprint("  spinners=", 7);
+    itoa(spinners, buf, 10);
+    kprint(buf, 15);
+    kprint(" round trip: ", 7);
+    itoa(udiv64_32((uint64_t)call_us * 1000, calls), buf, 10);
+    kprint(buf, 15);
+    kprint(" ns, wall per call: ", 7);
+    itoa(udiv64_32((uint64_t)us * 1000, calls), buf, 10);
+    kprint(buf, 7);
+    kprint(" ns\n", 7);
+
+    if (server >= 0) processes[server].active = false;
+    if (client >= 0) processes[client].active = false;
+    for (int i = 0; i < spinners; i++) {
+        if (spinner_pids[i] >= 0) processes[spinner_pids[i]].active = false;
+    }
+}
+
+static void bench_call(void) {
+    kprint("\nCall/reply latency (", 10);
+    char buf[16];
+    itoa(BENCH_CALLS, buf, 10);
+    kprint(buf, 10);
+    kprint(" calls):\n", 10);
+
+    bench_call_with_spinners(0);
+    bench_call_with_spinners(4);
+    bench_call_with_spinners(16);
+    kprint("\n", 7);
+}
+
+static void bench_spawn(void) {
+    uint16_t caps[] = { CAP_FS_READ };
+
+    if (vfs_create(BENCH_WORKER_PATH, (const char*)bench_worker_code, sizeof(bench_worker_code)) < 0) {
+        kprint("bench: cannot create worker image\n", 12);
+        return;
+    }
+
+    bench_put32(&bench_supervisor_code[12], BENCH_SPAWNS);
+    int supervisor = nvm_create_process(bench_supervisor_code, sizeof(bench_supervisor_code), caps, 1);
+    if (supervisor < 0) {
+        kprint("bench: no free process slots\n", 12);
+        vfs_delete(BENCH_WORKER_PATH);
+        return;
+    }
+
+    uint64_t start = timer_read_tsc();
+    for (uint32_t tick = 0; nvm_is_process_active(supervisor) && tick < BENCH_TICK_LIMIT; tick++) {
+        nvm_scheduler_tick();
+    }
+    uint32_t us = timer_elapsed_us(start);
+    if (us == 0) us = 1;
+
+    char buf[16];
+    kprint("\nSpawn/exit throughput (", 10);
+    itoa(BENCH_SPAWNS, buf, 10);
+    kprint(buf, 10);
+    kprint(" exec + wait from VFS):\n", 10);
+    kprint("  ", 7);
+    itoa(udiv64_32((uint64_t)BENCH_SPAWNS * 1000000, us), buf, 10);
+    kprint(buf, 15);
+    kprint(" spawns/s, ", 7);
+    itoa(us / BENCH_SPAWNS, buf, 10);
+    kprint(buf, 15);
+    kprint(" us per spawn (", 7);
+    itoa(us, buf, 10);
+    kprint(buf, 7);
+    kprint(" us)\n\n", 7);
+
+    processes[supervisor].active = false;
+    vfs_delete(BENCH_WORKER_PATH);
+}
+
+static void bench_report_ops(const char* label, uint32_t ops, uint32_t us) {
+    char buf[16];
+
+    kprint("  ", 7);
+    kprint(label, 11);
+    kprint(": ", 7);
+    itoa(udiv64_32((uint64_t)us * 1000, ops ? ops : 1), buf, 10);
+    kprint(buf, 15);
+    kprint(" ns/op (", 7);
+    itoa(ops, buf, 10);
+    kprint(buf, 7);
+    kprint(" ops)\n", 7);
+}
+
+// "<dir>/b<n>"
+static void bench_vfs_name(char* buf, const char* dir, int n) {
+    const char* prefix = "/b";
+    int i = 0;
+    while (*dir) {
+        buf[i++] = *dir++;
+    }
+    while (*prefix) {
+        buf[i++] = *prefix++;
+    }
+    itoa(n, buf + i, 10);
+}
+
+// Fills every free VFS slot, then times create, hit/miss lookups, moving
+// each file to another directory and delete
+static void bench_vfs(void) {
+    char name[32];
+    char dest[32];
+    // Moves stay in memory: /home and /var/log may be on disk
+    bool made_dir = !vfs_exists(BENCH_VFS_DIR);
+    if (made_dir && vfs_mkdir(BENCH_VFS_DIR) < 0) {
+        kprint("bench: cannot create " BENCH_VFS_DIR "\n", 12);
+        return;
+    }
+    int files = MAX_FILES - 1 - vfs_count();
+    uint32_t create_us = 0, hit_us = 0, miss_us = 0, rename_us = 0, delete_us = 0;
+
+    for (int round = 0; round < BENCH_VFS_ROUNDS; round++) {
+        uint64_t start = timer_read_tsc();
+        for (int i = 0; i < files; i++) {
+            bench_vfs_name(name, "/tmp", i);
+            vfs_create(name, name, 8);
+        }
+        create_us += timer_elapsed_us(start);
+
+        start = timer_read_tsc();
+        for (int i = 0; i < files; i++) {
+            bench_vfs_name(name, "/tmp", i);
+            vfs_exists(name);
+        }
+        hit_us += timer_elapsed_us(start);
+
+        start = timer_read_tsc();
+        for (int i = 0; i < files; i++) {
+            bench_vfs_name(name, "/tmp", files + i);
+            vfs_exists(name);
+        }
+        miss_us += timer_elapsed_us(start);
+
+        start = timer_read_tsc();
+        for (int i = 0; i < files; i++) {
+            bench_vfs_name(name, "/tmp", i);
+            bench_vfs_name(dest, BENCH_VFS_DIR, i);
+            vfs_rename(name, dest);
+        }
+        rename_us += timer_elapsed_us(start);
+
+        start = timer_read_tsc();
+        for (int i = 0; i < files; i++) {
+            bench_vfs_name(name, BENCH_VFS_DIR, i);
+            vfs_delete(name);
+        }
+        delete_us += timer_elapsed_us(start);
+    }
+
+    char buf[16];
+    uint32_t ops = files * BENCH_VFS_ROUNDS;
+    kprint("\nVFS path operations (", 10);
+    itoa(files, buf, 10);
+    kprint(buf, 10);
+    kprint(" files, ", 10);
+    itoa(vfs_count() + files, buf, 10);
+    kprint(buf, 10);
+    kprint(" entries at peak):\n", 10);
+    bench_report_ops("create     ", ops, create_us);
+    bench_report_ops("lookup hit ", ops, hit_us);
+    bench_report_ops("lookup miss", ops, miss_us);
+    bench_report_ops("move       ", ops, rename_us);
+    bench_report_ops("delete     ", ops, delete_us);
+    kprint("\n", 7);
+
+    if (made_dir) {
+        vfs_delete(BENCH_VFS_DIR);
+    }
+}
+
+static void bench_report_io(const char* label, uint32_t ops, uint32_t us, uint32_t dispatches) {
+    char buf[16];
+
+    if (us == 0) us = 1;
+    kprint("  ", 7);
+    kprint(label, 11);
+    kprint(": ", 7);
+    itoa(udiv64_32((uint64_t)ops * 1000000, us), buf, 10);
+    kprint(buf, 15);
+    kprint(" IOPS, ", 7);
+    itoa(udiv64_32((uint64_t)ops * (BENCH_BLK_IO_SIZE / 1024) * 1000000, us), buf, 10);
+    kprint(buf, 15);
+    kprint(" KB/s (", 7);
+    itoa(dispatches, buf, 10);
+    kprint(buf, 7);
+    kprint(" transfers)\n", 7);
+}
+
+// Queues BENCH_BLK_BATCH requests per plug into adjacent buffer slots, so
+// sequential batches merge and random ones mostly cannot
+static void bench_blk_pattern(int dev, const char* label, int op, bool random, uint8_t* buffer) {
+    uint32_t per_io = BENCH_BLK_IO_SIZE / block_driver(dev)->sector_size;
+    uint32_t slots = block_sectors(dev) / per_io;
+    uint32_t seed = 12345;
+    block_stats_t before, after;
+
+    block_get_stats(dev, &before);
+    uint64_t start = timer_read_tsc();
+    for (uint32_t i = 0; i < BENCH_BLK_OPS; i += BENCH_BLK_BATCH) {
+        block_batch_t batch;
+        block_batch_init(&batch);
+        block_plug(dev);
+        for (uint32_t j = 0; j < BENCH_BLK_BATCH; j++) {
+            uint32_t slot = (i + j) % slots;
+            if (random) {
+                seed = seed * 1103515245 + 12345;
+                slot = (seed >> 8) % slots;
+            }
+            block_batch_submit(&batch, dev, op, slot * per_io, per_io, buffer + j * BENCH_BLK_IO_SIZE);
+        }
+        block_unplug(dev);
+        if (block_batch_wait(&batch) < 0) {
+            kprint("  ", 7);
+            kprint(label, 12);
+            kprint(": I/O error\n", 12);
+            return;
+        }
+    }
+    uint32_t us = timer_elapsed_us(start);
+    block_get_stats(dev, &after);
+    bench_report_io(label, BENCH_BLK_OPS, us, after.dispatches - before.dispatches);
+}
+
+// Sequential and random 4 KB reads on every block device. Writes go only to
+// the RAM disk: the others hold filesystems or whatever the user put there.
+static void bench_blk(void) {
+    uint8_t* buffer = (uint8_t*)kmalloc(BENCH_BLK_BATCH * BENCH_BLK_IO_SIZE);
+    if (!buffer) {
+        kprint("bench: out of memory\n", 12);
+        return;
+    }
+
+    for (int dev = 0; dev < block_count(); dev++) {
+        const block_driver_t* drv = block_driver(dev);
+        if (block_sectors(dev) < BENCH_BLK_IO_SIZE / drv->sector_size) {
+            continue;
+        }
+
+        char buf[16];
+        kprint("\nBlock I/O on ", 10);
+        kprint(drv->name, 10);
+        kprint(" (", 10);
+        itoa(BENCH_BLK_OPS, buf, 10);
+        kprint(buf, 10);
+        kprint(" x 4 KB, ", 10);
+        itoa(BENCH_BLK_BATCH, buf, 10);
+        kprint(buf, 10);
+        kprint(" per batch):\n", 10);
+        bench_blk_pattern(dev, "seq read   ", BLOCK_READ, false, buffer);
+        bench_blk_pattern(dev, "rand read  ", BLOCK_READ, true, buffer);
+        if (!drv->read_only && dev == block_find(RAMDISK_NAME)) {
+            bench_blk_pattern(dev, "seq write  ", BLOCK_WRITE, false, buffer);
+            bench_blk_pattern(dev, "rand write ", BLOCK_WRITE, true, buffer);
+        }
+    }
+    kprint("\n", 7);
+    kfree(buffer);
+}
+
+static const uint32_t bench_lz4_sizes[] = { 4096, 65536, 262144, BENCH_LZ4_MAX };
+
+static void bench_lz4_report(uint32_t size, int packed, uint32_t us) {
+    char buf[16];
+
+    kprint("  ", 7);
+    itoa(size / 1024, buf, 10);
+    kprint(buf, 11);
+    kprint(" KB -> ", 7);
+    itoa(packed / 1024, buf, 10);
+    kprint(buf, 7);
+    kprint(" KB (", 7);
+    itoa(udiv64_32((uint64_t)packed * 100, size), buf, 10);
+    kprint(buf, 7);
+    kprint("%): inflate ", 7);
+    itoa(us, buf, 10);
+    kprint(buf, 15);
+    kprint(" us, ", 7);
+    itoa(udiv64_32(size, us), buf, 10);
+    kprint(buf, 15);
+    if ((uint32_t)packed < size) {
+        kprint(" MB/s; smaller image boots faster below ", 7);
+        itoa(udiv64_32(size - packed, us), buf, 10);
+        kprint(buf, 15);
+        kprint(" MB/s load\n", 7);
+    } else {
+        kprint(" MB/s; no gain, store it plain\n", 7);
+    }
+}
+
+// Compressed vs plain images: loading the plain one costs size / bandwidth,
+// the compressed one packed / bandwidth plus the inflate time, so
+// compression wins whenever the boot medium is slower than the bytes it
+// saves per microsecond of inflating
+static void bench_lz4(void) {
+    uint8_t* raw = (uint8_t*)kmalloc(BENCH_LZ4_MAX);
+    uint8_t* packed = (uint8_t*)kmalloc(LZ4_BOUND(BENCH_LZ4_MAX));
+    uint8_t* out = (uint8_t*)kmalloc(BENCH_LZ4_MAX);
+    if (!raw || !packed || !out) {
+        kprint("bench: out of memory\n", 12);
+        kfree(raw);
+        kfree(packed);
+        kfree(out);
+        return;
+    }
+    for (uint32_t i = 0; i < BENCH_LZ4_MAX; i += BENCH_LZ4_WINDOW) {
+        memcpy(raw + i, (const void*)BENCH_LZ4_SAMPLE, BENCH_LZ4_WINDOW);
+    }
+
+    kprint("\nLZ4 on kernel code:\n", 10);
+    for (size_t i = 0; i < sizeof(bench_lz4_sizes) / sizeof(bench_lz4_sizes[0]); i++) {
+        uint32_t size = bench_lz4_sizes[i];
+        int n = lz4_compress(raw, size, packed, LZ4_BOUND(size));
+
+        // Small blocks inflate too fast for one timing, repeat up to 1 MB
+        uint32_t rounds = BENCH_LZ4_MAX / size;
+        uint64_t start = timer_read_tsc();
+        bool ok = n > 0;
+        for (uint32_t r = 0; r < rounds && ok; r++) {
+            ok = lz4_decompress(packed, n, out, size) == (int)size;
+        }
+        uint32_t us = udiv64_32(timer_elapsed_us(start), rounds);
+        for (uint32_t k = 0; k < size && ok; k++) {
+            ok = out[k] == raw[k];
+        }
+        if (!ok) {
+            kprint("  LZ4 round trip failed\n", 12);
+            break;
+        }
+        bench_lz4_report(size, n, us ? us : 1);
+    }
+
+    size_t inflated;
+    uint32_t inflate_us;
+    initramfs_inflate_stats(&inflated, &inflate_us);
+    kprint("  Initramfs: ", 7);
+    char buf[16];
+    itoa((int)inflated, buf, 10);
+    kprint(buf, 15);
+    kprint(" bytes inflated so far in ", 7);
+    itoa(inflate_us, buf, 10);
+    kprint(buf, 15);
+    kprint(" us\n\n", 7);
+
+    kfree(raw);
+    kfree(packed);
+    kfree(out);
+}
+
+// Run code with CAP_DRV_ACCESS; true if it got to its HALT, false if the
+// address was rejected and the process killed
+static bool bench_abs_run(uint8_t* code, uint32_t size) {
+    uint16_t caps[] = { CAP_DRV_ACCESS };
+    int pid = nvm_create_process(code, size, caps, 1);
+    if (pid < 0) {
+        return false;
+    }
+    for (uint32_t tick = 0; nvm_is_process_active(pid) && tick < BENCH_TICK_LIMIT; tick++) {
+        nvm_scheduler_tick();
+    }
+    bool halted = !processes[pid].active && processes[pid].exit_code == 0;
+    processes[pid].active = false;
+    return halted;
+}
+
+static bool bench_abs_check(const char* label, bool allowed, bool expected) {
+    kprint("  ", 7);
+    kprint(label, 11);
+    kprint(": ", 7);
+    kprint(allowed ? "allowed" : "rejected", allowed == expected ? 10 : 12);
+    kprint(allowed == expected ? "\n" : " (FAIL)\n", allowed == expected ? 7 : 12);
+    return allowed == expected;
+}
+
+static bool bench_abs_store(uint32_t addr, uint32_t value) {
+    bench_put32(&bench_abs_store_code[5], addr);
+    bench_put32(&bench_abs_store_code[10], value);
+    return bench_abs_run(bench_abs_store_code, sizeof(bench_abs_store_code));
+}
+
+static bool bench_abs_load(uint32_t addr) {
+    bench_put32(&bench_abs_load_code[5], addr);
+    return bench_abs_run(bench_abs_load_code, sizeof(bench_abs_load_code));
+}
+
+// A driver process may reach devices but no kernel memory, whichever
+// mapping it goes through
+static void bench_abs(void) {
+    uint32_t target = (uint32_t)(uintptr_t)&bench_abs_target;
+    bool ok = true;
+
+    kprint("\nLOAD_ABS/STORE_ABS reach with CAP_DRV_ACCESS:\n", 10);
+    ok &= bench_abs_check("load VGA text buffer      ", bench_abs_load(0xB8000), true);
+    ok &= bench_abs_check("store kernel data         ", bench_abs_store(target, 0x4E564D21), false);
+    ok &= bench_abs_check("store via 0xC0000000 alias", bench_abs_store(PHYS_TO_HIGH(target), 0x4E564D21), false);
+    ok &= bench_abs_check("load across alias start   ", bench_abs_load(KERNEL_HIGH_BASE - 2), false);
+    ok &= bench_abs_check("alias target unchanged    ", bench_abs_target == 0, true);
+    kprint(ok ? "  all checks passed\n\n" : "  some checks FAILED\n\n", ok ? 10 : 12);
+}
+
+static void bench_ipc(void) {
+    nvm_process_t* tx = bench_claim_process();
+    nvm_process_t* rx = bench_claim_process();
+
+    if (!tx || !rx) {
+        kprint("bench: no free process slots\n", 12);
+        if (tx) bench_release_process(tx);
+        return;
+    }
+
+    kprint("\nIPC throughput (64 KB per run):\n", 10);
+    bench_report("byte msg_send/recv", BENCH_IPC_BYTES, bench_ipc_bytes(tx, rx));
+    bench_report("msg_send_v x16   ", BENCH_IPC_BYTES, bench_ipc_vector(tx, rx));
+    bench_report("bulk 256 B       ", BENCH_IPC_BYTES, bench_ipc_bulk(tx, rx, 256));
+    bench_report("bulk 1 KB        ", BENCH_IPC_BYTES, bench_ipc_bulk(tx, rx, 1024));
+    kprint("\n", 7);
+
+    bench_release_process(tx);
+    bench_release_process(rx);
+}
+
+void bench_run(const char* name) {
+    if (name == NULL || *name == '\0') {
+        kprint("\nUsage: bench <name>\n", 12);
+        kprint("  ipc      - NVM message passing throughput\n", 7);
+        kprint("  call     - Synchronous call/reply latency\n", 7);
+        kprint("  spawn    - SYS_EXEC + SYS_WAIT throughput\n", 7);
+        kprint("  vfs      - VFS create/lookup/move/delete cost\n", 7);
+        kprint("  blk      - Block device IOPS and throughput\n", 7);
+        kprint("  lz4      - LZ4 ratio, inflate speed and boot break-even\n", 7);
+        kprint("  abs      - LOAD_ABS/STORE_ABS address checks\n\n", 7);
+        return;
+    }
+
+    if (bench_strcmp(name, "ipc") == 0) {
+        bench_ipc();
+    } else if (bench_strcmp(name, "call") == 0) {
+        bench_call();
+    } else if (bench_strcmp(name, "spawn") == 0) {
+        bench_spawn();
+    } else if (bench_strcmp(name, "vfs") == 0) {
+        bench_vfs();
+    } else if (bench_strcmp(name, "blk") == 0) {
+        bench_blk();
+    } else if (bench_strcmp(name, "lz4") == 0) {
+        bench_lz4();
+    } else if (bench_strcmp(name, "abs") == 0) {
+        bench_abs();
+    } else {
+        kprint("\nbench: unknown benchmark '", 12);
+        kprint(name, 12);
+        kprint("'\n\n", 12);
+    }
+}
@@ -0,0 +1,12 @@
+#ifndef _BENCH_H_
+#define _BENCH_H_
+
+#include <stdint.h>
+
+// Run a named kernel benchmark ("ipc", ...) and print the results
+void bench_run(const char* name);
+
+// Print "<label>: <rate> MB/s (<us> us)" for a measured transfer
+void bench_report(const char* label, uint32_t bytes, uint32_t us);
+
+#endif // _BENCH_H_
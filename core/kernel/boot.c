@@ -0,0 +1,176 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/boot.h>
+#include <core/kernel/kstd.h>
+#include <core/kernel/syslog.h>
+#include <core/drivers/timer.h>
+
+typedef struct {
+    const char* name;
+    boot_step_t step;
+    uint32_t deps;
+    uint32_t steps;
+    uint32_t busy_us;       // Time spent in steps
+} boot_task_t;
+
+typedef struct {
+    const char* phase;
+    uint32_t us;
+} boot_mark_t;
+
+static boot_task_t tasks[BOOT_MAX_TASKS];
+static int task_count = 0;
+static uint32_t done_mask = 0;
+static int next_task = 0;       // Where boot_poll starts looking, round robin
+static bool stepping = false;   // A step that ticks the scheduler must not nest
+
+static uint64_t boot_start = 0;
+static boot_mark_t marks[BOOT_MAX_MARKS];
+static int mark_count = 0;
+static bool log_ready = false;
+
+static int boot_strcmp(const char* s1, const char* s2) {
+    while (*s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+static void boot_log_time(uint32_t us) {
+    char buf[16];
+    syslog_write("[boot ");
+    itoa((int)us, buf, 10);
+    syslog_write(buf);
+    syslog_write(" us] ");
+}
+
+static void boot_log(const char* phase, uint32_t us) {
+    boot_log_time(us);
+    syslog_write(phase);
+    syslog_write("\n");
+}
+
+void boot_init(void) {
+    boot_start = timer_read_tsc();
+    task_count = 0;
+    done_mask = 0;
+    next_task = 0;
+    mark_count = 0;
+    log_ready = false;
+}
+
+void boot_mark(const char* phase) {
+    uint32_t us = timer_elapsed_us(boot_start);
+    if (log_ready) {
+        boot_log(phase, us);
+    } else if (mark_count < BOOT_MAX_MARKS) {
+        marks[mark_count].phase = phase;
+        marks[mark_count].us = us;
+        mark_count++;
+    }
+}
+
+void boot_log_ready(void) {
+    log_ready = true;
+    for (int i = 0; i < mark_count; i++) {
+        boot_log(marks[i].phase, marks[i].us);
+    }
+    mark_count = 0;
+}
+
+int boot_add(const char* name, boot_step_t step, uint32_t deps) {
+    if (task_count == BOOT_MAX_TASKS) {
+        return BOOT_NONE;
+    }
+    tasks[task_count].name = name;
+    tasks[task_count].step = step;
+    tasks[task_count].deps = deps;
+    tasks[task_count].steps = 0;
+    tasks[task_count].busy_us = 0;
+    return task_count++;
+}
+
+static void boot_step(int id) {
+    boot_task_t* t = &tasks[id];
+    uint64_t start = timer_read_tsc();
+    stepping = true;
+    bool finished = t->step();
+    stepping = false;
+    t->busy_us += timer_elapsed_us(start);
+    t->steps++;
+    if (!finished) {
+        return;
+    }
+
+    done_mask |= BOOT_DEP(id);
+    char buf[16];
+    boot_log_time(timer_elapsed_us(boot_start));
+    syslog_write(t->name);
+    syslog_write(" done, ");
+    itoa((int)t->busy_us, buf, 10);
+    syslog_write(buf);
+    syslog_write(" us in ");
+    itoa((int)t->steps, buf, 10);
+    syslog_write(buf);
+    syslog_write(" steps\n");
+    if (boot_complete()) {
+        boot_mark("boot complete");
+    }
+}
+
+// First unfinished task in mask from start on whose dependencies are done
+static int boot_ready(uint32_t mask, int start) {
+    for (int n = 0; n < task_count; n++) {
+        int i = (start + n) % task_count;
+        if ((mask & BOOT_DEP(i)) && !(done_mask & BOOT_DEP(i)) && (tasks[i].deps & ~done_mask) == 0) {
+            return i;
+        }
+    }
+    return BOOT_NONE;
+}
+
+void boot_poll(void) {
+    if (stepping || boot_complete()) {
+        return;
+    }
+    int id = boot_ready(0xFFFFFFFFu, next_task);
+    if (id != BOOT_NONE) {
+        next_task = (id + 1) % task_count;
+        boot_step(id);
+    }
+}
+
+void boot_wait(const char* name) {
+    int id = BOOT_NONE;
+    for (int i = 0; i < task_count; i++) {
+        if (boot_strcmp(tasks[i].name, name) == 0) {
+            id = i;
+        }
+    }
+    if (id == BOOT_NONE || stepping) {
+        return;
+    }
+
+    // The task and everything it depends on, directly or not
+    uint32_t need = BOOT_DEP(id);
+    for (int pass = 0; pass < task_count; pass++) {
+        for (int i = 0; i < task_count; i++) {
+            if (need & BOOT_DEP(i)) {
+                need |= tasks[i].deps;
+            }
+        }
+    }
+
+    while (!(done_mask & BOOT_DEP(id))) {
+        int next = boot_ready(need, 0);
+        if (next == BOOT_NONE) {
+            return;     // Depends on a task that was never added
+        }
+        boot_step(next);
+    }
+}
+
+bool boot_complete(void) {
+    return done_mask == BOOT_DEP(task_count) - 1;
+}
@@ -0,0 +1,38 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Boot work that the shell does not need goes into a dependency graph of
+// tasks. The scheduler tick runs one step of a ready task at a time, so the
+// tasks interleave with each other and with the shell. A step does a bounded
+// piece of work and returns true once its task is done.
+#define BOOT_MAX_TASKS 16
+#define BOOT_MAX_MARKS 16       // Timestamps kept until the log is up
+#define BOOT_NONE      -1
+
+#define BOOT_DEP(id) (1u << (id))
+
+typedef bool (*boot_step_t)(void);
+
+// Start the boot clock; needs a calibrated timer
+void boot_init(void);
+
+// Add a task that runs once every task in deps (BOOT_DEP masks) is done
+int boot_add(const char* name, boot_step_t step, uint32_t deps);
+
+// Run one step of the first ready task; called from the scheduler tick
+void boot_poll(void);
+
+// Run the named task and what it depends on to completion now, for callers
+// that need its result before the scheduler gets to it
+void boot_wait(const char* name);
+
+bool boot_complete(void);
+
+// Log "[boot <us> us] <phase>"; kept in memory until boot_log_ready()
+void boot_mark(const char* phase);
+void boot_log_ready(void);
+
+#endif // BOOT_H
@@ -3,6 +3,8 @@
 #include <core/arch/multiboot.h>
 #include <core/kernel/kstd.h>
 #include <core/kernel/mem.h>
+#include <core/kernel/paging.h>
+#include <core/arch/idt.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
 #include <core/drivers/serial.h>
@@ -10,16 +12,174 @@
 #include <core/drivers/timer.h>
 #include <core/drivers/keyboard.h>
 #include <core/drivers/cdrom.h>
+#include <core/drivers/block.h>
+#include <core/drivers/ramdisk.h>
+#include <core/drivers/ata.h>
 #include <core/kernel/shell.h>
 #include <core/kernel/syslog.h>
+#include <core/kernel/boot.h>
 #include <core/fs/ramfs.h>
 #include <core/fs/initramfs.h>
 #include <core/fs/iso9660.h>
+#include <core/fs/pagecache.h>
+#include <core/fs/diskfs.h>
 #include <usr/vfs.h>
 #include <usr/userspace_init.h>
 #include <stddef.h>
 #include <stdbool.h>
 
+extern uint8_t kernel_end[];
+
+// The heap has to start past the kernel image and every module GRUB loaded,
+// otherwise the first allocations land on top of code or the initramfs.
+static uintptr_t heap_start_address(multiboot_info_t* mb_info) {
+    uintptr_t start = (uintptr_t)kernel_end;
+
+    if (mb_info->flags & MULTIBOOT_FLAG_MODS) {
+        module_t* modules = (module_t*)mb_info->mods_addr;
+        for (uint32_t i = 0; i < mb_info->mods_count; i++) {
+            if (modules[i].mod_end > start) {
+                start = modules[i].mod_end;
+            }
+        }
+    }
+
+    return (start + 0xFFF) & ~(uintptr_t)0xFFF;
+}
+
+// Compare the VFS footprint with the same table using inline 4 KB data blocks
+static void vfs_report_memory(void) {
+    size_t table_bytes, data_bytes, backed_bytes;
+    vfs_memory_usage(&table_bytes, &data_bytes, &backed_bytes);
+
+    size_t used = table_bytes + data_bytes;
+    size_t inline_blocks = table_bytes + (size_t)MAX_FILES * 4096;
+
+    char buf[16];
+    syslog_print(":: VFS: ", 7);
+    itoa(vfs_count(), buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" entries in ", 7);
+    itoa(used / 1024, buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" KB (", 7);
+    itoa(data_bytes, buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" B of file data), ", 7);
+    itoa((inline_blocks - used) / 1024, buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" KB saved vs 4 KB blocks\n", 7);
+
+    pcache_stats_t stats;
+    pcache_get_stats(&stats);
+    syslog_print(":: Page cache: ", 7);
+    itoa(backed_bytes / 1024, buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" KB of files mapped in place, ", 7);
+    itoa(stats.frames, buf, 10);
+    syslog_print(buf, 7);
+    syslog_print(" frames allocated\n", 7);
+}
+
+// Boot tasks that run from the scheduler once the shell is up. The ISO and
+// initramfs only become reachable when their task is done; the shell waits
+// for them where it needs them.
+static multiboot_info_t* boot_info = NULL;
+static void* iso_location = NULL;
+static size_t iso_size = 0;
+static size_t autorun_next = 0;
+
+// Find the ISO among the multiboot modules by its "CD001" signature
+static bool boot_scan_modules(void) {
+    if (!(boot_info->flags & MULTIBOOT_FLAG_MODS) || boot_info->mods_count == 0) {
+        return true;
+    }
+    module_t* modules = (module_t*)boot_info->mods_addr;
+    syslog_write("Checking multiboot modules for ISO9660...\n");
+    
+    for (uint32_t i = 0; i < boot_info->mods_count; i++) {
+        uint32_t mod_start_addr = modules[i].mod_start;
+        uint32_t mod_end_addr = modules[i].mod_end;
+        
+        if (mod_start_addr == 0 || mod_end_addr == 0 || mod_end_addr <= mod_start_addr) {
+            continue;
+        }
+        
+        void* mod_start = (void*)mod_start_addr;
+        uint32_t mod_size = mod_end_addr - mod_start_addr;
+        
+        if (mod_size > 0x8005) {
+            char* sig = (char*)mod_start + 0x8001;
+            if (sig[0] == 'C' && sig[1] == 'D' && sig[2] == '0' && 
+                sig[3] == '0' && sig[4] == '1') {
+                iso_location = mod_start;
+                iso_size = mod_size;
+                syslog_print(":: Found ISO9660 in module ", 7);
+                char num[8];
+                itoa(i, num, 10);
+                syslog_write(num);
+                syslog_write("\n");
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+static bool boot_cdrom(void) {
+    cdrom_init();
+    return true;
+}
+
+static bool boot_mount_iso(void) {
+    if (iso_location) {
+        cdrom_set_iso_data(iso_location, iso_size);
+        iso9660_init(iso_location, iso_size);
+        syslog_write("ISO9660 filesystem mounted\n");
+
+        iso9660_mount_to_vfs("/bin", "/");
+        syslog_write("ISO contents mounted to /bin/\n");
+    } else if (cdrom_present()) {
+        // No copy in memory: read the disc in the drive on demand
+        iso9660_init_cdrom();
+        if (iso9660_is_initialized()) {
+            syslog_write("ISO9660 filesystem mounted from the CD-ROM drive\n");
+            iso9660_mount_to_vfs("/bin", "/");
+        } else {
+            syslog_print(":: ISO9660 filesystem not found\n", 14);
+        }
+    } else {
+        syslog_print(":: ISO9660 filesystem not found\n", 14);
+    }
+    return true;
+}
+
+static bool boot_load_initramfs(void) {
+    initramfs_load(boot_info);
+    syslog_write("Initramfs loaded\n");
+    if (initramfs_get_count() == 0) {
+        syslog_print(":: No programs found in initramfs\n", 14);
+    }
+    return true;
+}
+
+// One program per step
+static bool boot_autorun(void) {
+    if (autorun_next < initramfs_get_count()) {
+        struct program* prog = initramfs_get_program(autorun_next);
+        if (prog->size > 0 && (prog->entry->flags & INITRAMFS_FLAG_BOOT)) {
+            initramfs_execute(autorun_next);
+        }
+        autorun_next++;
+    }
+    return autorun_next >= initramfs_get_count();
+}
+
+static bool boot_report(void) {
+    vfs_report_memory();
+    return true;
+}
+
 void kmain(multiboot_info_t* mb_info) {
     enable_cursor();
 
@@ -42,13 +202,34 @@ void kmain(multiboot_info_t* mb_info) {
     kprint(":: Initializing memory manager...\n", 7);
 
     uint32_t available_memory = mb_info->mem_upper * 1024;
-    initializeMemoryManager((void*)0x100000, available_memory);
+    uintptr_t heap_start = heap_start_address(mb_info);
+    uintptr_t heap_end = 0x100000 + available_memory;
+    // RAM above the NVM data window is not identity mapped once paging is on
+    if (heap_end > VM_WINDOW_BASE) {
+        heap_end = VM_WINDOW_BASE;
+    }
+    initializeMemoryManager((void*)heap_start, heap_end - heap_start);
+    idt_init();
+    paging_init();
+    pcache_init();
 
     init_serial();
     pit_init();
+    boot_init();
+    boot_mark("memory, paging and timer");
     ramfs_init();
     vfs_init();
+
+    // The disk goes in before the log so it can carry on from the last boot
+    block_init();
+    if (ata_init() && diskfs_init("hd0")) {
+        diskfs_mount("/home", "home");
+        diskfs_mount("/var/log", "log");
+        kprint(":: Disk mounted at /home and /var/log\n", 7);
+    }
+    boot_mark("filesystems and disk");
     syslog_init();
+    boot_log_ready();
     
     char buf[16];
     char mem_msg[64];
@@ -70,96 +251,28 @@ void kmain(multiboot_info_t* mb_info) {
     
     syslog_write("System initialization started\n");
     
-    cdrom_init();
-    
-    void* iso_location = NULL;
-    size_t iso_size = 0;
-    
-    // Check multiboot modules for ISO9660
-    if (mb_info->flags & MULTIBOOT_FLAG_MODS && mb_info->mods_count > 0) {
-        module_t* modules = (module_t*)mb_info->mods_addr;
-        syslog_write("Checking multiboot modules for ISO9660...\n");
-        
-        for (uint32_t i = 0; i < mb_info->mods_count; i++) {
-            uint32_t mod_start_addr = modules[i].mod_start;
-            uint32_t mod_end_addr = modules[i].mod_end;
-            
-            if (mod_start_addr == 0 || mod_end_addr == 0 || mod_end_addr <= mod_start_addr) {
-                continue;
-            }
-            
-            void* mod_start = (void*)mod_start_addr;
-            uint32_t mod_size = mod_end_addr - mod_start_addr;
-            
-            if (mod_size > 0x8005) {
-                char* sig = (char*)mod_start + 0x8001;
-                if (sig[0] == 'C' && sig[1] == 'D' && sig[2] == '0' && 
-                    sig[3] == '0' && sig[4] == '1') {
-                    iso_location = mod_start;
-                    iso_size = mod_size;
-                    syslog_print(":: Found ISO9660 in module ", 7);
-                    char num[8];
-                    itoa(i, num, 10);
-                    syslog_write(num);
-                    syslog_write("\n");
-                    break;
-                }
-            }
-        }
+    if (!ramdisk_init(RAMDISK_SECTORS)) {
+        syslog_print(":: RAM disk allocation failed\n", 14);
     }
-    
-    if (iso_location) {
-        cdrom_set_iso_data(iso_location, iso_size);
-        iso9660_init(iso_location, iso_size);
-        syslog_write("ISO9660 filesystem mounted\n");
-
-        iso9660_mount_to_vfs("/bin", "/");
-        syslog_write("ISO contents mounted to /bin/\n");
-    } else {
-        syslog_print(":: ISO9660 filesystem not found\n", 14);
-    }
-    
-    initramfs_load(mb_info);
-    syslog_write("Initramfs loaded\n");
     nvm_init();
     syslog_write("NVM initialized\n");
     userspace_init_programs();
     syslog_write("Userspace programs registered\n");
-    size_t program_count = initramfs_get_count();
-    if (program_count > 0) {
-        for (size_t i = 0; i < program_count; i++) {
-            struct program* prog = initramfs_get_program(i);
-            if (prog && prog->size > 0) {
-                char buf[32];
-                int n = i;
-                char* p = buf;
-                if (n == 0) {
-                    *p++ = '0';
-                } else {
-                    char* start = p;
-                    while (n > 0) {
-                        *p++ = '0' + n % 10;
-                        n /= 10;
-                    }
-                    p--;
-                    while (start < p) {
-                        char temp = *start;
-                        *start = *p;
-                        *p = temp;
-                        start++;
-                        p--;
-                    }
-                }
-                *p = '\0';
-                
-                nvm_execute((uint8_t*)prog->data, prog->size, (uint16_t[]){CAP_ALL}, 1);
-            }
-        }
-    } else {
-        syslog_print(":: No programs found in initramfs\n", 14);
-    }
+
+    // Everything below is independent of the shell. Probing the CD-ROM and
+    // scanning modules overlap; the ISO mount needs both, the autorun and
+    // checksum pass need the initramfs index.
+    boot_info = mb_info;
+    int modules = boot_add("modules", boot_scan_modules, 0);
+    int cdrom = boot_add("cdrom", boot_cdrom, 0);
+    int initramfs = boot_add("initramfs", boot_load_initramfs, 0);
+    int iso = boot_add("iso", boot_mount_iso, BOOT_DEP(modules) | BOOT_DEP(cdrom));
+    boot_add("autorun", boot_autorun, BOOT_DEP(initramfs));
+    boot_add("verify", initramfs_verify_step, BOOT_DEP(initramfs));
+    boot_add("report", boot_report, BOOT_DEP(iso) | BOOT_DEP(initramfs));
     
     syslog_write("System initialization complete\n");
+    boot_mark("shell ready");
     shell_init();
     shell_run();
     
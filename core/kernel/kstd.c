@@ -30,6 +30,19 @@ char* strncpy(char *dest, const char *src, unsigned int n) {
     return dest;
 }
 
+// 64-by-32 division without libgcc: two divl steps, saturating on overflow
+uint32_t udiv64_32(uint64_t num, uint32_t den) {
+    uint32_t hi = (uint32_t)(num >> 32);
+    uint32_t lo = (uint32_t)num;
+    uint32_t quot, rem;
+
+    if (den == 0 || hi >= den) {
+        return 0xFFFFFFFF;
+    }
+
+    asm volatile ("divl %4" : "=a"(quot), "=d"(rem) : "a"(lo), "d"(hi), "rm"(den));
+    return quot;
+}
 
 char* itoa(int num, char* str, int base) {
     int i = 0;
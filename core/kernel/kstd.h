@@ -2,10 +2,12 @@
 #define _KSTD_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 void reverse(char* str, int length);
 char* itoa(int num, char* str, int base);
 void kprint(const char *str, int color);
 char* strncpy(char *dest, const char *src, unsigned int n);
+uint32_t udiv64_32(uint64_t num, uint32_t den);
 
 #endif // _KSTD_H
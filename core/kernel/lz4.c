@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/lz4.h>
+
+#define LZ4_LAST_LITERALS 5     // The block ends with at least this many literals
+#define LZ4_MATCH_LIMIT   12    // No match starts closer than this to the end
+#define LZ4_HASH_BITS     12
+#define LZ4_MAX_OFFSET    65535
+
+static uint32_t lz4_table[1 << LZ4_HASH_BITS];
+
+static uint32_t lz4_read32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t lz4_hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// Length fields past 15 continue in bytes of 255 and a final smaller one
+static int lz4_read_length(const uint8_t** ip, const uint8_t* iend, size_t* len) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *len += b;
+    } while (b == 255);
+    return 0;
+}
+
+int lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_size;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t len = token >> 4;
+        if (len == 15 && lz4_read_length(&ip, iend, &len) < 0) {
+            return -1;
+        }
+        if (len > (size_t)(iend - ip) || len > (size_t)(oend - op)) {
+            return -1;
+        }
+        for (size_t i = 0; i < len; i++) {
+            op[i] = ip[i];
+        }
+        ip += len;
+        op += len;
+        if (ip == iend) {
+            break;      // Last sequence has no match
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+
+        len = token & 15;
+        if (len == 15 && lz4_read_length(&ip, iend, &len) < 0) {
+            return -1;
+        }
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t)(oend - op)) {
+            return -1;
+        }
+        // Byte by byte: the match may overlap the bytes it produces
+        const uint8_t* match = op - offset;
+        for (size_t i = 0; i < len; i++) {
+            op[i] = match[i];
+        }
+        op += len;
+    }
+    return (int)(op - dst);
+}
+
+static uint8_t* lz4_write_length(uint8_t* op, size_t len) {
+    while (len >= 255) {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (uint8_t)len;
+    return op;
+}
+
+// One sequence: literals, then a match unless match_len is 0 (the last one)
+static uint8_t* lz4_emit(uint8_t* op, const uint8_t* literals, size_t lit_len, size_t offset, size_t match_len) {
+    uint8_t* token = op++;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4);
+    if (lit_len >= 15) {
+        op = lz4_write_length(op, lit_len - 15);
+    }
+    for (size_t i = 0; i < lit_len; i++) {
+        *op++ = literals[i];
+    }
+    if (match_len == 0) {
+        return op;
+    }
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t len = match_len - LZ4_MIN_MATCH;
+    *token |= (uint8_t)(len >= 15 ? 15 : len);
+    if (len >= 15) {
+        op = lz4_write_length(op, len - 15);
+    }
+    return op;
+}
+
+int lz4_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size) {
+    if (dst_size < LZ4_BOUND(src_size)) {
+        return -1;
+    }
+    for (int i = 0; i < (1 << LZ4_HASH_BITS); i++) {
+        lz4_table[i] = 0;
+    }
+
+    uint8_t* op = dst;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + LZ4_MATCH_LIMIT <= src_size) {
+        uint32_t seq = lz4_read32(src + pos);
+        uint32_t h = lz4_hash(seq);
+        size_t candidate = lz4_table[h];     // Position + 1, 0 if empty
+        lz4_table[h] = (uint32_t)pos + 1;
+
+        if (candidate == 0 || pos - (candidate - 1) > LZ4_MAX_OFFSET || lz4_read32(src + candidate - 1) != seq) {
+            pos++;
+            continue;
+        }
+        size_t ref = candidate - 1;
+        size_t len = LZ4_MIN_MATCH;
+        while (pos + len < src_size - LZ4_LAST_LITERALS && src[ref + len] == src[pos + len]) {
+            len++;
+        }
+        op = lz4_emit(op, src + anchor, pos - anchor, pos - ref, len);
+        pos += len;
+        anchor = pos;
+    }
+    op = lz4_emit(op, src + anchor, src_size - anchor, 0, 0);
+    return (int)(op - dst);
+}
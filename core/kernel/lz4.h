@@ -0,0 +1,21 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// LZ4 block format: sequences of a token, literals, a 16-bit back offset and
+// a match length, ending with a literals-only sequence.
+#define LZ4_MIN_MATCH 4
+
+// Worst-case compressed size of n bytes
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Decode one block in a single forward pass over src; returns the number of
+// bytes written or -1 if the block is malformed or does not fit dst_size.
+int lz4_decompress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+// Greedy compressor; returns the compressed size or -1 if dst is too small
+int lz4_compress(const uint8_t* src, size_t src_size, uint8_t* dst, size_t dst_size);
+
+#endif // LZ4_H
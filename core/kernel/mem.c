@@ -99,6 +99,25 @@ void initializeMemoryManager(void* memoryPool, size_t poolSize) {
     kprint(")\n", 7);
 }
 
+// First address past the heap; nothing at or above it belongs to the kernel
+uintptr_t mm_pool_end(void) {
+    return (uintptr_t)poolStart + poolSizeTotal;
+}
+
+void mm_get_stats(mm_stats_t* stats) {
+    stats->total = poolSizeTotal;
+    stats->free = 0;
+    stats->largest_free = 0;
+    stats->free_blocks = 0;
+    for (MemoryBlock* curr = freeList; curr; curr = curr->next) {
+        stats->free += curr->size;
+        if (curr->size > stats->largest_free) {
+            stats->largest_free = curr->size;
+        }
+        stats->free_blocks++;
+    }
+}
+
 void* allocateMemory(size_t size) {
     if (size == 0 || size > poolSizeTotal - sizeof(MemoryBlock)) {
         return NULL;
@@ -2,17 +2,27 @@
 #define MEM_H
 
 #include <stddef.h>
+#include <stdint.h>
 #include <core/arch/multiboot.h>
 #include <core/arch/pause.h>
 #include <core/kernel/kstd.h>
 #include <core/drivers/serial.h>
 
 extern void initializeMemoryManager(void* memoryPool, size_t size);
+typedef struct {
+    size_t total;           // Pool size, headers included
+    size_t free;            // Bytes available to allocations
+    size_t largest_free;    // Largest single allocation that would succeed
+    uint32_t free_blocks;
+} mm_stats_t;
+
 extern void* memcpy(void* dest, const void* src, size_t n);
 extern void* memset(void* s, int c, size_t n);
 extern void* allocateMemory(size_t size);
 extern void freeMemory(void* ptr);
 extern void mm_test();
+extern uintptr_t mm_pool_end(void);
+extern void mm_get_stats(mm_stats_t* stats);
 extern void pause();
 
 // Aliases for convenience
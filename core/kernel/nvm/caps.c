@@ -6,39 +6,55 @@
 
 bool caps_has_capability(nvm_process_t* proc, uint16_t cap) {
     if (!proc) return false;
-    
-    for (int i = 0; i < proc->caps_count; i++) {
-        if (proc->capabilities[i] == CAP_ALL) return true;
-    }
-    
-    // Check specific capability
+
+    uint32_t bit = CAPS_BIT(cap);
+    if (proc->caps_mask & (CAPS_BIT_ALL | bit)) return true;
+    if (bit) return false;
+
+    // Extended caps are rare; the overflow table is usually empty
     for (int i = 0; i < proc->caps_count; i++) {
         if (proc->capabilities[i] == cap) return true;
     }
-    
+
     return false;
 }
 
 bool caps_add_capability(nvm_process_t* proc, uint16_t cap) {
-    if (!proc || proc->caps_count >= MAX_CAPS) return false;
-    
+    if (!proc) return false;
+
+    uint32_t bit = CAPS_BIT(cap);
+    if (bit) {
+        proc->caps_mask |= bit;
+        proc->memop_mode = NVM_MEMOP_UNVERIFIED;
+        return true;
+    }
+
     // We check whether such a capability already exists.
-    if (caps_has_capability(proc, cap)) return true;
-    
+    for (int i = 0; i < proc->caps_count; i++) {
+        if (proc->capabilities[i] == cap) return true;
+    }
+
+    if (proc->caps_count >= MAX_CAPS) return false;
+
     proc->capabilities[proc->caps_count++] = cap;
     return true;
 }
 
 bool caps_remove_capability(nvm_process_t* proc, uint16_t cap) {
     if (!proc) return false;
-    
+
+    uint32_t bit = CAPS_BIT(cap);
+    if (bit) {
+        bool had = (proc->caps_mask & bit) != 0;
+        proc->caps_mask &= ~bit;
+        proc->memop_mode = NVM_MEMOP_UNVERIFIED;
+        return had;
+    }
+
     for (int i = 0; i < proc->caps_count; i++) {
         if (proc->capabilities[i] == cap) {
-            // move the remaining elements
-            for (int j = i; j < proc->caps_count - 1; j++) {
-                proc->capabilities[j] = proc->capabilities[j + 1];
-            }
-            proc->caps_count--;
+            // Order does not matter, move the last entry into the hole
+            proc->capabilities[i] = proc->capabilities[--proc->caps_count];
             return true;
         }
     }
@@ -47,16 +63,20 @@ bool caps_remove_capability(nvm_process_t* proc, uint16_t cap) {
 
 void caps_clear_all(nvm_process_t* proc) {
     if (proc) {
+        proc->caps_mask = 0;
         proc->caps_count = 0;
+        proc->memop_mode = NVM_MEMOP_UNVERIFIED;
     }
 }
 
 bool caps_copy(nvm_process_t* dest, nvm_process_t* src) {
     if (!dest || !src) return false;
-    
+
+    dest->caps_mask = src->caps_mask;
+    dest->memop_mode = NVM_MEMOP_UNVERIFIED;
     dest->caps_count = src->caps_count;
     for (int i = 0; i < src->caps_count; i++) {
         dest->capabilities[i] = src->capabilities[i];
     }
     return true;
-}
\ No newline at end of file
+}
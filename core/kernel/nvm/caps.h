@@ -1,8 +1,9 @@
-#ifndef CAPS_H 
-#define CAPS_h
+#ifndef CAPS_H
+#define CAPS_H
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <core/kernel/nvm/nvm.h>
 
 // CAPS definitions
 #define CAPS_NONE             0x0000
@@ -17,8 +18,19 @@
 #define CAP_DRV_GROUP_VIDEO   0x0200
 #define CAP_DRV_GROUP_AUDIO   0x0300
 #define CAP_DRV_GROUP_NETWORK 0x0400
+#define CAP_SHM_BASE          0x0800
+#define CAP_SHM(id)           (CAP_SHM_BASE + (id))
 #define CAP_ALL               0xFFFF
 
+// Built-in caps are bits in nvm_process_t.caps_mask: CAP_FS_READ..CAP_CAPS_MGMT
+// use bits 1-7, the driver groups bits 8-11 and CAP_ALL bit 31. Any other
+// cap (e.g. CAP_SHM) lives in the small capabilities[] overflow table.
+#define CAPS_BIT_ALL          0x80000000u
+#define CAPS_BIT(cap)         ((cap) == CAP_ALL ? CAPS_BIT_ALL : \
+                               (cap) >= CAP_FS_READ && (cap) <= CAP_CAPS_MGMT ? (1u << (cap)) : \
+                               ((cap) & 0xFF) == 0 && (cap) >= CAP_DRV_GROUP_STORAGE && (cap) <= CAP_DRV_GROUP_NETWORK ? \
+                               (1u << (7 + ((cap) >> 8))) : 0)
+
 // CAPS management functions
 bool caps_has_capability(nvm_process_t* proc, uint16_t cap);
 bool caps_add_capability(nvm_process_t* proc, uint16_t cap);
@@ -1,17 +1,30 @@
 // SPDX-License-Identifier: LGPL-3.0-or-later
 
+#include <stddef.h>
 #include <core/kernel/nvm/syscall.h>
 #include <core/kernel/kstd.h>
 #include <core/kernel/log.h>
 #include <core/drivers/serial.h>
+#include <core/drivers/block.h>
+#include <core/fs/diskfs.h>
+#include <core/kernel/boot.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
+#include <core/kernel/nvm/wait.h>
+#include <core/kernel/nvm/shm.h>
+#include <core/kernel/mem.h>
 
 nvm_process_t processes[MAX_PROCESSES];
 uint8_t current_process = 0;
 uint32_t timer_ticks = 0;
 
+// Pending direct switch requested by a synchronous IPC syscall
+#define NVM_NO_SWITCH 0xFFFF
+static uint16_t switch_target = NVM_NO_SWITCH;
+
 int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc);
+void ipc_process_exited(nvm_process_t* proc);
+void fd_process_exited(nvm_process_t* proc);
 
 void nvm_init() {
     for(int i = 0; i < MAX_PROCESSES; i++) {
@@ -19,7 +32,10 @@ void nvm_init() {
         processes[i].sp = 0;
         processes[i].ip = 0;
         processes[i].exit_code = 0;
+        processes[i].caps_mask = 0;
         processes[i].caps_count = 0;
+        processes[i].zombie = false;
+        processes[i].wait_mask = 0;
     }
 
     kprint(":: NVM initialized\n", 7);
@@ -34,7 +50,7 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
     }
     
     for(int i = 0; i < MAX_PROCESSES; i++) {
-        if(!processes[i].active) {
+        if(!processes[i].active && !processes[i].zombie) {
             processes[i].bytecode = bytecode;
             processes[i].ip = 4;
             processes[i].size = size;
@@ -42,13 +58,33 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
             processes[i].active = true;
             processes[i].exit_code = 0;
             processes[i].pid = i;
-            processes[i].caps_count = 0;
+            processes[i].blocked = false;
+            processes[i].wakeup_reason = 0;
+            processes[i].ipc_state = IPC_NONE;
+            processes[i].slice_left = 0;
+            processes[i].wait_mask = 0;
+            processes[i].parent = NVM_NO_PARENT;
+            processes[i].waiting_child = false;
+            processes[i].image = NULL;
+            processes[i].space = NULL;
+            processes[i].data_size = 0;
+
+            for(int j = 0; j < NVM_MAX_FDS; j++) {
+                processes[i].fds[j] = -1;
+            }
+
+            for(int j = 0; j < NVM_SHM_SLOTS; j++) {
+                processes[i].shm[j].base = NULL;
+                processes[i].shm[j].size = 0;
+                processes[i].shm[j].id = -1;
+            }
 
             // Initializing capabilities
-            for(int j = 0; j < caps_count && j < MAX_CAPS; j++) {
-                processes[i].capabilities[j] = initial_caps[j];
+            caps_clear_all(&processes[i]);
+            for(int j = 0; j < caps_count; j++) {
+                caps_add_capability(&processes[i], initial_caps[j]);
             }
-            processes[i].caps_count = caps_count;
+            nvm_specialize(&processes[i]);
             
             for(int j = 0; j < MAX_LOCALS; j++) {
                 processes[i].locals[j] = 0;
@@ -62,6 +98,162 @@ int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[]
     return -1;
 }
 
+// Bookkeeping once a process has stopped running
+static void nvm_process_exited(nvm_process_t* proc) {
+    ipc_process_exited(proc);
+    wait_cancel(proc);
+    shm_process_exited(proc);
+    fd_process_exited(proc);
+
+    if (proc->space) {
+        vm_space_destroy(proc->space);
+        proc->space = NULL;
+        proc->data_size = 0;
+    }
+
+    if (proc->image) {
+        kfree(proc->image);
+        proc->image = NULL;
+        proc->bytecode = NULL;
+        proc->size = 0;
+    }
+
+    // Orphans are not collected by anyone; free their slots right away
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (processes[i].parent == proc->pid && (processes[i].active || processes[i].zombie)) {
+            processes[i].parent = NVM_NO_PARENT;
+            processes[i].zombie = false;
+        }
+    }
+
+    if (proc->parent != NVM_NO_PARENT) {
+        nvm_process_t* parent = &processes[proc->parent];
+        proc->zombie = true;
+
+        if (parent->waiting_child) {
+            // SYS_WAIT restarts and collects the exit code
+            parent->waiting_child = false;
+            parent->blocked = false;
+        } else {
+            wait_notify(parent, WAIT_CHILD);
+        }
+    }
+}
+
+// Start a child of parent; argv and argc are pushed onto the child's stack.
+// With caps == NULL the child inherits all of the parent's caps.
+int nvm_spawn(nvm_process_t* parent, uint8_t* bytecode, uint32_t size, bool owned,
+              uint16_t* caps, uint8_t caps_count, int32_t* argv, uint32_t argc) {
+    if (size < 4 || argc > NVM_MAX_ARGS) {
+        return -1;
+    }
+
+    int pid = nvm_create_process(bytecode, size, caps, caps_count);
+    if (pid < 0) {
+        return -1;
+    }
+
+    nvm_process_t* child = &processes[pid];
+    child->parent = parent ? parent->pid : NVM_NO_PARENT;
+    child->image = owned ? bytecode : NULL;
+    if (!caps && parent) {
+        caps_copy(child, parent);
+    }
+
+    for (uint32_t i = 0; i < argc; i++) {
+        child->stack[child->sp++] = argv[i];
+    }
+    child->stack[child->sp++] = argc;
+
+    return pid;
+}
+
+// Collect an exited child (pid, or -1 for any). Returns the child PID,
+// -2 if a matching child is still running, or -1 if there is none.
+int32_t nvm_reap(nvm_process_t* parent, int32_t pid, int32_t* exit_code) {
+    bool running = false;
+
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        nvm_process_t* child = &processes[i];
+
+        if (child->parent != parent->pid || (pid >= 0 && i != pid)) {
+            continue;
+        }
+
+        if (child->zombie) {
+            *exit_code = child->exit_code;
+            child->zombie = false;
+            child->parent = NVM_NO_PARENT;
+            return i;
+        }
+
+        if (child->active) {
+            running = true;
+        }
+    }
+
+    return running ? -2 : -1;
+}
+
+// Called from the page fault handler when LOAD_MEM/STORE_MEM go past data_size,
+// and directly for offsets that would leave the window
+static void nvm_data_fault(void* owner) {
+    nvm_process_t* proc = (nvm_process_t*)owner;
+
+    LOG_WARN("Procces %d: Offset out of data segment\n", proc->pid);
+    proc->exit_code = -1;
+    proc->active = false;
+}
+
+// Grow the data segment to size bytes (rounded up to pages, so every access
+// past it faults). Pages are only allocated, zeroed, when first touched.
+// Returns the new size or -1.
+int32_t nvm_mem_grow(nvm_process_t* proc, uint32_t size) {
+    if (size > NVM_DATA_MAX) {
+        return -1;
+    }
+    size = (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    if (size <= proc->data_size) {
+        return proc->data_size;
+    }
+
+    if (!proc->space) {
+        proc->space = vm_space_create(proc, nvm_data_fault);
+        if (!proc->space) {
+            return -1;
+        }
+    }
+
+    proc->space->limit = size;
+    proc->data_size = size;
+    return size;
+}
+
+// Any byte of the word at addr falls in [base, base + size)
+static bool nvm_abs_overlaps(uint32_t addr, uint32_t base, uint32_t size) {
+    return addr > base - sizeof(int32_t) && addr < base + size;
+}
+
+// LOAD_ABS/STORE_ABS only reach devices: the VGA text buffer and MMIO above
+// RAM. Kernel image, modules and heap are never addressable, neither
+// directly nor through the high alias of low memory, and neither is the
+// data window.
+static bool nvm_abs_allowed(uint32_t addr) {
+    if (nvm_abs_overlaps(addr, KERNEL_HIGH_BASE, KERNEL_HIGH_SIZE) ||
+        nvm_abs_overlaps(addr, VM_WINDOW_BASE, VM_WINDOW_SIZE)) {
+        return false;
+    }
+    return (addr >= 0xB8000 && addr <= 0xB8FA0) ||
+           (addr >= mm_pool_end() && addr <= 0xFFFFFFFC);
+}
+
+// Decide once how LOAD_ABS/STORE_ABS run for the current caps. Caps changes
+// reset the mode to NVM_MEMOP_UNVERIFIED, which lands here again.
+uint8_t nvm_specialize(nvm_process_t* proc) {
+    proc->memop_mode = caps_has_capability(proc, CAP_DRV_ACCESS) ? NVM_MEMOP_FAST : NVM_MEMOP_TRAP;
+    return proc->memop_mode;
+}
+
 // Execute one instruction
 bool nvm_execute_instruction(nvm_process_t* proc) {
     if(proc->ip >= proc->size) {
@@ -533,10 +725,70 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
             }
             break;
 
+        // Data segment access:
+        case 0x42: // LOAD_MEM - load from offset in the process data segment
+            // The window is paged: offsets past data_size fault and terminate the
+            // process. Only offsets that would leave the window are checked here.
+            if(proc->sp > 0) {
+                uint32_t offset = (uint32_t)proc->stack[proc->sp - 1];
+
+                if(proc->space) {
+                    if (offset > VM_WINDOW_SIZE - sizeof(int32_t)) {
+                        nvm_data_fault(proc);
+                        return false;
+                    }
+                    int32_t value = *(volatile int32_t*)(VM_WINDOW_BASE + offset);
+                    if (!proc->active) {
+                        return false;
+                    }
+                    proc->stack[proc->sp - 1] = value;
+                } else {
+                    LOG_WARN("Procces %d: No data segment in LOAD_MEM\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Procces %d: Stack underflow in LOAD_MEM\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x43: // STORE_MEM - store to offset in the process data segment
+            if(proc->sp >= 2) {
+                uint32_t offset = (uint32_t)proc->stack[proc->sp - 2];
+
+                if(proc->space) {
+                    if (offset > VM_WINDOW_SIZE - sizeof(int32_t)) {
+                        nvm_data_fault(proc);
+                        return false;
+                    }
+                    *(volatile int32_t*)(VM_WINDOW_BASE + offset) = proc->stack[proc->sp - 1];
+                    if (!proc->active) {
+                        return false;
+                    }
+                    proc->sp -= 2;
+                } else {
+                    LOG_WARN("Procces %d: No data segment in STORE_MEM\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Procces %d: Stack underflow in STORE_MEM\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
         // Memory absolute access:
         case 0x44: // LOAD_ABS - load from absolute memory address
-            if (!caps_has_capability(proc, CAP_DRV_ACCESS)) {
-                LOG_WARN("Procces %d: Required caps not receivedn\n", proc->pid);
+            if (proc->memop_mode != NVM_MEMOP_FAST &&
+                (proc->memop_mode == NVM_MEMOP_TRAP || nvm_specialize(proc) == NVM_MEMOP_TRAP)) {
+                LOG_WARN("Procces %d: Required caps not received\n", proc->pid);
                 proc->exit_code = -1;
                 proc->active = false;
                 return false;
@@ -545,8 +797,7 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
             if(proc->sp > 0) {
                 uint32_t addr = (uint32_t)proc->stack[proc->sp - 1]; // get address from stack
 
-                if((addr >= 0x100000 && addr < 0xFFFFFFFF) || 
-                (addr >= 0xB8000 && addr <= 0xB8FA0)) {
+                if(nvm_abs_allowed(addr)) {
                     int32_t value = *(int32_t*)addr;
                     proc->stack[proc->sp - 1] = value;
 
@@ -574,8 +825,9 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
             break;
 
         case 0x45: // STORE_ABS - store to absolute memory address
-            if (!caps_has_capability(proc, CAP_DRV_ACCESS)) {
-                LOG_WARN("Procces %d: Required caps not receivedn\n", proc->pid);
+            if (proc->memop_mode != NVM_MEMOP_FAST &&
+                (proc->memop_mode == NVM_MEMOP_TRAP || nvm_specialize(proc) == NVM_MEMOP_TRAP)) {
+                LOG_WARN("Procces %d: Required caps not received\n", proc->pid);
                 proc->exit_code = -1;
                 proc->active = false;
                 return false;
@@ -585,8 +837,7 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
                 uint32_t addr = (uint32_t)proc->stack[proc->sp - 2]; // address
                 int32_t value = proc->stack[proc->sp - 1]; // value
 
-                if((addr >= 0x100000 && addr < 0xFFFFFFFF) || 
-                (addr >= 0xB8000 && addr <= 0xB8FA0)) {
+                if(nvm_abs_allowed(addr)) {
                     // Special handling for VGA text buffer - write only 16 bits (char + attribute)
                     if (addr >= 0xB8000 && addr <= 0xB8FA0) {
                         *(uint16_t*)addr = (uint16_t)(value & 0xFFFF);
@@ -621,6 +872,53 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
             }
             break;
 
+        // Shared memory windows:
+        case 0x46: // LOAD_SHM - load from offset in a mapped shared memory window
+            if(proc->ip < proc->size && proc->sp > 0) {
+                uint8_t slot = proc->bytecode[proc->ip++];
+                uint32_t offset = (uint32_t)proc->stack[proc->sp - 1];
+
+                if(slot < NVM_SHM_SLOTS && proc->shm[slot].base &&
+                   offset <= proc->shm[slot].size - sizeof(int32_t)) {
+                    proc->stack[proc->sp - 1] = *(int32_t*)(proc->shm[slot].base + offset);
+                } else {
+                    LOG_WARN("Procces %d: Invalid shared memory access in LOAD_SHM\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Procces %d: Stack underflow in LOAD_SHM\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
+        case 0x47: // STORE_SHM - store to offset in a mapped shared memory window
+            if(proc->ip < proc->size && proc->sp >= 2) {
+                uint8_t slot = proc->bytecode[proc->ip++];
+                uint32_t offset = (uint32_t)proc->stack[proc->sp - 2];
+                int32_t value = proc->stack[proc->sp - 1];
+
+                if(slot < NVM_SHM_SLOTS && proc->shm[slot].base &&
+                   offset <= proc->shm[slot].size - sizeof(int32_t)) {
+                    *(int32_t*)(proc->shm[slot].base + offset) = value;
+                    proc->sp -= 2;
+                } else {
+                    LOG_WARN("Procces %d: Invalid shared memory access in STORE_SHM\n", proc->pid);
+                    proc->exit_code = -1;
+                    proc->active = false;
+                    return false;
+                }
+            } else {
+                LOG_WARN("Procces %d: Stack underflow in STORE_SHM\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                return false;
+            }
+            break;
+
         // System calls:
         case 0x51: // BREAK
             LOG_DEBUG("Procces %d: Stop from BREAK\n", proc->pid);
@@ -652,9 +950,31 @@ bool nvm_execute_instruction(nvm_process_t* proc) {
     return true;
 }
 
+// Instructions left after a direct switch from proc. A call runs the server
+// on a fresh slice and keeps the client's remainder, which the reply hands
+// back, so a round trip never waits for the round robin whatever else is
+// runnable.
+static int nvm_switch_budget(nvm_process_t* proc, int left) {
+    nvm_process_t* target = &processes[switch_target];
+
+    if (proc->ipc_state == IPC_CALL_WAIT && proc->ipc_partner == switch_target) {
+        proc->slice_left = left;
+        return NVM_SLICE_INSTRUCTIONS;
+    }
+    if (target->slice_left) {
+        left = target->slice_left;
+        target->slice_left = 0;
+    }
+    return left;
+}
+
 // Round Robin task manager
 void nvm_scheduler_tick() {
     timer_ticks++;
+    wait_poll();
+    block_poll();
+    diskfs_poll();
+    boot_poll();
     if(timer_ticks % TIME_SLICE_MS != 0) {
         return;
     }
@@ -670,23 +990,43 @@ void nvm_scheduler_tick() {
     } while(current_process != start);
     
     if(processes[current_process].active && !processes[current_process].blocked) {
+        // A slice kept from an earlier call is stale once the round robin
+        // comes back around
+        processes[current_process].slice_left = 0;
+
         // Execute multiple instructions per tick for better performance
-        for(int i = 0; i < 100; i++) {
-            if (processes[current_process].ip < processes[current_process].size && 
-                processes[current_process].active && 
-                !processes[current_process].blocked) {
-                if(!nvm_execute_instruction(&processes[current_process])) {
+        int budget = NVM_SLICE_INSTRUCTIONS;
+        while (budget-- > 0) {
+            nvm_process_t* proc = &processes[current_process];
+
+            if (proc->ip < proc->size && proc->active && !proc->blocked) {
+                vm_activate(proc->space);
+                bool running = nvm_execute_instruction(proc);
+
+                if (!proc->active) {
+                    nvm_process_exited(proc);
+                }
+
+                // Call/reply switches straight to the partner
+                if (switch_target != NVM_NO_SWITCH) {
+                    budget = nvm_switch_budget(proc, budget);
+                    current_process = switch_target;
+                    switch_target = NVM_NO_SWITCH;
+                    continue;
+                }
+
+                if(!running) {
                     break; // Stop if instruction returns false (halt, error, etc)
                 }
             } else {
-                if(processes[current_process].ip >= processes[current_process].size && 
-                   processes[current_process].active) {
+                if(proc->ip >= proc->size && proc->active) {
                     char buffer[32];
-                    itoa(processes[current_process].pid, buffer, 10);
+                    itoa(proc->pid, buffer, 10);
 
                     LOG_WARN("Procces %s: Reached end of code - terminating\n", buffer);
-                    processes[current_process].active = false;
-                    processes[current_process].exit_code = 0;
+                    proc->active = false;
+                    proc->exit_code = 0;
+                    nvm_process_exited(proc);
                 }
                 break;
             }
@@ -696,6 +1036,13 @@ void nvm_scheduler_tick() {
     }
 }
 
+// Request a direct switch to pid after the current instruction
+void nvm_switch_to(uint16_t pid) {
+    if(pid < MAX_PROCESSES && processes[pid].active && !processes[pid].blocked) {
+        switch_target = pid;
+    }
+}
+
 void nvm_execute(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count) {
     int pid = nvm_create_process(bytecode, size, capabilities, caps_count);
     if(pid >= 0) {
@@ -4,11 +4,38 @@
 #ifndef _NVM_H
 #define _NVM_H
 
-#define MAX_PROCESSES 32768
+#include <core/kernel/paging.h>
+
+#define MAX_PROCESSES 256    // Bounded by the 8-bit PID
 #define TIME_SLICE_MS 2
 #define MAX_CAPS 16
 #define STACK_SIZE 256
 #define MAX_LOCALS 256
+#define NVM_SLICE_INSTRUCTIONS 100
+
+// Synchronous IPC states
+#define IPC_NONE       0
+#define IPC_CALL_WAIT  1   // Client waiting for a reply from ipc_partner
+#define IPC_RECV_WAIT  2   // Server waiting for the next call
+
+#define NVM_NO_PARENT  0xFFFF
+#define NVM_MAX_ARGS   16
+
+#define NVM_SHM_SLOTS  4
+#define NVM_MAX_FDS    8
+#define NVM_DATA_MAX   (1024 * 1024)   // Largest data segment SYS_MEM_GROW hands out
+
+// LOAD_ABS/STORE_ABS specialization, fixed while the caps do not change
+#define NVM_MEMOP_UNVERIFIED 0   // Caps changed, recompute on next memory op
+#define NVM_MEMOP_FAST       1   // CAP_DRV_ACCESS held: no caps check
+#define NVM_MEMOP_TRAP       2   // CAP_DRV_ACCESS missing: terminate
+
+// Shared memory mapped into one of the process window slots
+typedef struct {
+    uint8_t* base;
+    uint32_t size;
+    int8_t id;              // Object id or -1 when the slot is free
+} nvm_shm_window_t;
 
 // NVM process structure
 typedef struct {
@@ -23,13 +50,37 @@ typedef struct {
     int32_t locals[MAX_LOCALS];    // Local variables
 
     // CAPS
-    uint16_t capabilities[MAX_CAPS];  // list of caps
-    uint8_t caps_count;               // count active caps
+    uint32_t caps_mask;               // built-in caps, one bit each (see caps.h)
+    uint16_t capabilities[MAX_CAPS];  // extended caps (overflow table)
+    uint8_t caps_count;               // count of extended caps
+    uint8_t memop_mode;               // NVM_MEMOP_* for absolute memory access
     uint8_t pid;                      // Process ID
     
     // Message system
     bool blocked;           // Process blocked waiting for message
     uint8_t wakeup_reason;  // Reason for wakeup
+    uint8_t ipc_state;      // Synchronous call/reply state
+    uint16_t ipc_partner;   // Server a client is calling
+    uint16_t slice_left;    // Own slice kept while a direct call runs the server
+    uint64_t call_start;    // TSC when the pending call was made
+
+    // Multiplexed wait
+    uint8_t wait_mask;      // Sources a SYS_WAIT_ANY is blocked on
+    uint32_t wait_deadline; // timer_ticks value for WAIT_TIMER
+    uint16_t parent;        // Parent PID or NVM_NO_PARENT
+    bool zombie;            // Exited, not yet collected by the parent
+    bool waiting_child;     // Blocked in SYS_WAIT
+    uint8_t* image;         // Bytecode copy owned by the process (VFS exec)
+
+    // Private data segment, mapped at VM_WINDOW_BASE while the process runs
+    vm_space_t* space;
+    uint32_t data_size;
+
+    // Open files: VFS handle per descriptor, -1 when free
+    int16_t fds[NVM_MAX_FDS];
+
+    // Shared memory windows addressed by LOAD_SHM/STORE_SHM
+    nvm_shm_window_t shm[NVM_SHM_SLOTS];
 } nvm_process_t;
 
 extern nvm_process_t processes[MAX_PROCESSES];
@@ -37,8 +88,15 @@ extern uint8_t current_process;
 extern uint32_t timer_ticks;
 
 void nvm_init();
+int nvm_create_process(uint8_t* bytecode, uint32_t size, uint16_t initial_caps[], uint8_t caps_count);
+int nvm_spawn(nvm_process_t* parent, uint8_t* bytecode, uint32_t size, bool owned,
+              uint16_t* caps, uint8_t caps_count, int32_t* argv, uint32_t argc);
+int32_t nvm_reap(nvm_process_t* parent, int32_t pid, int32_t* exit_code);
 void nvm_execute(uint8_t* bytecode, uint32_t size, uint16_t* capabilities, uint8_t caps_count);
 void nvm_scheduler_tick();
+void nvm_switch_to(uint16_t pid);
+uint8_t nvm_specialize(nvm_process_t* proc);
+int32_t nvm_mem_grow(nvm_process_t* proc, uint32_t size);
 bool nvm_is_process_active(uint8_t pid);
 int32_t nvm_get_exit_code(uint8_t pid);
 
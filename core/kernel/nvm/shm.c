@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/nvm/shm.h>
+#include <core/kernel/nvm/caps.h>
+#include <core/kernel/log.h>
+#include <core/kernel/mem.h>
+
+static shm_object_t objects[MAX_SHM_OBJECTS];
+
+static int shm_find(uint32_t key) {
+    for (int i = 0; i < MAX_SHM_OBJECTS; i++) {
+        if (objects[i].used && objects[i].key == key) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void shm_release(int id) {
+    shm_object_t* obj = &objects[id];
+
+    if (obj->refs > 0 && --obj->refs == 0) {
+        // Revoke stale tokens so a recycled id does not grant access
+        for (int i = 0; i < MAX_PROCESSES; i++) {
+            if (processes[i].active) {
+                caps_remove_capability(&processes[i], CAP_SHM(id));
+            }
+        }
+
+        kfree(obj->data);
+        obj->data = NULL;
+        obj->used = false;
+    }
+}
+
+int32_t shm_create(nvm_process_t* proc, uint32_t key, uint32_t size) {
+    if (size == 0 || size > SHM_MAX_SIZE) {
+        LOG_WARN("Procces %d: Invalid shared memory size\n", proc->pid);
+        return -1;
+    }
+    size = (size + 3) & ~3u; // Whole words, so LOAD_SHM bounds checks cannot underflow
+
+    if (shm_find(key) >= 0) {
+        LOG_WARN("Procces %d: Shared memory key already exists\n", proc->pid);
+        return -1;
+    }
+
+    for (int i = 0; i < MAX_SHM_OBJECTS; i++) {
+        if (!objects[i].used) {
+            uint8_t* data = kmalloc(size);
+            if (!data) {
+                LOG_WARN("Procces %d: Out of memory for shared memory\n", proc->pid);
+                return -1;
+            }
+            memset(data, 0, size);
+
+            if (!caps_add_capability(proc, CAP_SHM(i))) {
+                kfree(data);
+                LOG_WARN("Procces %d: No room for shared memory capability\n", proc->pid);
+                return -1;
+            }
+
+            objects[i].key = key;
+            objects[i].data = data;
+            objects[i].size = size;
+            objects[i].refs = 1;
+            objects[i].owner = proc->pid;
+            objects[i].used = true;
+            return i;
+        }
+    }
+
+    LOG_WARN("Procces %d: No free shared memory objects\n", proc->pid);
+    return -1;
+}
+
+int32_t shm_map(nvm_process_t* proc, uint32_t key, uint32_t slot) {
+    int id = shm_find(key);
+
+    if (id < 0 || slot >= NVM_SHM_SLOTS) {
+        LOG_WARN("Procces %d: Invalid shared memory map\n", proc->pid);
+        return -1;
+    }
+
+    if (!caps_has_capability(proc, CAP_SHM(id))) {
+        LOG_WARN("Procces %d: Required caps not received for shared memory\n", proc->pid);
+        return -1;
+    }
+
+    // Reference first: remapping an object into the slot holding its last
+    // reference must not free it
+    objects[id].refs++;
+    shm_unmap(proc, slot);
+
+    proc->shm[slot].base = objects[id].data;
+    proc->shm[slot].size = objects[id].size;
+    proc->shm[slot].id = id;
+    return objects[id].size;
+}
+
+int32_t shm_unmap(nvm_process_t* proc, uint32_t slot) {
+    if (slot >= NVM_SHM_SLOTS || proc->shm[slot].id < 0) {
+        return -1;
+    }
+
+    shm_release(proc->shm[slot].id);
+    proc->shm[slot].base = NULL;
+    proc->shm[slot].size = 0;
+    proc->shm[slot].id = -1;
+    return 0;
+}
+
+int32_t shm_grant(nvm_process_t* proc, uint32_t key, uint16_t pid) {
+    int id = shm_find(key);
+
+    if (id < 0 || pid >= MAX_PROCESSES || !processes[pid].active) {
+        LOG_WARN("Procces %d: Invalid shared memory grant\n", proc->pid);
+        return -1;
+    }
+
+    if (!caps_has_capability(proc, CAP_SHM(id))) {
+        LOG_WARN("Procces %d: Cannot grant shared memory it does not hold\n", proc->pid);
+        return -1;
+    }
+
+    return caps_add_capability(&processes[pid], CAP_SHM(id)) ? 0 : -1;
+}
+
+void shm_process_exited(nvm_process_t* proc) {
+    for (int slot = 0; slot < NVM_SHM_SLOTS; slot++) {
+        shm_unmap(proc, slot);
+    }
+
+    for (int i = 0; i < MAX_SHM_OBJECTS; i++) {
+        if (objects[i].used && objects[i].owner == proc->pid) {
+            objects[i].owner = NVM_NO_PARENT;
+            shm_release(i);
+        }
+    }
+}
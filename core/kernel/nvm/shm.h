@@ -0,0 +1,35 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <core/kernel/nvm/nvm.h>
+
+#define MAX_SHM_OBJECTS 32
+#define SHM_MAX_SIZE    (1024 * 1024)
+
+typedef struct {
+    uint32_t key;           // Name chosen by the creator
+    uint8_t* data;          // Kernel heap backing store
+    uint32_t size;
+    uint16_t refs;          // Mappings plus one for the live creator
+    uint16_t owner;         // Creator PID
+    bool used;
+} shm_object_t;
+
+// Create a zeroed object named key; the creator receives its CAP_SHM token
+int32_t shm_create(nvm_process_t* proc, uint32_t key, uint32_t size);
+
+// Map the object named key into window slot; requires its CAP_SHM token
+int32_t shm_map(nvm_process_t* proc, uint32_t key, uint32_t slot);
+
+// Unmap window slot
+int32_t shm_unmap(nvm_process_t* proc, uint32_t slot);
+
+// Hand the CAP_SHM token for key to another process
+int32_t shm_grant(nvm_process_t* proc, uint32_t key, uint16_t pid);
+
+// Release every mapping and creator reference held by proc
+void shm_process_exited(nvm_process_t* proc);
+
+#endif // SHM_H
@@ -18,5 +18,27 @@
 #define SYS_PORT_IN_BYTE    0x0B
 #define SYS_PORT_OUT_BYTE   0x0C
 #define SYS_PRINT           0x0D
+#define SYS_MSG_SEND_BULK   0x0E
+#define SYS_MSG_RECV_BULK   0x0F
+#define SYS_MSG_SEND_V      0x10
+#define SYS_MSG_CALL        0x11
+#define SYS_MSG_REPLY_WAIT  0x12
+#define SYS_WAIT_ANY        0x13
+#define SYS_SHM_CREATE      0x14
+#define SYS_SHM_MAP         0x15
+#define SYS_SHM_UNMAP       0x16
+#define SYS_SHM_GRANT       0x17
+#define SYS_WAIT            0x18
+#define SYS_MEM_GROW        0x19
+#define SYS_OPEN            0x1A
+#define SYS_CLOSE           0x1B
+#define SYS_SEEK            0x1C
+
+// SYS_EXEC / SYS_CAP_SPAWN program sources
+#define EXEC_INITRAMFS      0   // ref = initramfs program index
+#define EXEC_VFS_PATH       1   // ref = locals index of a NUL-terminated path
+
+// Round trips completed by MSG_CALL and the time from call to reply
+void ipc_get_call_stats(uint32_t* calls, uint32_t* us);
 
 #endif
\ No newline at end of file
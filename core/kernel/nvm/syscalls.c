@@ -4,10 +4,16 @@
 #include <core/kernel/nvm/syscall.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
+#include <core/kernel/nvm/wait.h>
+#include <core/kernel/nvm/shm.h>
 #include <core/drivers/serial.h>
 #include <core/kernel/log.h>
 #include <core/kernel/mem.h>
-// VFS is now in userspace - kernel syscalls don't need it directly
+#include <core/kernel/kstd.h>
+#include <core/drivers/timer.h>
+#include <core/fs/initramfs.h>
+#include <core/fs/pagecache.h>
+#include <usr/vfs.h>
 
 extern uint8_t inb(uint16_t port);
 extern void outb(uint16_t port, uint8_t val);
@@ -16,18 +22,378 @@ uint16_t recipient;
 uint16_t port;
 uint8_t value;
 
+#define MSG_KIND_BYTE 0
+#define MSG_KIND_BULK 1
+#define MSG_KIND_CALL 2
+
 typedef struct {
     uint16_t recipient;
     uint16_t sender;
-    uint8_t content;
+    uint8_t kind;
+    int32_t content;
+    uint8_t* data;          // Bulk payload (NULL for single byte messages)
+    uint32_t length;        // Bulk payload length in bytes
 } message_t;
 
 
 #define MAX_MESSAGES 32
+#define MSG_BULK_MAX (MAX_LOCALS * sizeof(int32_t))
 static message_t message_queue[MAX_MESSAGES];
 static int message_count = 0;
 
+// Completed calls and their summed call-to-reply time, for bench call
+static uint32_t call_count = 0;
+static uint64_t call_cycles = 0;
+
+static void msg_wake(uint16_t recipient) {
+    if (recipient < MAX_PROCESSES && wait_notify(&processes[recipient], WAIT_MSG)) {
+        return;
+    }
+
+    if (recipient < MAX_PROCESSES && processes[recipient].active && processes[recipient].blocked &&
+        processes[recipient].ipc_state == IPC_NONE && processes[recipient].wait_mask == 0 &&
+        !processes[recipient].waiting_child) {
+        processes[recipient].blocked = false;
+        processes[recipient].wakeup_reason = 1;
+        LOG_DEBUG("Unblocked procces %d due to incoming message\n", recipient);
+    }
+}
+
+static int msg_find(uint16_t pid, uint8_t kind) {
+    for (int i = 0; i < message_count; i++) {
+        if (message_queue[i].recipient == pid && message_queue[i].kind == kind) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool msg_pending(uint16_t pid) {
+    for (int i = 0; i < message_count; i++) {
+        if (message_queue[i].recipient == pid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static message_t msg_take(int index) {
+    message_t msg = message_queue[index];
+    for (int i = index; i < message_count - 1; i++) {
+        message_queue[i] = message_queue[i + 1];
+    }
+    message_count--;
+    return msg;
+}
+
+// Bulk payloads live in the sender's locals; the kernel copy is moved through
+// the queue by pointer and released once the receiver has taken it.
+static int32_t msg_send_bulk(nvm_process_t* proc, uint16_t to, uint32_t index, uint32_t length) {
+    if (length == 0 || length > MSG_BULK_MAX ||
+        index >= MAX_LOCALS || length > (MAX_LOCALS - index) * sizeof(int32_t)) {
+        LOG_WARN("Procces %d: Invalid bulk message range\n", proc->pid);
+        return -1;
+    }
+
+    if (message_count >= MAX_MESSAGES) {
+        LOG_WARN("Procces %d: Message queue full\n", proc->pid);
+        return -1;
+    }
+
+    uint8_t* payload = kmalloc(length);
+    if (!payload) {
+        LOG_WARN("Procces %d: Out of memory for bulk message\n", proc->pid);
+        return -1;
+    }
+    memcpy(payload, &proc->locals[index], length);
+
+    message_t* msg = &message_queue[message_count++];
+    msg->recipient = to;
+    msg->sender = proc->pid;
+    msg->kind = MSG_KIND_BULK;
+    msg->content = 0;
+    msg->data = payload;
+    msg->length = length;
+
+    msg_wake(to);
+    return 0;
+}
+
+static int32_t msg_send_vector(nvm_process_t* proc) {
+    int32_t count = proc->stack[proc->sp - 1];
+
+    if (count < 0 || (uint32_t)count * 2 + 1 > proc->sp) {
+        LOG_WARN("Procces %d: Stack underflow for msg_send_v\n", proc->pid);
+        return -1;
+    }
+
+    uint32_t base = proc->sp - 1 - count * 2;
+    proc->sp = base;
+
+    if (message_count + count > MAX_MESSAGES) {
+        LOG_WARN("Procces %d: Message queue full\n", proc->pid);
+        return -1;
+    }
+
+    for (int32_t i = 0; i < count; i++) {
+        message_t* msg = &message_queue[message_count++];
+        msg->recipient = proc->stack[base + i * 2] & 0xFFFF;
+        msg->sender = proc->pid;
+        msg->kind = MSG_KIND_BYTE;
+        msg->content = proc->stack[base + i * 2 + 1] & 0xFF;
+        msg->data = NULL;
+        msg->length = 0;
+        msg_wake(msg->recipient);
+    }
+
+    return count;
+}
+
+// L4-style call: hand the request straight to a server parked in reply_wait
+// and switch to it, otherwise queue the call. Either way the client blocks
+// until ipc_reply() pushes the answer onto its stack.
+static int32_t ipc_call(nvm_process_t* proc, uint16_t to, int32_t request) {
+    if (to >= MAX_PROCESSES || !processes[to].active || to == proc->pid) {
+        LOG_WARN("Procces %d: Invalid call target\n", proc->pid);
+        return -1;
+    }
+
+    nvm_process_t* server = &processes[to];
+    if (server->ipc_state == IPC_RECV_WAIT) {
+        server->stack[server->sp++] = proc->pid;
+        server->stack[server->sp++] = request;
+        server->ipc_state = IPC_NONE;
+        server->blocked = false;
+        nvm_switch_to(to);
+    } else {
+        if (message_count >= MAX_MESSAGES) {
+            LOG_WARN("Procces %d: Message queue full\n", proc->pid);
+            return -1;
+        }
+
+        message_t* msg = &message_queue[message_count++];
+        msg->recipient = to;
+        msg->sender = proc->pid;
+        msg->kind = MSG_KIND_CALL;
+        msg->content = request;
+        msg->data = NULL;
+        msg->length = 0;
+        wait_notify(server, WAIT_MSG);
+    }
+
+    proc->ipc_state = IPC_CALL_WAIT;
+    proc->ipc_partner = to;
+    proc->call_start = timer_read_tsc();
+    proc->blocked = true;
+    return 0;
+}
+
+static bool ipc_reply(nvm_process_t* proc, uint16_t to, int32_t reply) {
+    if (to >= MAX_PROCESSES) {
+        return false;
+    }
+
+    nvm_process_t* client = &processes[to];
+    if (!client->active || client->ipc_state != IPC_CALL_WAIT || client->ipc_partner != proc->pid) {
+        return false;
+    }
+
+    client->stack[client->sp++] = reply;
+    client->ipc_state = IPC_NONE;
+    client->blocked = false;
+    call_count++;
+    call_cycles += timer_read_tsc() - client->call_start;
+    return true;
+}
+
+void ipc_get_call_stats(uint32_t* calls, uint32_t* us) {
+    uint32_t per_us = timer_tsc_per_us();
+    *calls = call_count;
+    *us = per_us ? udiv64_32(call_cycles, per_us) : 0;
+}
+
+// Called by the scheduler once a process has stopped: fail calls that are
+// waiting on it and drop whatever is still queued for it.
+void ipc_process_exited(nvm_process_t* proc) {
+    proc->ipc_state = IPC_NONE;
+
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (processes[i].active && processes[i].ipc_state == IPC_CALL_WAIT &&
+            processes[i].ipc_partner == proc->pid) {
+            ipc_reply(proc, i, -1);
+        }
+    }
+
+    for (int i = 0; i < message_count; ) {
+        if (message_queue[i].recipient == proc->pid) {
+            message_t dropped = msg_take(i);
+            if (dropped.kind == MSG_KIND_CALL) {
+                ipc_reply(proc, dropped.sender, -1);
+            }
+            if (dropped.data) {
+                kfree(dropped.data);
+            }
+        } else {
+            i++;
+        }
+    }
+}
+
 // Syscalls
+// Kernel view of [offset, offset + length) in the caller's data window, or
+// NULL if it is not inside the data segment. Pages are populated on demand.
+static uint8_t* user_window(nvm_process_t* proc, uint32_t offset, uint32_t length) {
+    if (!proc->space || offset > proc->data_size || length > proc->data_size - offset) {
+        return NULL;
+    }
+
+    vm_activate(proc->space);
+    return (uint8_t*)(VM_WINDOW_BASE + offset);
+}
+
+// NUL-terminated string at offset in the data window, or NULL
+static const char* user_path(nvm_process_t* proc, uint32_t offset) {
+    const char* path = (const char*)user_window(proc, offset, 1);
+    if (!path) {
+        return NULL;
+    }
+
+    for (uint32_t i = 0; i < proc->data_size - offset; i++) {
+        if (path[i] == '\0') {
+            return path;
+        }
+    }
+    return NULL;
+}
+
+// VFS handle behind a descriptor, or -1
+static int32_t fd_handle(nvm_process_t* proc, int32_t fd) {
+    if (fd < 0 || fd >= NVM_MAX_FDS) {
+        return -1;
+    }
+    return proc->fds[fd];
+}
+
+// Reading needs CAP_FS_READ, anything that modifies the file CAP_FS_CREATE
+static int32_t fd_open(nvm_process_t* proc, uint32_t path_offset, int32_t flags) {
+    bool reads = flags & VFS_O_READ;
+    bool writes = flags & (VFS_O_WRITE | VFS_O_CREATE | VFS_O_TRUNC | VFS_O_APPEND);
+
+    if ((reads && !caps_has_capability(proc, CAP_FS_READ)) ||
+        (writes && !caps_has_capability(proc, CAP_FS_CREATE))) {
+        LOG_WARN("Procces %d: Required caps not received for open\n", proc->pid);
+        return -1;
+    }
+
+    const char* path = user_path(proc, path_offset);
+    if (!path) {
+        return -1;
+    }
+
+    for (int fd = 0; fd < NVM_MAX_FDS; fd++) {
+        if (proc->fds[fd] < 0) {
+            int handle = vfs_open(path, flags);
+            if (handle < 0) {
+                return -1;
+            }
+            proc->fds[fd] = handle;
+            return fd;
+        }
+    }
+    return -1;
+}
+
+void fd_process_exited(nvm_process_t* proc) {
+    for (int fd = 0; fd < NVM_MAX_FDS; fd++) {
+        if (proc->fds[fd] >= 0) {
+            vfs_close(proc->fds[fd]);
+            proc->fds[fd] = -1;
+        }
+    }
+}
+
+// Resolve an exec source to a bytecode image. VFS images are copied to the
+// heap (owned by the child), initramfs images are run in place.
+static uint8_t* exec_load(nvm_process_t* proc, int32_t kind, int32_t ref, uint32_t* size, bool* owned) {
+    *owned = false;
+
+    if (kind == EXEC_INITRAMFS) {
+        struct program* prog = initramfs_get_program((size_t)ref);
+        if (!prog) {
+            return NULL;
+        }
+        *size = prog->size;
+        return (uint8_t*)pcache_map(initramfs_get_store(), (uint32_t)ref, prog->size);
+    }
+
+    if (kind == EXEC_VFS_PATH) {
+        if (!caps_has_capability(proc, CAP_FS_READ) || ref < 0 || ref >= MAX_LOCALS) {
+            return NULL;
+        }
+
+        // Path is stored in locals as raw bytes and must be terminated inside them
+        const char* path = (const char*)&proc->locals[ref];
+        uint32_t limit = (MAX_LOCALS - ref) * sizeof(int32_t);
+        uint32_t len = 0;
+        while (len < limit && path[len]) len++;
+        if (len == limit) {
+            return NULL;
+        }
+
+        size_t file_size;
+        const char* data = vfs_read(path, &file_size);
+        if (!data || file_size < 4) {
+            return NULL;
+        }
+
+        uint8_t* image = (uint8_t*)kmalloc(file_size);
+        if (!image) {
+            return NULL;
+        }
+        memcpy(image, data, file_size);
+        *size = file_size;
+        *owned = true;
+        return image;
+    }
+
+    return NULL;
+}
+
+// Shared tail of SYS_EXEC and SYS_CAP_SPAWN: args..., argc, kind, ref are on
+// top of the stack (above base). Pops everything from base and pushes the PID.
+static void exec_spawn(nvm_process_t* proc, uint32_t base, uint16_t* caps, uint8_t caps_count) {
+    int32_t argc = proc->stack[proc->sp - 3];
+    int32_t kind = proc->stack[proc->sp - 2];
+    int32_t ref = proc->stack[proc->sp - 1];
+    int32_t* argv = &proc->stack[proc->sp - 3 - argc];
+    int32_t result = -1;
+
+    uint32_t size;
+    bool owned;
+    uint8_t* image = exec_load(proc, kind, ref, &size, &owned);
+
+    if (image) {
+        result = nvm_spawn(proc, image, size, owned, caps, caps_count, argv, (uint32_t)argc);
+        if (result < 0 && owned) {
+            kfree(image);
+        }
+    } else {
+        LOG_WARN("Procces %d: exec source %d:%d not found\n", proc->pid, kind, ref);
+    }
+
+    proc->sp = base;
+    proc->stack[proc->sp++] = result;
+}
+
+// argc must fit below the three fixed arguments at the top of the stack
+static bool exec_args_valid(nvm_process_t* proc, uint32_t fixed) {
+    if (proc->sp < fixed + 3) {
+        return false;
+    }
+    int32_t argc = proc->stack[proc->sp - 3];
+    return argc >= 0 && argc <= NVM_MAX_ARGS && proc->sp >= fixed + 3 + (uint32_t)argc;
+}
+
 int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
     int32_t result = 0;
     int32_t arg1;
@@ -48,7 +414,97 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             break;
         
         case SYS_EXEC:
-            LOG_WARN("Procces %d: Exec syscall was called. Ignore");
+            // Start a child with the caller's caps: args..., argc, kind, ref -> pid
+            if (!caps_has_capability(proc, CAP_FS_READ)) {
+                LOG_WARN("Procces %d: Terminate procces - required caps not received.\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                result = -1;
+                break;
+            }
+
+            if (!exec_args_valid(proc, 0)) {
+                LOG_WARN("Procces %d: Stack underflow for exec\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            exec_spawn(proc, proc->sp - 3 - proc->stack[proc->sp - 3], NULL, 0);
+            break;
+
+        case SYS_CAP_SPAWN:
+            // Start a child with a subset of the caller's caps:
+            // caps..., capc, args..., argc, kind, ref -> pid
+            if (!caps_has_capability(proc, CAP_CAPS_MGMT)) {
+                LOG_WARN("Procces %d: Terminate procces - required caps not received.\n", proc->pid);
+                proc->exit_code = -1;
+                proc->active = false;
+                result = -1;
+                break;
+            }
+
+            if (!exec_args_valid(proc, 1)) {
+                LOG_WARN("Procces %d: Stack underflow for cap_spawn\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            {
+                uint32_t capc_at = proc->sp - 4 - proc->stack[proc->sp - 3];
+                int32_t capc = proc->stack[capc_at];
+                if (capc < 0 || capc > MAX_CAPS || (uint32_t)capc > capc_at) {
+                    LOG_WARN("Procces %d: Invalid caps count for cap_spawn\n", proc->pid);
+                    result = -1;
+                    break;
+                }
+
+                uint16_t caps[MAX_CAPS];
+                uint32_t base = capc_at - capc;
+                bool allowed = true;
+                for (int32_t i = 0; i < capc; i++) {
+                    caps[i] = proc->stack[base + i] & 0xFFFF;
+                    // A child can never receive more than its parent holds
+                    if (!caps_has_capability(proc, caps[i])) {
+                        allowed = false;
+                    }
+                }
+
+                if (!allowed) {
+                    LOG_WARN("Procces %d: cap_spawn requested caps the parent does not hold\n", proc->pid);
+                    proc->sp = base;
+                    proc->stack[proc->sp++] = -1;
+                    break;
+                }
+
+                exec_spawn(proc, base, caps, (uint8_t)capc);
+            }
+            break;
+
+        case SYS_WAIT:
+            // Collect an exited child: pid (-1 = any) -> pid, exit_code
+            if (proc->sp < 1) {
+                LOG_WARN("Procces %d: Stack underflow for wait\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            {
+                int32_t code = 0;
+                int32_t child = nvm_reap(proc, proc->stack[proc->sp - 1], &code);
+
+                if (child == -2) {
+                    // Child still running: block and retry the syscall on wakeup
+                    proc->waiting_child = true;
+                    proc->blocked = true;
+                    proc->ip -= 2;
+                    break;
+                }
+
+                proc->stack[proc->sp - 1] = child;
+                if (proc->sp < STACK_SIZE) {
+                    proc->stack[proc->sp++] = child < 0 ? -1 : code;
+                }
+            }
             break;
 
         case SYS_MSG_SEND:
@@ -70,32 +526,21 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             message_t msg;
             msg.recipient = recipient;
             msg.sender = proc->pid;
+            msg.kind = MSG_KIND_BYTE;
             msg.content = value;
+            msg.data = NULL;
+            msg.length = 0;
             
             message_queue[message_count] = msg;
             message_count++;
 
-            for (int i = 0; i < MAX_PROCESSES; i++) {
-                if (processes[i].active && processes[i].pid == recipient && processes[i].blocked) {
-                    processes[i].blocked = false; 
-                    processes[i].wakeup_reason = 1;
-
-                    LOG_DEBUG("Unblocked procces %d due to incoming message", buffer);
-                    break;
-                }
-            }
+            msg_wake(recipient);
 
             proc->sp -= 2;
             break;
             
         case SYS_MSG_RECEIVE:
-            int found_index = -1;
-            for (int i = 0; i < message_count; i++) {
-                if (message_queue[i].recipient == proc->pid) {
-                    found_index = i;
-                    break;
-                }
-            }
+            int found_index = msg_find(proc->pid, MSG_KIND_BYTE);
             
             if (found_index == -1) {
                 serial_print("No messages for process ");
@@ -108,12 +553,7 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
                 break;
             }
             
-            message_t received_msg = message_queue[found_index];
-            
-            for (int i = found_index; i < message_count - 1; i++) {
-                message_queue[i] = message_queue[i + 1];
-            }
-            message_count--;
+            message_t received_msg = msg_take(found_index);
 
             if (proc->sp + 1 < 256) {
                 proc->stack[proc->sp] = received_msg.sender;
@@ -129,6 +569,204 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             LOG_DEBUG("Procces %d: Message received. sender=%s. Unblock procces\n", proc->pid, buffer);
             break;
 
+        case SYS_MSG_SEND_BULK:
+            // Send bulk message: recipient, locals_index, length
+            if (proc->sp < 3) {
+                LOG_WARN("Procces %d: Stack underflow for msg_send_bulk\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            recipient = proc->stack[proc->sp - 3] & 0xFFFF;
+            result = msg_send_bulk(proc, recipient,
+                                   (uint32_t)proc->stack[proc->sp - 2],
+                                   (uint32_t)proc->stack[proc->sp - 1]);
+            proc->sp -= 3;
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_MSG_RECV_BULK:
+            // Receive bulk message into locals: locals_index, max_length
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for msg_recv_bulk\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            uint32_t bulk_index = (uint32_t)proc->stack[proc->sp - 2];
+            uint32_t bulk_max = (uint32_t)proc->stack[proc->sp - 1];
+            if (bulk_index >= MAX_LOCALS) {
+                // Leave the message queued for a valid receive
+                LOG_WARN("Procces %d: Invalid locals index in msg_recv_bulk\n", proc->pid);
+                proc->sp -= 2;
+                proc->stack[proc->sp++] = -1;
+                result = -1;
+                break;
+            }
+
+            found_index = msg_find(proc->pid, MSG_KIND_BULK);
+            if (found_index == -1) {
+                // Restart the syscall once a message arrives
+                proc->ip -= 2;
+                proc->blocked = true;
+                result = -1;
+                break;
+            }
+            proc->sp -= 2;
+
+            received_msg = msg_take(found_index);
+            uint32_t room = (MAX_LOCALS - bulk_index) * sizeof(int32_t);
+            uint32_t copy = received_msg.length;
+            if (copy > bulk_max) copy = bulk_max;
+            if (copy > room) copy = room;
+            memcpy(&proc->locals[bulk_index], received_msg.data, copy);
+            proc->stack[proc->sp++] = received_msg.sender;
+            proc->stack[proc->sp++] = copy;
+            kfree(received_msg.data);
+            break;
+
+        case SYS_MSG_SEND_V:
+            // Send a batch of byte messages: recipient, value, ..., count
+            if (proc->sp < 1) {
+                LOG_WARN("Procces %d: Stack underflow for msg_send_v\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = msg_send_vector(proc);
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_MSG_CALL:
+            // Synchronous call: server, request -> reply
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for msg_call\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            recipient = proc->stack[proc->sp - 2] & 0xFFFF;
+            arg1 = proc->stack[proc->sp - 1];
+            proc->sp -= 2;
+
+            result = ipc_call(proc, recipient, arg1);
+            if (result < 0) {
+                proc->stack[proc->sp++] = result;
+            }
+            break;
+
+        case SYS_MSG_REPLY_WAIT:
+            // Reply to a client (or -1 for none) and wait for the next call:
+            // client, reply -> client, request
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for msg_reply_wait\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            int32_t client = proc->stack[proc->sp - 2];
+            arg1 = proc->stack[proc->sp - 1];
+            proc->sp -= 2;
+
+            bool replied = client >= 0 && ipc_reply(proc, client & 0xFFFF, arg1);
+
+            found_index = msg_find(proc->pid, MSG_KIND_CALL);
+            if (found_index != -1) {
+                received_msg = msg_take(found_index);
+                proc->stack[proc->sp++] = received_msg.sender;
+                proc->stack[proc->sp++] = received_msg.content;
+                break;
+            }
+
+            proc->ipc_state = IPC_RECV_WAIT;
+            proc->blocked = true;
+            if (replied) {
+                // Donate the rest of the slice back to the client
+                nvm_switch_to(client & 0xFFFF);
+            }
+            break;
+
+        case SYS_WAIT_ANY:
+            // Block until any source in mask fires: mask, timeout_ticks -> source
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for wait_any\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            arg1 = proc->stack[proc->sp - 2];
+            uint32_t timeout = (uint32_t)proc->stack[proc->sp - 1];
+            proc->sp -= 2;
+
+            result = wait_begin(proc, arg1 & 0xFF, timeout);
+            if (result < 0) {
+                proc->stack[proc->sp++] = result;
+            }
+            break;
+
+        case SYS_MEM_GROW:
+            // Grow the data segment used by LOAD_MEM/STORE_MEM: size -> new size
+            if (proc->sp < 1) {
+                LOG_WARN("Procces %d: Stack underflow for mem_grow\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = nvm_mem_grow(proc, (uint32_t)proc->stack[proc->sp - 1]);
+            proc->stack[proc->sp - 1] = result;
+            break;
+
+        case SYS_SHM_CREATE:
+            // Create shared memory: key, size -> id
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for shm_create\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = shm_create(proc, (uint32_t)proc->stack[proc->sp - 2], (uint32_t)proc->stack[proc->sp - 1]);
+            proc->sp -= 2;
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_SHM_MAP:
+            // Map shared memory into a window slot: key, slot -> size
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for shm_map\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = shm_map(proc, (uint32_t)proc->stack[proc->sp - 2], (uint32_t)proc->stack[proc->sp - 1]);
+            proc->sp -= 2;
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_SHM_UNMAP:
+            // Unmap a window slot: slot -> result
+            if (proc->sp < 1) {
+                LOG_WARN("Procces %d: Stack underflow for shm_unmap\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = shm_unmap(proc, (uint32_t)proc->stack[proc->sp - 1]);
+            proc->stack[proc->sp - 1] = result;
+            break;
+
+        case SYS_SHM_GRANT:
+            // Give another process the right to map: key, pid -> result
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for shm_grant\n", proc->pid);
+                result = -1;
+                break;
+            }
+
+            result = shm_grant(proc, (uint32_t)proc->stack[proc->sp - 2], proc->stack[proc->sp - 1] & 0xFFFF);
+            proc->sp -= 2;
+            proc->stack[proc->sp++] = result;
+            break;
+
         case SYS_PORT_IN_BYTE:
             if (!caps_has_capability(proc, CAP_DRV_ACCESS)) {
                 LOG_WARN("Procces %d: Terminate procces - required caps not received.\n", proc->pid);
@@ -175,119 +813,114 @@ int32_t syscall_handler(uint8_t syscall_id, nvm_process_t* proc) {
             proc->sp -= 1;
             break;
 
-        case SYS_CREATE:
-            // Create a file: filename_addr, data_addr, size
-            if (proc->sp < 3) {
-                LOG_WARN("Procces %d: Stack underflow for create\\n", proc->pid);
+        case SYS_OPEN:
+            // Open a file: path_offset, flags -> fd
+            if (proc->sp < 2) {
+                LOG_WARN("Procces %d: Stack underflow for open\n", proc->pid);
                 result = -1;
                 break;
             }
-            
-            uint32_t filename_addr = (uint32_t)proc->stack[proc->sp - 3];
-            uint32_t data_addr = (uint32_t)proc->stack[proc->sp - 2];
-            uint32_t file_size = (uint32_t)proc->stack[proc->sp - 1];
-            
-            // Check if addresses are valid (simple validation)
-            if (filename_addr < 0x100000 || data_addr < 0x100000) {
-                LOG_WARN("Procces %d: Invalid address for create\\n", proc->pid);
+
+            result = fd_open(proc, (uint32_t)proc->stack[proc->sp - 2], proc->stack[proc->sp - 1]);
+            proc->sp -= 2;
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_CLOSE:
+            // Close a descriptor: fd -> result
+            if (proc->sp < 1) {
+                LOG_WARN("Procces %d: Stack underflow for close\n", proc->pid);
                 result = -1;
-                proc->sp -= 3;
                 break;
             }
-            
-            // VFS is now in userspace - syscalls should be handled there
-            LOG_WARN("Procces %d: SYS_CREATE not implemented in kernel (VFS moved to userspace)\\n", proc->pid);
+
+            arg1 = proc->stack[proc->sp - 1];
             result = -1;
-            
-            proc->sp -= 3;
-            if (proc->sp < STACK_SIZE) {
-                proc->stack[proc->sp++] = result;
+            if (arg1 >= 0 && arg1 < NVM_MAX_FDS && proc->fds[arg1] >= 0) {
+                result = vfs_close(proc->fds[arg1]);
+                proc->fds[arg1] = -1;
             }
+            proc->stack[proc->sp - 1] = result;
             break;
 
-        case SYS_WRITE:
-            // Write to existing file: filename_addr, data_addr, size
+        case SYS_SEEK:
+            // Move the file offset: fd, offset, whence -> new offset
             if (proc->sp < 3) {
-                LOG_WARN("Procces %d: Stack underflow for write\\n", proc->pid);
+                LOG_WARN("Procces %d: Stack underflow for seek\n", proc->pid);
                 result = -1;
                 break;
             }
-            
-            filename_addr = (uint32_t)proc->stack[proc->sp - 3];
-            data_addr = (uint32_t)proc->stack[proc->sp - 2];
-            file_size = (uint32_t)proc->stack[proc->sp - 1];
-            
-            if (filename_addr < 0x100000 || data_addr < 0x100000) {
-                LOG_WARN("Procces %d: Invalid address for write\\n", proc->pid);
+
+            arg1 = fd_handle(proc, proc->stack[proc->sp - 3]);
+            result = arg1 < 0 ? -1 : vfs_seek(arg1, proc->stack[proc->sp - 2], proc->stack[proc->sp - 1]);
+            proc->sp -= 3;
+            proc->stack[proc->sp++] = result;
+            break;
+
+        case SYS_READ:
+        case SYS_WRITE:
+            // Read or write at the file offset: fd, buffer_offset, length -> bytes
+            if (proc->sp < 3) {
+                LOG_WARN("Procces %d: Stack underflow for read/write\n", proc->pid);
                 result = -1;
-                proc->sp -= 3;
                 break;
             }
-            
-            // VFS is now in userspace
-            LOG_WARN("Procces %d: SYS_WRITE not implemented in kernel (VFS moved to userspace)\\n", proc->pid);
-            result = -1;
-            
-            proc->sp -= 3;
-            if (proc->sp < STACK_SIZE) {
-                proc->stack[proc->sp++] = result;
+
+            {
+                int32_t handle = fd_handle(proc, proc->stack[proc->sp - 3]);
+                uint32_t length = (uint32_t)proc->stack[proc->sp - 1];
+                uint8_t* buffer = user_window(proc, (uint32_t)proc->stack[proc->sp - 2], length);
+
+                if (handle < 0 || !buffer) {
+                    result = -1;
+                } else if (syscall_id == SYS_READ) {
+                    result = vfs_fread(handle, buffer, length);
+                } else {
+                    result = vfs_fwrite(handle, buffer, length);
+                }
             }
+            proc->sp -= 3;
+            proc->stack[proc->sp++] = result;
             break;
 
-        case SYS_READ:
-            // Read file: filename_addr, buffer_addr, maxsize
+        case SYS_CREATE:
+            // Create or replace a whole file: path_offset, data_offset, size -> result
             if (proc->sp < 3) {
-                LOG_WARN("Procces %d: Stack underflow for read\\n", proc->pid);
+                LOG_WARN("Procces %d: Stack underflow for create\n", proc->pid);
                 result = -1;
                 break;
             }
-            
-            filename_addr = (uint32_t)proc->stack[proc->sp - 3];
-            uint32_t buffer_addr = (uint32_t)proc->stack[proc->sp - 2];
-            uint32_t max_size = (uint32_t)proc->stack[proc->sp - 1];
-            
-            if (filename_addr < 0x100000 || buffer_addr < 0x100000) {
-                LOG_WARN("Procces %d: Invalid address for read\\n", proc->pid);
+
+            if (!caps_has_capability(proc, CAP_FS_CREATE)) {
+                LOG_WARN("Procces %d: Required caps not received for create\n", proc->pid);
                 result = -1;
-                proc->sp -= 3;
-                break;
+            } else {
+                const char* path = user_path(proc, (uint32_t)proc->stack[proc->sp - 3]);
+                uint32_t size = (uint32_t)proc->stack[proc->sp - 1];
+                uint8_t* data = user_window(proc, (uint32_t)proc->stack[proc->sp - 2], size);
+
+                result = (path && data && vfs_create(path, (const char*)data, size) >= 0) ? 0 : -1;
             }
-            
-            // VFS is now in userspace
-            LOG_WARN("Procces %d: SYS_READ not implemented in kernel (VFS moved to userspace)\\n", proc->pid);
-            result = -1;
-            
             proc->sp -= 3;
-            if (proc->sp < STACK_SIZE) {
-                proc->stack[proc->sp++] = result;
-            }
+            proc->stack[proc->sp++] = result;
             break;
 
         case SYS_DELETE:
-            // Delete file: filename_addr
+            // Delete a file or empty directory: path_offset -> result
             if (proc->sp < 1) {
-                LOG_WARN("Procces %d: Stack underflow for delete\\n", proc->pid);
+                LOG_WARN("Procces %d: Stack underflow for delete\n", proc->pid);
                 result = -1;
                 break;
             }
-            
-            filename_addr = (uint32_t)proc->stack[proc->sp - 1];
-            
-            if (filename_addr < 0x100000) {
-                LOG_WARN("Procces %d: Invalid address for delete\\n", proc->pid);
+
+            if (!caps_has_capability(proc, CAP_FS_DELETE)) {
+                LOG_WARN("Procces %d: Required caps not received for delete\n", proc->pid);
                 result = -1;
-                proc->sp -= 1;
-                break;
-            }
-            
-            // VFS is now in userspace
-            LOG_WARN("Procces %d: SYS_DELETE not implemented in kernel (VFS moved to userspace)\\n", proc->pid);
-            result = -1;
-            
-            proc->sp -= 1;
-            if (proc->sp < STACK_SIZE) {
-                proc->stack[proc->sp++] = result;
+            } else {
+                const char* path = user_path(proc, (uint32_t)proc->stack[proc->sp - 1]);
+                result = (path && vfs_delete(path) == 0) ? 0 : -1;
             }
+            proc->stack[proc->sp - 1] = result;
             break;
 
         default:
@@ -0,0 +1,108 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/nvm/wait.h>
+#include <core/kernel/nvm/nvm.h>
+#include <core/kernel/log.h>
+#include <core/drivers/keyboard.h>
+#include <core/drivers/serial.h>
+
+// Blocked waiters, so polling costs O(waiters) rather than O(processes)
+static uint16_t waiters[MAX_WAITERS];
+static int waiter_count = 0;
+
+bool msg_pending(uint16_t pid);
+
+static bool wait_child_exited(nvm_process_t* proc) {
+    for (int i = 0; i < MAX_PROCESSES; i++) {
+        if (processes[i].zombie && processes[i].parent == proc->pid) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Sources are checked in priority order; the first ready one wins
+static uint8_t wait_ready(nvm_process_t* proc, uint8_t mask) {
+    if ((mask & WAIT_MSG) && msg_pending(proc->pid)) return WAIT_MSG;
+    if ((mask & WAIT_CHILD) && wait_child_exited(proc)) return WAIT_CHILD;
+    if ((mask & WAIT_KEYBOARD) && keyboard_has_char()) return WAIT_KEYBOARD;
+    if ((mask & WAIT_SERIAL) && serial_received()) return WAIT_SERIAL;
+    if ((mask & WAIT_TIMER) && (int32_t)(timer_ticks - proc->wait_deadline) >= 0) return WAIT_TIMER;
+    return 0;
+}
+
+static void wait_fire(nvm_process_t* proc, uint8_t source) {
+    wait_cancel(proc);
+    proc->stack[proc->sp++] = source;
+    proc->wakeup_reason = source;
+    proc->blocked = false;
+}
+
+int32_t wait_begin(nvm_process_t* proc, uint8_t mask, uint32_t timeout) {
+    mask &= WAIT_ALL;
+    if (mask == 0) {
+        LOG_WARN("Procces %d: Empty wait set\n", proc->pid);
+        return -1;
+    }
+
+    proc->wait_deadline = timer_ticks + timeout;
+
+    uint8_t source = wait_ready(proc, mask);
+    if (source) {
+        proc->stack[proc->sp++] = source;
+        return source;
+    }
+
+    if (waiter_count >= MAX_WAITERS) {
+        LOG_WARN("Procces %d: Too many waiting processes\n", proc->pid);
+        return -1;
+    }
+
+    waiters[waiter_count++] = proc->pid;
+    proc->wait_mask = mask;
+    proc->blocked = true;
+    return 0;
+}
+
+bool wait_notify(nvm_process_t* proc, uint8_t source) {
+    if (!proc->active || !proc->blocked || !(proc->wait_mask & source)) {
+        return false;
+    }
+
+    wait_fire(proc, source);
+    return true;
+}
+
+void wait_cancel(nvm_process_t* proc) {
+    if (proc->wait_mask == 0) {
+        return;
+    }
+
+    proc->wait_mask = 0;
+    for (int i = 0; i < waiter_count; i++) {
+        if (waiters[i] == proc->pid) {
+            waiters[i] = waiters[--waiter_count];
+            return;
+        }
+    }
+}
+
+void wait_poll(void) {
+    for (int i = 0; i < waiter_count; ) {
+        nvm_process_t* proc = &processes[waiters[i]];
+
+        if (!proc->active) {
+            wait_cancel(proc);
+            continue;
+        }
+
+        // Messages and child exits are pushed by their producers; only the
+        // device and timer sources have to be polled here.
+        uint8_t source = wait_ready(proc, proc->wait_mask & (WAIT_KEYBOARD | WAIT_SERIAL | WAIT_TIMER));
+        if (source) {
+            wait_fire(proc, source); // Removes waiters[i]
+        } else {
+            i++;
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#ifndef WAIT_H
+#define WAIT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <core/kernel/nvm/nvm.h>
+
+// SYS_WAIT_ANY sources (bitmask)
+#define WAIT_MSG        0x01    // Mailbox non-empty
+#define WAIT_TIMER      0x02    // Timeout expired
+#define WAIT_KEYBOARD   0x04    // Keyboard input available
+#define WAIT_SERIAL     0x08    // Serial RX data available
+#define WAIT_CHILD      0x10    // A child process exited
+#define WAIT_ALL        0x1F
+
+#define MAX_WAITERS     32
+
+// Start a wait; pushes the fired source now or blocks the process
+int32_t wait_begin(nvm_process_t* proc, uint8_t mask, uint32_t timeout);
+
+// Wake proc if it waits on source; returns true if it was woken
+bool wait_notify(nvm_process_t* proc, uint8_t source);
+
+// Poll device and timer sources for blocked waiters (called every tick)
+void wait_poll(void);
+
+// Drop a process from the waiter table
+void wait_cancel(nvm_process_t* proc);
+
+#endif // WAIT_H
@@ -0,0 +1,153 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include <core/kernel/paging.h>
+#include <core/kernel/mem.h>
+#include <core/kernel/kstd.h>
+#include <stddef.h>
+
+#define PAGE_ENTRIES   1024
+#define FRAME_BATCH    16           // Frames carved from the heap at a time
+#define WINDOW_SLOT    (VM_WINDOW_BASE >> 22)
+
+static uint32_t kernel_directory[PAGE_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+static vm_space_t* active_space = NULL;
+static void* free_frames = NULL;    // Linked through the first word of each frame
+static void* scratch_frame = NULL;  // Backs accesses past a window limit
+
+static void paging_load_directory(uint32_t* directory) {
+    asm volatile ("mov %0, %%cr3" : : "r"(directory) : "memory");
+}
+
+// Everything is identity mapped with 4 MB pages, so the kernel keeps running
+// on physical addresses. The window slot is left empty in the kernel directory.
+void paging_init(void) {
+    for (uint32_t i = 0; i < PAGE_ENTRIES; i++) {
+        uint32_t base = i << 22;
+        if (base >= KERNEL_HIGH_BASE && base - KERNEL_HIGH_BASE < KERNEL_HIGH_SIZE) {
+            base -= KERNEL_HIGH_BASE;
+        }
+        kernel_directory[i] = base | PAGE_LARGE | PAGE_WRITE | PAGE_PRESENT;
+    }
+    kernel_directory[WINDOW_SLOT] = 0;
+
+    scratch_frame = frame_alloc();
+
+    uint32_t reg;
+    asm volatile ("mov %%cr4, %0" : "=r"(reg));
+    asm volatile ("mov %0, %%cr4" : : "r"(reg | 0x10));          // CR4.PSE
+    paging_load_directory(kernel_directory);
+    asm volatile ("mov %%cr0, %0" : "=r"(reg));
+    asm volatile ("mov %0, %%cr0" : : "r"(reg | 0x80000000));    // CR0.PG
+
+    kprint(":: Paging enabled\n", 7);
+}
+
+// Frames are never handed back to the heap; freed ones are reused here
+void* frame_alloc(void) {
+    if (!free_frames) {
+        uint8_t* chunk = (uint8_t*)kmalloc((FRAME_BATCH + 1) * PAGE_SIZE);
+        if (!chunk) {
+            return NULL;
+        }
+
+        uintptr_t first = ((uintptr_t)chunk + PAGE_SIZE - 1) & ~(uintptr_t)(PAGE_SIZE - 1);
+        for (int i = 0; i < FRAME_BATCH; i++) {
+            frame_free((void*)(first + i * PAGE_SIZE));
+        }
+    }
+
+    void* frame = free_frames;
+    free_frames = *(void**)frame;
+    return frame;
+}
+
+void frame_free(void* frame) {
+    *(void**)frame = free_frames;
+    free_frames = frame;
+}
+
+vm_space_t* vm_space_create(void* owner, void (*on_violation)(void* owner)) {
+    vm_space_t* space = (vm_space_t*)kmalloc(sizeof(vm_space_t));
+    if (!space) {
+        return NULL;
+    }
+
+    space->directory = (uint32_t*)frame_alloc();
+    space->table = (uint32_t*)frame_alloc();
+    if (!space->directory || !space->table) {
+        if (space->directory) frame_free(space->directory);
+        if (space->table) frame_free(space->table);
+        kfree(space);
+        return NULL;
+    }
+
+    memcpy(space->directory, kernel_directory, PAGE_SIZE);
+    memset(space->table, 0, PAGE_SIZE);
+    space->directory[WINDOW_SLOT] = (uint32_t)space->table | PAGE_WRITE | PAGE_PRESENT;
+    space->limit = 0;
+    space->pages = 0;
+    space->owner = owner;
+    space->on_violation = on_violation;
+    return space;
+}
+
+void vm_space_destroy(vm_space_t* space) {
+    if (!space) {
+        return;
+    }
+
+    if (active_space == space) {
+        vm_activate(NULL);
+    }
+
+    for (int i = 0; i < PAGE_ENTRIES; i++) {
+        if (space->table[i] & PAGE_PRESENT) {
+            void* frame = (void*)(space->table[i] & ~(PAGE_SIZE - 1));
+            if (frame != scratch_frame) {
+                frame_free(frame);
+            }
+        }
+    }
+
+    frame_free(space->table);
+    frame_free(space->directory);
+    kfree(space);
+}
+
+// NULL switches back to the kernel directory
+void vm_activate(vm_space_t* space) {
+    if (space == active_space) {
+        return;
+    }
+
+    active_space = space;
+    paging_load_directory(space ? space->directory : kernel_directory);
+}
+
+// Called from the #PF handler. Populates the window of the active space with
+// zeroed frames up to its limit; anything else is a kernel fault.
+bool paging_fault(uint32_t address, uint32_t error) {
+    if (!active_space || (error & PAGE_PRESENT) ||
+        address < VM_WINDOW_BASE || address - VM_WINDOW_BASE >= VM_WINDOW_SIZE) {
+        return false;
+    }
+
+    uint32_t offset = address - VM_WINDOW_BASE;
+    uint32_t* entry = &active_space->table[offset / PAGE_SIZE];
+    void* frame = offset < active_space->limit ? frame_alloc() : NULL;
+
+    if (frame) {
+        memset(frame, 0, PAGE_SIZE);
+        active_space->pages++;
+    } else {
+        // Let the faulting instruction finish on the scratch page, the owner
+        // is terminated before it runs again
+        frame = scratch_frame;
+        if (active_space->on_violation) {
+            active_space->on_violation(active_space->owner);
+        }
+    }
+
+    *entry = (uint32_t)frame | PAGE_WRITE | PAGE_PRESENT;
+    return true;
+}
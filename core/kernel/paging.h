@@ -0,0 +1,39 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define PAGE_SIZE          4096
+#define PAGE_PRESENT       0x001
+#define PAGE_WRITE         0x002
+#define PAGE_LARGE         0x080        // 4 MB directory entry (PSE)
+
+// Low physical memory is also mapped at the top of the address space
+#define KERNEL_HIGH_BASE   0xC0000000
+#define KERNEL_HIGH_SIZE   0x10000000   // 256 MB
+#define PHYS_TO_HIGH(addr) ((uintptr_t)(addr) + KERNEL_HIGH_BASE)
+
+// One directory slot holds the data window of the running NVM process
+#define VM_WINDOW_BASE     0x40000000
+#define VM_WINDOW_SIZE     0x00400000
+
+// Per-process address space: the kernel mappings plus a demand-zero window
+typedef struct {
+    uint32_t* directory;    // Page directory frame
+    uint32_t* table;        // Page table of the data window
+    uint32_t limit;         // Bytes of the window that may be populated
+    uint32_t pages;         // Frames currently mapped in the window
+    void* owner;
+    void (*on_violation)(void* owner);  // Access past limit; a scratch page is mapped
+} vm_space_t;
+
+void paging_init(void);
+void* frame_alloc(void);
+void frame_free(void* frame);
+vm_space_t* vm_space_create(void* owner, void (*on_violation)(void* owner));
+void vm_space_destroy(vm_space_t* space);
+void vm_activate(vm_space_t* space);
+bool paging_fault(uint32_t address, uint32_t error);
+
+#endif
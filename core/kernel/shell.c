@@ -8,10 +8,14 @@
 #include <core/drivers/vga.h>
 #include <core/kernel/mem.h>
 #include <core/fs/initramfs.h>
+#include <core/fs/ramfs.h>
 #include <core/fs/iso9660.h>
 #include <core/kernel/nvm/nvm.h>
 #include <core/kernel/nvm/caps.h>
 #include <core/kernel/userspace.h>
+#include <core/kernel/bench.h>
+#include <core/kernel/boot.h>
+#include <usr/vfs.h>
 
 #define MAX_COMMAND_LENGTH 256
 #define MAX_PATH_LENGTH 64
@@ -53,10 +57,13 @@ static void cmd_help(void) {
     kprint("  help     - Show this help message\n", 7);
     kprint("  info     - Show system information\n", 7);
     kprint("  memtest  - Test memory allocation\n", 7);
+    kprint("  ramfs    - Show RamFS usage and heap fragmentation\n", 7);
     kprint("  list     - List loaded NVM programs\n", 7);
-    kprint("  run      - Run a NVM program by index\n", 7);
+    kprint("  run      - Run a NVM program by name or index\n", 7);
     kprint("  progs    - List userspace programs\n", 7);
     kprint("  pwd      - Print working directory\n", 7);
+    kprint("  bench    - Run a kernel benchmark\n", 7);
+    kprint("  sync     - Write cached disk changes back\n", 7);
     kprint("\nISO9660 commands:\n", 10);
     kprint("  isols    - List files in ISO9660 directory\n", 7);
     kprint("  isocat   - Show ISO9660 file content\n", 7);
@@ -96,8 +103,55 @@ static void cmd_memtest(void) {
     kprint("\n", 7);
 }
 
+static void print_kb(const char* label, size_t bytes) {
+    char buf[16];
+    kprint(label, 7);
+    itoa((int)(bytes / 1024), buf, 10);
+    kprint(buf, 15);
+    kprint(" KB", 7);
+}
+
+// Command: ramfs
+static void cmd_ramfs(void) {
+    ramfs_stats_t rs;
+    mm_stats_t ms;
+    char buf[16];
+    ramfs_get_stats(&rs);
+    mm_get_stats(&ms);
+
+    kprint("\nRamFS: ", 7);
+    itoa(rs.objects, buf, 10);
+    kprint(buf, 15);
+    kprint(" objects in ", 7);
+    itoa(rs.slots, buf, 10);
+    kprint(buf, 7);
+    kprint(" slots\n", 7);
+    print_kb("  Data: ", rs.bytes);
+    print_kb(", largest object: ", rs.largest);
+    print_kb(", slot table: ", rs.table_bytes);
+    kprint("\n", 7);
+
+    // External fragmentation: the share of free memory that a single
+    // allocation cannot use
+    size_t stranded = ms.free - ms.largest_free;
+    uint32_t percent = ms.free >= 100 ? (uint32_t)(stranded / (ms.free / 100)) : 0;
+    print_kb("Heap: ", ms.total - ms.free);
+    print_kb(" used of ", ms.total);
+    kprint("\n", 7);
+    print_kb("  Free: ", ms.free);
+    kprint(" in ", 7);
+    itoa(ms.free_blocks, buf, 10);
+    kprint(buf, 7);
+    print_kb(" blocks, largest ", ms.largest_free);
+    kprint("\n  Fragmentation: ", 7);
+    itoa(percent, buf, 10);
+    kprint(buf, 15);
+    kprint("%\n\n", 7);
+}
+
 // Command: list
 static void cmd_list(void) {
+    boot_wait("initramfs");
     size_t count = initramfs_get_count();
     
     kprint("\nLoaded programs: ", 7);
@@ -112,7 +166,9 @@ static void cmd_list(void) {
             kprint("  [", 7);
             itoa(i, buf, 10);
             kprint(buf, 7);
-            kprint("] Size: ", 7);
+            kprint("] ", 7);
+            kprint(prog->entry->name, 11);
+            kprint(" - ", 7);
             itoa(prog->size, buf, 10);
             kprint(buf, 7);
             kprint(" bytes\n", 7);
@@ -123,7 +179,7 @@ static void cmd_list(void) {
 
 // Command: run
 static void cmd_run(const char* args) {
-    // Parse the program index
+    // Parse the program name or index
     int index = 0;
     const char* p = args;
     
@@ -131,29 +187,34 @@ static void cmd_run(const char* args) {
     while (*p == ' ') p++;
     
     // Parse number
+    const char* name = p;
     while (*p >= '0' && *p <= '9') {
         index = index * 10 + (*p - '0');
         p++;
     }
+    boot_wait("initramfs");
+    if (*p != '\0' || p == name) {
+        index = initramfs_find(name);
+    }
     
     size_t count = initramfs_get_count();
     if (index >= 0 && (size_t)index < count) {
         struct program* prog = initramfs_get_program(index);
         if (prog && prog->size > 0) {
             kprint("\nRunning program ", 7);
-            char buf[32];
-            itoa(index, buf, 10);
-            kprint(buf, 7);
+            kprint(prog->entry->name, 7);
             kprint("...\n", 7);
             
-            nvm_execute(prog->data, prog->size, (uint16_t[]){CAP_ALL}, 1);
-            
-            kprint("Program finished.\n", 7);
+            if (initramfs_execute(index)) {
+                kprint("Program finished.\n", 7);
+            } else {
+                kprint("Error: Cannot load program\n", 12);
+            }
         } else {
             kprint("\nError: Invalid program\n", 12);
         }
     } else {
-        kprint("\nError: Invalid program index\n", 12);
+        kprint("\nError: No such program\n", 12);
     }
     kprint("\n", 7);
 }
@@ -167,6 +228,7 @@ static void cmd_progs(void) {
 
 // Command: isols
 static void cmd_isols(const char* args) {
+    boot_wait("iso");
     if (!iso9660_is_initialized()) {
         kprint("\nISO9660 filesystem is not initialized\n\n", 14);
         return;
@@ -188,6 +250,7 @@ static void cmd_isols(const char* args) {
 
 // Command: isocat
 static void cmd_isocat(const char* args) {
+    boot_wait("iso");
     if (!iso9660_is_initialized()) {
         kprint("\nISO9660 filesystem is not initialized\n\n", 14);
         return;
@@ -202,10 +265,8 @@ static void cmd_isocat(const char* args) {
         return;
     }
     
-    size_t size;
-    const void* data = iso9660_find_file(path, &size);
-    
-    if (!data) {
+    iso9660_file_t file;
+    if (!iso9660_open(path, &file)) {
         kprint("\nFile not found: ", 14);
         kprint(path, 14);
         kprint("\n\n", 14);
@@ -217,31 +278,39 @@ static void cmd_isocat(const char* args) {
     kprint(path, 11);
     kprint(" (", 7);
     char buf[32];
-    itoa(size, buf, 10);
+    itoa(file.size, buf, 10);
     kprint(buf, 7);
     kprint(" bytes)\n", 7);
     kprint("Content:\n", 7);
     
-    // Print file content (limit to first 1024 bytes for safety)
-    size_t print_size = size > 1024 ? 1024 : size;
-    const char* text = (const char*)data;
-    for (size_t i = 0; i < print_size; i++) {
-        char c[2];
-        c[0] = text[i];
-        c[1] = '\0';
-        
-        if (text[i] >= 32 && text[i] < 127) {
-            kprint(c, 7);
-        } else if (text[i] == '\n') {
-            kprint("\n", 7);
-        } else if (text[i] == '\t') {
-            kprint("    ", 7);
-        } else {
-            kprint(".", 7);
+    // Print file content (limit to first 1024 bytes for safety), read in
+    // chunks so multi-extent files need no contiguous copy
+    size_t print_size = file.size > 1024 ? 1024 : file.size;
+    char text[256];
+    for (size_t offset = 0; offset < print_size; offset += sizeof(text)) {
+        size_t want = print_size - offset < sizeof(text) ? print_size - offset : sizeof(text);
+        size_t got = iso9660_read_at(&file, offset, text, want);
+        for (size_t i = 0; i < got; i++) {
+            char c[2];
+            c[0] = text[i];
+            c[1] = '\0';
+            
+            if (text[i] >= 32 && text[i] < 127) {
+                kprint(c, 7);
+            } else if (text[i] == '\n') {
+                kprint("\n", 7);
+            } else if (text[i] == '\t') {
+                kprint("    ", 7);
+            } else {
+                kprint(".", 7);
+            }
+        }
+        if (got < want) {
+            break;
         }
     }
     
-    if (size > 1024) {
+    if (file.size > 1024) {
         kprint("\n... (truncated, showing first 1024 bytes)\n", 7);
     }
     
@@ -308,16 +377,24 @@ static void execute_command(const char* command) {
         cmd_info();
     } else if (strcmp(argv[0], "memtest") == 0) {
         cmd_memtest();
+    } else if (strcmp(argv[0], "ramfs") == 0) {
+        cmd_ramfs();
     } else if (strcmp(argv[0], "list") == 0) {
         cmd_list();
     } else if (strcmp(argv[0], "run") == 0) {
         if (argc > 1) {
             cmd_run(argv[1]);
         } else {
-            kprint("\nUsage: run <index>\n\n", 12);
+            kprint("\nUsage: run <name|index>\n\n", 12);
         }
     } else if (strcmp(argv[0], "progs") == 0) {
         cmd_progs();
+    } else if (strcmp(argv[0], "bench") == 0) {
+        bench_run(argc > 1 ? argv[1] : NULL);
+    } else if (strcmp(argv[0], "sync") == 0) {
+        if (vfs_sync() < 0) {
+            kprint("sync: write-back failed\n", 12);
+        }
     } else if (strcmp(argv[0], "pwd") == 0) {
         kprint(current_working_directory, 11);
         kprint("\n", 7);
@@ -336,6 +413,9 @@ static void execute_command(const char* command) {
     } else {
         // Try to execute as userspace program
         if (userspace_exists(argv[0])) {
+            // Programs may look at /bin or /initrd, which boot mounts late
+            boot_wait("iso");
+            boot_wait("initramfs");
             int ret = userspace_exec(argv[0], argc, argv);
             if (ret != 0) {
                 kprint("\nProgram exited with code ", 12);
@@ -5,9 +5,10 @@
 #include <core/drivers/serial.h>
 #include <usr/vfs.h>
 
-#define MAX_LOG_SIZE 4000
+#define SYSLOG_PATH "/var/log/system.log"
+#define SYSLOG_OLD_PATH "/var/log/system.log.old"
+#define MAX_LOG_SIZE (64 * 1024)
 
-static char log_buffer[MAX_LOG_SIZE];
 static size_t log_size = 0;
 
 static int syslog_strlen(const char* str) {
@@ -18,33 +19,52 @@ static int syslog_strlen(const char* str) {
     return len;
 }
 
+// Size of the log a previous boot left on disk, 0 if there is none
+static size_t syslog_previous_size(void) {
+    int h = vfs_open(SYSLOG_PATH, VFS_O_READ);
+    if (h < 0) {
+        return 0;
+    }
+    int size = vfs_seek(h, 0, VFS_SEEK_END);
+    vfs_close(h);
+    return size > 0 ? size : 0;
+}
+
+// A log kept from earlier boots is continued; once it takes half the limit
+// it moves to SYSLOG_OLD_PATH and a new one starts
 void syslog_init(void) {
-    log_buffer[0] = '\0';
-    log_size = 0;
-    
     const char* init_msg = "=== NovariaOS System Log ===\n";
-    int len = syslog_strlen(init_msg);
+    size_t previous = syslog_previous_size();
     
-    for (int i = 0; i < len && log_size < MAX_LOG_SIZE - 1; i++) {
-        log_buffer[log_size++] = init_msg[i];
+    if (previous > MAX_LOG_SIZE / 2) {
+        vfs_delete(SYSLOG_OLD_PATH);
+        vfs_rename(SYSLOG_PATH, SYSLOG_OLD_PATH);
+        previous = 0;
+    }
+
+    log_size = syslog_strlen(init_msg);
+    if (previous == 0) {
+        vfs_create(SYSLOG_PATH, init_msg, log_size);
+    } else {
+        vfs_append(SYSLOG_PATH, init_msg, log_size);
+        log_size += previous;
     }
-    log_buffer[log_size] = '\0';
-    vfs_create("/var/log/system.log", log_buffer, log_size);
 }
 
+// Appends only the new message; the log is not rewritten
 void syslog_write(const char* message) {
     if (!message) return;
     
-    int len = syslog_strlen(message);
-    
-    for (int i = 0; i < len && log_size < MAX_LOG_SIZE - 1; i++) {
-        log_buffer[log_size++] = message[i];
+    size_t len = syslog_strlen(message);
+    if (len > MAX_LOG_SIZE - log_size) {
+        len = MAX_LOG_SIZE - log_size;
     }
-    log_buffer[log_size] = '\0';
     
     serial_print(message);
     
-    vfs_create("/var/log/system.log", log_buffer, log_size);
+    if (len > 0 && vfs_append(SYSLOG_PATH, message, len) > 0) {
+        log_size += len;
+    }
 }
 
 void syslog_print(const char* message, int color) {
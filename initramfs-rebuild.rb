@@ -1,36 +1,153 @@
 #!/usr/bin/env ruby
 require 'fileutils'
+require 'zlib'
 
-def create_initramfs(app_dir, output_file)
+# Archive layout (little-endian), see core/fs/initramfs.h:
+#   header  magic[8] version:u16 header_size:u16 entry_size:u16 reserved:u16
+#           count:u32 size:u32 toc_crc32:u32 header_crc32:u32
+#   toc     count entries of name[64] offset:u32 size:u32 flags:u32 crc32:u32
+#           cap_count:u16 caps[7]:u16 stored_size:u32
+#   data    each entry on its own page boundary, LZ4 blocks for compressed ones
+#
+# Usage: initramfs-rebuild.rb [--lz4] [app_dir] [output]
+# --lz4 compresses every entry that gets smaller; the kernel decompresses an
+# entry the first time it runs or is read.
+MAGIC = "NVINITRD"
+VERSION = 2
+HEADER_SIZE = 32
+ENTRY_SIZE = 100
+ALIGN = 4096
+NAME_MAX = 64
+MAX_CAPS = 7
+FLAG_BOOT = 0x0001
+FLAG_LZ4 = 0x0002
+
+LZ4_MIN_MATCH = 4
+LZ4_LAST_LITERALS = 5
+LZ4_MATCH_LIMIT = 12
+LZ4_MAX_OFFSET = 65535
+
+CAPS = {
+  "FS_READ" => 0x0001, "FS_CREATE" => 0x0002, "FS_DELETE" => 0x0003,
+  "MEM_MGMT" => 0x0004, "DRV_ACCESS" => 0x0005, "PROC_MGMT" => 0x0006,
+  "CAPS_MGMT" => 0x0007, "DRV_GROUP_STORAGE" => 0x0100, "DRV_GROUP_VIDEO" => 0x0200,
+  "DRV_GROUP_AUDIO" => 0x0300, "DRV_GROUP_NETWORK" => 0x0400, "ALL" => 0xFFFF
+}
+
+def align(value)
+  (value + ALIGN - 1) / ALIGN * ALIGN
+end
+
+# Suggested capabilities come from an optional <app>.caps file next to the
+# binary: names from CAPS or numbers, separated by whitespace. Without one the
+# kernel runs the program with CAP_ALL, as before.
+def read_caps(bin_file)
+  caps_file = bin_file.sub(/\.bin\z/, ".caps")
+  return [] unless File.exist?(caps_file)
+
+  caps = File.read(caps_file).split.map do |word|
+    name = word.upcase.sub(/\ACAP_/, "")
+    CAPS[name] || Integer(word)
+  rescue ArgumentError
+    abort "Error: unknown capability #{word} in #{caps_file}"
+  end
+  abort "Error: more than #{MAX_CAPS} capabilities in #{caps_file}" if caps.size > MAX_CAPS
+  caps
+end
+
+def lz4_length(out, len)
+  while len >= 255
+    out << 255
+    len -= 255
+  end
+  out << len
+end
+
+def lz4_sequence(out, src, anchor, lit_len, offset, match_len)
+  token = [lit_len, 15].min << 4
+  token |= [match_len - LZ4_MIN_MATCH, 15].min if match_len > 0
+  out << token
+  lz4_length(out, lit_len - 15) if lit_len >= 15
+  out.concat(src[anchor, lit_len])
+  return if match_len == 0
+
+  out << (offset & 0xFF) << (offset >> 8)
+  lz4_length(out, match_len - LZ4_MIN_MATCH - 15) if match_len - LZ4_MIN_MATCH >= 15
+end
+
+# Greedy LZ4 block compressor. Like lz4_compress in core/kernel/lz4.c, it
+# matches against the last position of each 4-byte sequence.
+def lz4_compress(data)
+  src = data.bytes
+  out = []
+  table = {}
+  anchor = 0
+  pos = 0
+  while pos + LZ4_MATCH_LIMIT <= src.size
+    seq = data.byteslice(pos, 4)
+    ref = table[seq]
+    table[seq] = pos
+    if ref.nil? || pos - ref > LZ4_MAX_OFFSET
+      pos += 1
+      next
+    end
+    len = LZ4_MIN_MATCH
+    len += 1 while pos + len < src.size - LZ4_LAST_LITERALS && src[ref + len] == src[pos + len]
+    lz4_sequence(out, src, anchor, pos - anchor, pos - ref, len)
+    pos += len
+    anchor = pos
+  end
+  lz4_sequence(out, src, anchor, src.size - anchor, 0, 0)
+  out.pack("C*")
+end
+
+def create_initramfs(app_dir, output_file, compress)
   bin_files = Dir.glob(File.join(app_dir, "*.bin")).sort
   puts "Found #{bin_files.size} .bin files in #{app_dir}"
-  
+
+  offset = align(HEADER_SIZE + ENTRY_SIZE * bin_files.size)
+  toc = "".b
+  data = "".b
   total_size = 0
-  File.open(output_file, 'wb') do |out|
-    bin_files.each do |bin_file|
-      data = File.binread(bin_file)
-      size = data.bytesize
-      
-      puts "Adding #{File.basename(bin_file)} (#{size} bytes)"
-      
-      out.write([size].pack('N'))
-      
-      out.write(data)
-      
-      total_size += 4 + size
-      
-      padding = (4 - (size % 4)) % 4
-      if padding > 0
-        out.write("\0" * padding)
-        total_size += padding
-        puts "  Added #{padding} bytes padding"
+  bin_files.each do |bin_file|
+    name = File.basename(bin_file, ".bin")
+    abort "Error: name #{name} is longer than #{NAME_MAX - 1} bytes" if name.bytesize >= NAME_MAX
+    contents = File.binread(bin_file)
+    caps = read_caps(bin_file)
+    flags = FLAG_BOOT
+    stored = contents
+    if compress
+      packed = lz4_compress(contents)
+      if packed.bytesize < contents.bytesize
+        stored = packed
+        flags |= FLAG_LZ4
       end
     end
+
+    puts "Adding #{name} (#{contents.bytesize} bytes#{stored.equal?(contents) ? "" : ", #{stored.bytesize} compressed"} at #{offset}#{caps.empty? ? "" : ", caps #{caps.join(' ')}"})"
+
+    # The checksum covers the bytes as stored so the kernel can check them
+    # without decompressing
+    toc << [name, offset, contents.bytesize, flags, Zlib.crc32(stored), caps.size].pack("a#{NAME_MAX}VVVVv")
+    toc << (caps + [0] * (MAX_CAPS - caps.size)).pack("v*")
+    toc << [stored.bytesize].pack("V")
+
+    data << "\0" * (offset - HEADER_SIZE - ENTRY_SIZE * bin_files.size - data.bytesize)
+    data << stored
+    total_size += contents.bytesize
+    offset = align(offset + stored.bytesize)
   end
-  
-  puts "Created initramfs: #{output_file} (#{File.size(output_file)} bytes, total with headers: #{total_size} bytes)"
+
+  size = HEADER_SIZE + toc.bytesize + data.bytesize
+  header = [MAGIC, VERSION, HEADER_SIZE, ENTRY_SIZE, 0, bin_files.size, size, Zlib.crc32(toc)].pack("a8vvvvVVV")
+  header << [Zlib.crc32(header)].pack("V")
+
+  File.binwrite(output_file, header + toc + data)
+  puts "Created initramfs: #{output_file} (#{size} bytes, #{total_size} bytes of programs)"
 end
 
+compress = !ARGV.delete("--lz4").nil?
+
 if ARGV[0] != nil
   app_dir = ARGV[0]
 else
@@ -50,4 +167,4 @@ end
 
 FileUtils.mkdir_p(File.dirname(output_file))
 
-create_initramfs(app_dir, output_file)
\ No newline at end of file
+create_initramfs(app_dir, output_file, compress)
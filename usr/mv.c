@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: LGPL-3.0-or-later
+
+#include "vfs.h"
+#include <core/kernel/kstd.h>
+
+int mv_main(int argc, char** argv) {
+    if (argc < 3) {
+        kprint("\nUsage: mv <source> <destination>\n\n", 12);
+        return 1;
+    }
+    
+    int result = vfs_rename(argv[1], argv[2]);
+    
+    if (result >= 0) {
+        kprint("\n'", 7);
+        kprint(argv[1], 11);
+        kprint("' moved to '", 7);
+        kprint(argv[2], 11);
+        kprint("'\n\n", 7);
+        return 0;
+    }
+    
+    kprint("\nError: ", 12);
+    if (result == -2) {
+        kprint("destination '", 12);
+        kprint(argv[2], 12);
+        kprint("' already exists\n\n", 12);
+    } else if (result == -3) {
+        kprint("cannot move a directory into itself\n\n", 12);
+    } else {
+        kprint("cannot move '", 12);
+        kprint(argv[1], 12);
+        kprint("' to '", 12);
+        kprint(argv[2], 12);
+        kprint("'\n\n", 12);
+    }
+    return 1;
+}
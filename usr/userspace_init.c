@@ -9,6 +9,7 @@ extern int clear_main(int argc, char** argv);
 extern int ls_main(int argc, char** argv);
 extern int cat_main(int argc, char** argv);
 extern int rm_main(int argc, char** argv);
+extern int mv_main(int argc, char** argv);
 extern int write_main(int argc, char** argv);
 extern int nova_main(int argc, char** argv);
 extern int uname_main(int argc, char** argv);
@@ -22,6 +23,7 @@ void userspace_init_programs(void) {
     userspace_register("ls", ls_main);
     userspace_register("cat", cat_main);
     userspace_register("rm", rm_main);
+    userspace_register("mv", mv_main);
     userspace_register("write", write_main);
     userspace_register("nova", nova_main);
     userspace_register("uname", uname_main);
@@ -2,53 +2,374 @@
 // VFS in userspace
 
 #include "vfs.h"
-#include <lib/nc/stdlib.h>
+#include <core/kernel/mem.h>
+#include <core/fs/pagecache.h>
 
 static vfs_file_t files[MAX_FILES];
 
-// Helper function to compare strings
-static int vfs_strcmp(const char* str1, const char* str2) {
-    while (*str1 && (*str1 == *str2)) {
-        str1++;
-        str2++;
+// Dentry index keyed by (parent slot, name): open addressing with linear probing
+#define VFS_HASH_SIZE (MAX_FILES * 2)    // Power of two, load factor <= 0.5
+#define VFS_HASH_EMPTY -1
+#define VFS_HASH_TOMB  -2
+
+static int16_t hash_table[VFS_HASH_SIZE];
+static int hash_tombs = 0;
+
+typedef struct {
+    int16_t slot;           // Open file or VFS_NONE when the handle is free
+    uint8_t flags;          // VFS_O_*
+    uint32_t offset;
+} vfs_handle_t;
+
+static vfs_handle_t handles[VFS_MAX_HANDLES];
+
+typedef struct {
+    const vfs_driver_t* driver;
+    int store;              // Page cache store of the mounted files
+    uint32_t changes;       // Entries made dirty or removed, for write-back
+} vfs_mount_t;
+
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static int mount_count = 0;
+
+// Contents of empty files
+static char empty_data[1] = { '\0' };
+
+// Unused slots, popped by create/mkdir and pushed back by delete
+static int16_t free_slots[MAX_FILES];
+static int free_top = 0;
+
+// Helper function to copy memory
+static void vfs_memcpy(void* dest, const void* src, size_t n) {
+    unsigned char* d = (unsigned char*)dest;
+    const unsigned char* s = (const unsigned char*)src;
+    while (n--) {
+        *d++ = *s++;
+    }
+}
+
+// Does the NUL-terminated name equal the len bytes at part?
+static bool vfs_name_eq(const char* name, const char* part, int len) {
+    for (int i = 0; i < len; i++) {
+        if (name[i] != part[i]) {
+            return false;
+        }
     }
-    return *(unsigned char*)str1 - *(unsigned char*)str2;
+    return name[len] == '\0';
 }
 
-// Helper function to copy string
-static void vfs_strcpy(char* dest, const char* src) {
-    while (*src) {
-        *dest++ = *src++;
+// FNV-1a over the parent slot and the name
+static uint32_t vfs_hash(int parent, const char* name, int len) {
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ (parent & 0xFF)) * 16777619u;
+    hash = (hash ^ ((parent >> 8) & 0xFF)) * 16777619u;
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)name[i];
+        hash *= 16777619u;
     }
-    *dest = '\0';
+    return hash & (VFS_HASH_SIZE - 1);
 }
 
-// Helper function to get string length
-static int vfs_strlen(const char* str) {
+static int vfs_name_len(const char* name) {
     int len = 0;
-    while (str[len] != '\0') {
+    while (name[len] != '\0') {
         len++;
     }
     return len;
 }
 
-// Helper function to copy memory
-static void vfs_memcpy(void* dest, const void* src, size_t n) {
-    unsigned char* d = (unsigned char*)dest;
-    const unsigned char* s = (const unsigned char*)src;
-    while (n--) {
-        *d++ = *s++;
+// Let the driver fill in a mounted directory before it is first looked into
+static void vfs_populate(int dir) {
+    vfs_file_t* d = &files[dir];
+    if (d->mount == VFS_NONE || d->populated || d->type != VFS_TYPE_DIR) {
+        return;
+    }
+    d->populated = true;    // Set first, populate looks up children itself
+    mounts[d->mount].driver->populate(dir, d->node);
+}
+
+static bool vfs_writable(int mount) {
+    return mount != VFS_NONE && mounts[mount].driver->sync != NULL;
+}
+
+// Record a change for the driver to write back
+static void vfs_touch(int slot, uint8_t dirty) {
+    int mount = files[slot].mount;
+    if (vfs_writable(mount)) {
+        files[slot].dirty |= dirty;
+        mounts[mount].changes++;
+    }
+}
+
+// The entry leaves its writable mount: drop what the driver stored for it
+static void vfs_forget(int slot) {
+    int mount = files[slot].mount;
+    if (!vfs_writable(mount)) {
+        return;
+    }
+    if (files[slot].node != VFS_NEW_NODE) {
+        mounts[mount].driver->remove(files[slot].node);
+        files[slot].node = VFS_NEW_NODE;
+    }
+    files[slot].dirty = 0;
+    mounts[mount].changes++;
+}
+
+// Returns the child of parent called name[0..len), or -1
+static int vfs_lookup_child(int parent, const char* name, int len) {
+    vfs_populate(parent);
+    for (uint32_t h = vfs_hash(parent, name, len), n = 0; n < VFS_HASH_SIZE; h = (h + 1) & (VFS_HASH_SIZE - 1), n++) {
+        int slot = hash_table[h];
+        if (slot == VFS_HASH_EMPTY) {
+            return -1;
+        }
+        if (slot >= 0 && files[slot].parent == parent && vfs_name_eq(files[slot].name, name, len)) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+static void vfs_hash_insert(int slot) {
+    uint32_t h = vfs_hash(files[slot].parent, files[slot].name, vfs_name_len(files[slot].name));
+    while (hash_table[h] >= 0) {
+        h = (h + 1) & (VFS_HASH_SIZE - 1);
+    }
+    if (hash_table[h] == VFS_HASH_TOMB) {
+        hash_tombs--;
+    }
+    hash_table[h] = slot;
+}
+
+static void vfs_hash_rebuild(void) {
+    for (int i = 0; i < VFS_HASH_SIZE; i++) {
+        hash_table[i] = VFS_HASH_EMPTY;
+    }
+    hash_tombs = 0;
+    for (int i = 0; i < MAX_FILES; i++) {
+        if (files[i].used && i != VFS_ROOT) {
+            vfs_hash_insert(i);
+        }
+    }
+}
+
+// Must be called while the entry still has its old parent and name
+static void vfs_hash_remove(int slot) {
+    uint32_t h = vfs_hash(files[slot].parent, files[slot].name, vfs_name_len(files[slot].name));
+    while (hash_table[h] != slot) {
+        h = (h + 1) & (VFS_HASH_SIZE - 1);
+    }
+    hash_table[h] = VFS_HASH_TOMB;
+    hash_tombs++;
+}
+
+// Removed entries leave tombstones behind; rebuild once they pile up so
+// misses keep terminating early. Only call with the index consistent.
+static void vfs_hash_compact(void) {
+    if (hash_tombs > VFS_HASH_SIZE / 4) {
+        vfs_hash_rebuild();
+    }
+}
+
+static void vfs_link(int slot, int parent) {
+    files[slot].parent = parent;
+    files[slot].prev_sibling = VFS_NONE;
+    files[slot].next_sibling = files[parent].first_child;
+    if (files[parent].first_child != VFS_NONE) {
+        files[files[parent].first_child].prev_sibling = slot;
+    }
+    files[parent].first_child = slot;
+}
+
+static void vfs_unlink(int slot) {
+    int parent = files[slot].parent;
+    if (files[slot].prev_sibling != VFS_NONE) {
+        files[files[slot].prev_sibling].next_sibling = files[slot].next_sibling;
+    } else {
+        files[parent].first_child = files[slot].next_sibling;
+    }
+    if (files[slot].next_sibling != VFS_NONE) {
+        files[files[slot].next_sibling].prev_sibling = files[slot].prev_sibling;
+    }
+}
+
+// Take a free slot for name[0..len) under parent; the caller fills in the data
+static int vfs_alloc_slot(int parent, const char* name, int len, vfs_entry_type_t type) {
+    if (free_top == 0) {
+        return -1;
+    }
+
+    int slot = free_slots[--free_top];
+    vfs_memcpy(files[slot].name, name, len);
+    files[slot].name[len] = '\0';
+    files[slot].size = 0;
+    files[slot].used = true;
+    files[slot].type = type;
+    files[slot].first_child = VFS_NONE;
+    files[slot].store = VFS_NONE;
+    files[slot].dirty = 0;
+
+    // New entries belong to the parent's mount; a new directory has
+    // nothing stored to list
+    files[slot].mount = files[parent].mount;
+    files[slot].populated = true;
+    files[slot].node = VFS_NEW_NODE;
+    vfs_link(slot, parent);
+    vfs_hash_insert(slot);
+    return slot;
+}
+
+// Store size bytes as the file contents. The first extent is exactly the
+// file size; rewrites that outgrow it double the capacity so append-style
+// writers (syslog) do not reallocate on every call.
+static int vfs_set_data(int slot, const char* data, size_t size) {
+    vfs_file_t* file = &files[slot];
+
+    if (size > file->capacity || (file->capacity > 64 && size < file->capacity / 4)) {
+        size_t capacity = size;
+        if (file->capacity && size > file->capacity && file->capacity * 2 > size) {
+            capacity = file->capacity * 2;
+        }
+        if (capacity > MAX_FILE_SIZE) {
+            capacity = MAX_FILE_SIZE;
+        }
+
+        char* extent = NULL;
+        if (capacity) {
+            extent = (char*)kmalloc(capacity);
+            if (!extent) {
+                return -1;
+            }
+        }
+
+        // Copy before freeing, data may point into the old extent
+        vfs_memcpy(extent, data, size);
+        if (file->data) {
+            kfree(file->data);
+        }
+        file->data = extent;
+        file->capacity = capacity;
+    } else {
+        vfs_memcpy(file->data, data, size);
+    }
+
+    file->size = size;
+    file->store = VFS_NONE;    // Replaced contents need no copy from the store
+    vfs_touch(slot, VFS_DIRTY_DATA);
+    return 0;
+}
+
+// Copy a store-backed file into its own extent before it is modified
+static int vfs_unshare(int slot) {
+    vfs_file_t* file = &files[slot];
+    if (file->store == VFS_NONE) {
+        return 0;
+    }
+
+    char* extent = NULL;
+    if (file->size) {
+        extent = (char*)kmalloc(file->size);
+        if (!extent) {
+            return -1;
+        }
+        if (pcache_read(file->store, file->store_file, file->size, 0, extent, file->size) != file->size) {
+            kfree(extent);
+            return -1;
+        }
+    }
+
+    file->data = extent;
+    file->capacity = file->size;
+    file->store = VFS_NONE;
+    return 0;
+}
+
+// Make room for size bytes, keeping the contents. Capacity doubles so a
+// sequence of appends costs O(bytes appended) amortized.
+static int vfs_reserve(int slot, size_t size) {
+    vfs_file_t* file = &files[slot];
+
+    if (vfs_unshare(slot) < 0) {
+        return -1;
+    }
+    if (size <= file->capacity) {
+        return 0;
+    }
+    if (size > MAX_FILE_SIZE) {
+        return -1;
+    }
+
+    size_t capacity = file->capacity * 2;
+    if (capacity < size) {
+        capacity = size;
+    }
+    if (capacity > MAX_FILE_SIZE) {
+        capacity = MAX_FILE_SIZE;
+    }
+
+    char* extent = (char*)kmalloc(capacity);
+    if (!extent) {
+        return -1;
+    }
+
+    if (file->data) {
+        vfs_memcpy(extent, file->data, file->size);
+        kfree(file->data);
+    }
+    file->data = extent;
+    file->capacity = capacity;
+    return 0;
+}
+
+// Walk path one component at a time. On success returns the parent directory
+// slot and leaves the last component in *leaf/*leaf_len (empty for the root).
+// With create set, missing intermediate directories are made on the way.
+static int vfs_walk(const char* path, const char** leaf, int* leaf_len, bool create) {
+    int dir = VFS_ROOT;
+
+    while (*path == '/') path++;
+
+    for (;;) {
+        int len = 0;
+        while (path[len] && path[len] != '/') len++;
+        if (len >= MAX_FILENAME) {
+            return -1;
+        }
+
+        const char* next = path + len;
+        while (*next == '/') next++;
+
+        if (*next == '\0') {
+            *leaf = path;
+            *leaf_len = len;
+            return dir;
+        }
+
+        int child = vfs_lookup_child(dir, path, len);
+        if (child < 0 && create) {
+            child = vfs_alloc_slot(dir, path, len, VFS_TYPE_DIR);
+            if (child >= 0) {
+                vfs_touch(child, VFS_DIRTY_META);
+            }
+        }
+        if (child < 0 || files[child].type != VFS_TYPE_DIR) {
+            return -1;
+        }
+
+        dir = child;
+        path = next;
     }
 }
 
-static int vfs_strncmp(const char* s1, const char* s2, int n) {
-    while (n > 0 && *s1 && (*s1 == *s2)) {
-        s1++;
-        s2++;
-        n--;
+// Slot of the entry at path, or -1
+static int vfs_resolve(const char* path) {
+    const char* leaf;
+    int len;
+    int dir = vfs_walk(path, &leaf, &len, false);
+    if (dir < 0) {
+        return -1;
     }
-    if (n == 0) return 0;
-    return *(unsigned char*)s1 - *(unsigned char*)s2;
+    return len == 0 ? dir : vfs_lookup_child(dir, leaf, len);
 }
 
 void vfs_init(void) {
@@ -56,9 +377,36 @@ void vfs_init(void) {
         files[i].used = false;
         files[i].size = 0;
         files[i].name[0] = '\0';
-        files[i].data[0] = '\0';
+        files[i].data = NULL;
+        files[i].capacity = 0;
+        files[i].opens = 0;
+        files[i].store = VFS_NONE;
+        files[i].mount = VFS_NONE;
+        files[i].populated = false;
+        files[i].dirty = 0;
+        files[i].node = VFS_NEW_NODE;
         files[i].type = VFS_TYPE_FILE;
+        files[i].parent = VFS_NONE;
+        files[i].first_child = VFS_NONE;
+        files[i].next_sibling = VFS_NONE;
+        files[i].prev_sibling = VFS_NONE;
+        // Pushed in reverse so slots are handed out from 1 upwards
+        free_slots[i] = MAX_FILES - 1 - i;
     }
+    free_top = MAX_FILES - 1;   // Slot 0 is the root
+
+    for (int i = 0; i < VFS_MAX_HANDLES; i++) {
+        handles[i].slot = VFS_NONE;
+    }
+
+    files[VFS_ROOT].used = true;
+    files[VFS_ROOT].type = VFS_TYPE_DIR;
+
+    for (int i = 0; i < VFS_HASH_SIZE; i++) {
+        hash_table[i] = VFS_HASH_EMPTY;
+    }
+    hash_tombs = 0;
+    mount_count = 0;
 
     vfs_mkdir("/bin");
     vfs_mkdir("/bin/Nutils");
@@ -90,171 +438,463 @@ void vfs_init(void) {
 }
 
 int vfs_mkdir(const char* dirname) {
-    if (vfs_strlen(dirname) >= MAX_FILENAME) {
+    const char* leaf;
+    int len;
+    int dir = vfs_walk(dirname, &leaf, &len, true);
+    if (dir < 0) {
         return -1;
     }
-    
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, dirname) == 0) {
-            if (files[i].type == VFS_TYPE_DIR) {
-                return i;
-            }
-            return -2;
-        }
+    if (len == 0) {
+        return dir;
     }
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!files[i].used) {
-            vfs_strcpy(files[i].name, dirname);
-            files[i].size = 0;
-            files[i].used = true;
-            files[i].type = VFS_TYPE_DIR;
-            return i;
-        }
+    int slot = vfs_lookup_child(dir, leaf, len);
+    if (slot >= 0) {
+        return files[slot].type == VFS_TYPE_DIR ? slot : -2;
     }
     
-    return -3;
+    slot = vfs_alloc_slot(dir, leaf, len, VFS_TYPE_DIR);
+    if (slot < 0) {
+        return -3;
+    }
+    vfs_touch(slot, VFS_DIRTY_META);
+    return slot;
 }
 
-int vfs_create(const char* filename, const char* data, size_t size) {
-    if (vfs_strlen(filename) >= MAX_FILENAME) {
+// Slot of the regular file at filename, created if missing
+static int vfs_file_slot(const char* filename) {
+    const char* leaf;
+    int len;
+    int dir = vfs_walk(filename, &leaf, &len, true);
+    if (dir < 0 || len == 0) {
         return -1;
     }
     
+    int slot = vfs_lookup_child(dir, leaf, len);
+    if (slot >= 0 && files[slot].type == VFS_TYPE_DIR) {
+        return -4;
+    }
+    
+    if (slot < 0) {
+        slot = vfs_alloc_slot(dir, leaf, len, VFS_TYPE_FILE);
+        if (slot < 0) {
+            return -3;
+        }
+        vfs_touch(slot, VFS_DIRTY_META | VFS_DIRTY_DATA);
+    }
+    return slot;
+}
+
+int vfs_create(const char* filename, const char* data, size_t size) {
     if (size > MAX_FILE_SIZE) {
         return -2;
     }
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-            if (files[i].type == VFS_TYPE_DIR) {
-                return -4;
-            }
-            vfs_memcpy(files[i].data, data, size);
-            files[i].size = size;
-            return i;
-        }
+    int slot = vfs_file_slot(filename);
+    if (slot < 0) {
+        return slot;
     }
     
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!files[i].used) {
-            vfs_strcpy(files[i].name, filename);
-            vfs_memcpy(files[i].data, data, size);
-            files[i].size = size;
-            files[i].used = true;
-            files[i].type = VFS_TYPE_FILE;
-            return i;
-        }
+    if (vfs_set_data(slot, data, size) < 0) {
+        return -5;
+    }
+    return slot;
+}
+
+// Create a file whose contents stay in a page cache store. Nothing is
+// copied until the file is written.
+int vfs_create_backed(const char* filename, int store, uint32_t file, size_t size) {
+    if (store < 0) {
+        return -1;
+    }
+    if (size > MAX_FILE_SIZE) {
+        return -2;
     }
     
-    return -3;
+    int slot = vfs_file_slot(filename);
+    if (slot < 0) {
+        return slot;
+    }
+    
+    if (files[slot].data) {
+        kfree(files[slot].data);
+    }
+    files[slot].data = NULL;
+    files[slot].capacity = 0;
+    files[slot].size = size;
+    files[slot].store = store;
+    files[slot].store_file = file;
+    return slot;
 }
 
 const char* vfs_read(const char* filename, size_t* size) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-            if (size) *size = files[i].size;
-            return files[i].data;
+    int slot = vfs_resolve(filename);
+    if (slot >= 0) {
+        vfs_file_t* file = &files[slot];
+        if (file->store != VFS_NONE && file->size) {
+            // Zero-copy when the store keeps the file contiguous in memory
+            const char* mapped = (const char*)pcache_map(file->store, file->store_file, file->size);
+            if (mapped) {
+                if (size) *size = file->size;
+                return mapped;
+            }
+            if (vfs_unshare(slot) < 0) {
+                if (size) *size = 0;
+                return NULL;
+            }
         }
+        if (size) *size = file->size;
+        return file->data ? file->data : empty_data;
     }
     
     if (size) *size = 0;
     return NULL;
 }
 
+// Directories have to be empty and files closed
 int vfs_delete(const char* filename) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-            files[i].used = false;
-            files[i].size = 0;
-            files[i].name[0] = '\0';
-            files[i].data[0] = '\0';
-            return 0;
+    int slot = vfs_resolve(filename);
+    if (slot < 0 || slot == VFS_ROOT) {
+        return -1; // File not found
+    }
+    vfs_populate(slot);
+    if (files[slot].first_child != VFS_NONE) {
+        return -2;
+    }
+    if (files[slot].opens) {
+        return -3;
+    }
+    
+    vfs_forget(slot);
+    files[slot].used = false;
+    vfs_hash_remove(slot);
+    vfs_unlink(slot);
+    if (files[slot].data) {
+        kfree(files[slot].data);
+    }
+    files[slot].data = NULL;
+    files[slot].capacity = 0;
+    files[slot].size = 0;
+    files[slot].store = VFS_NONE;
+    files[slot].name[0] = '\0';
+    files[slot].parent = VFS_NONE;
+    free_slots[free_top++] = slot;
+    vfs_hash_compact();
+    return 0;
+}
+
+// Re-links one dentry; descendants move with it untouched. The destination's
+// parent directory must exist and the destination name must be free.
+int vfs_rename(const char* from, const char* to) {
+    int slot = vfs_resolve(from);
+    if (slot < 0 || slot == VFS_ROOT) {
+        return -1;
+    }
+    
+    const char* leaf;
+    int len;
+    int dir = vfs_walk(to, &leaf, &len, false);
+    if (dir < 0 || len == 0) {
+        return -1;
+    }
+    if (vfs_lookup_child(dir, leaf, len) >= 0) {
+        return -2;
+    }
+    
+    // A directory cannot be moved below itself
+    for (int up = dir; up != VFS_NONE; up = files[up].parent) {
+        if (up == slot) {
+            return -3;
+        }
+    }
+
+    // Files crossing a writable mount are stored again on the other side;
+    // directories would take their whole subtree along and stay put
+    int old_mount = files[slot].mount;
+    int new_mount = files[dir].mount;
+    if (old_mount != new_mount && files[slot].type == VFS_TYPE_FILE) {
+        if ((vfs_writable(old_mount) || vfs_writable(new_mount)) && vfs_unshare(slot) < 0) {
+            return -5;
         }
+        vfs_forget(slot);
+        files[slot].mount = new_mount;
+        vfs_touch(slot, VFS_DIRTY_META | VFS_DIRTY_DATA);
+    } else if (old_mount != new_mount && (vfs_writable(old_mount) || vfs_writable(new_mount))) {
+        return -4;
     }
     
-    return -1; // File not found
+    vfs_hash_remove(slot);
+    vfs_unlink(slot);
+    vfs_memcpy(files[slot].name, leaf, len);
+    files[slot].name[len] = '\0';
+    vfs_link(slot, dir);
+    vfs_hash_insert(slot);
+    vfs_hash_compact();
+    vfs_touch(slot, VFS_DIRTY_META);
+    return slot;
 }
 
 bool vfs_exists(const char* filename) {
+    return vfs_resolve(filename) >= 0;
+}
+
+bool vfs_is_dir(const char* path) {
+    int slot = vfs_resolve(path);
+    return slot >= 0 && files[slot].type == VFS_TYPE_DIR;
+}
+
+// Entries excluding the root directory
+int vfs_count(void) {
+    return MAX_FILES - 1 - free_top;
+}
+
+vfs_file_t* vfs_get_files(void) {
+    return files;
+}
+
+// Attach a driver to the directory at path (created if missing). Entries
+// already in the directory stay and shadow the driver's ones.
+int vfs_mount(const char* path, const vfs_driver_t* driver, int store, uint32_t root) {
+    if (mount_count == VFS_MAX_MOUNTS || store < 0) {
+        return -1;
+    }
+
+    int dir = vfs_mkdir(path);
+    if (dir < 0) {
+        return -1;
+    }
+    if (files[dir].mount != VFS_NONE) {
+        return -2;
+    }
+
+    mounts[mount_count].driver = driver;
+    mounts[mount_count].store = store;
+    mounts[mount_count].changes = 0;
+    files[dir].mount = mount_count++;
+    files[dir].populated = false;
+    files[dir].node = root;
+    return dir;
+}
+
+// Called by a driver's populate. Subdirectories belong to the same mount and
+// are populated when first used; files read from the mount's store.
+int vfs_mount_add(int dir, const char* name, vfs_entry_type_t type, uint32_t node, size_t size) {
+    int len = vfs_name_len(name);
+    if (len == 0 || len >= MAX_FILENAME || size > MAX_FILE_SIZE) {
+        return -1;
+    }
+    if (vfs_lookup_child(dir, name, len) >= 0) {
+        return -2;
+    }
+
+    int slot = vfs_alloc_slot(dir, name, len, type);
+    if (slot < 0) {
+        return -3;
+    }
+
+    // Listed entries are already stored
+    int mount = files[dir].mount;
+    files[slot].node = node;
+    if (type == VFS_TYPE_DIR) {
+        files[slot].populated = false;
+    } else {
+        files[slot].size = size;
+        files[slot].store = mounts[mount].store;
+        files[slot].store_file = node;
+    }
+    return slot;
+}
+
+// Bytes taken by the dentry table and by file extents on the heap, and
+// bytes of file contents left in page cache stores
+void vfs_memory_usage(size_t* table_bytes, size_t* data_bytes, size_t* backed_bytes) {
+    size_t data = 0;
+    size_t backed = 0;
     for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, filename) == 0) {
-            return true;
+        if (files[i].used) {
+            data += files[i].capacity;
+            if (files[i].store != VFS_NONE) {
+                backed += files[i].size;
+            }
         }
     }
-    return false;
+
+    if (table_bytes) *table_bytes = sizeof(files) + sizeof(hash_table) + sizeof(free_slots);
+    if (data_bytes) *data_bytes = data;
+    if (backed_bytes) *backed_bytes = backed;
 }
 
-bool vfs_is_dir(const char* path) {
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used && vfs_strcmp(files[i].name, path) == 0) {
-            return files[i].type == VFS_TYPE_DIR;
+const vfs_driver_t* vfs_mount_driver(int mount) {
+    if (mount < 0 || mount >= mount_count) {
+        return NULL;
+    }
+    return mounts[mount].driver;
+}
+
+uint32_t vfs_mount_changes(const vfs_driver_t* driver) {
+    uint32_t changes = 0;
+    for (int i = 0; i < mount_count; i++) {
+        if (mounts[i].driver == driver) {
+            changes += mounts[i].changes;
         }
     }
-    return false;
+    return changes;
 }
 
-int vfs_count(void) {
-    int count = 0;
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (files[i].used) {
-            count++;
+// A driver mounted several times is synced once
+int vfs_sync(void) {
+    int result = 0;
+    for (int i = 0; i < mount_count; i++) {
+        const vfs_driver_t* driver = mounts[i].driver;
+        bool seen = false;
+        for (int j = 0; j < i; j++) {
+            seen |= mounts[j].driver == driver;
+        }
+        if (driver->sync && !seen && driver->sync(true) < 0) {
+            result = -1;
         }
     }
-    return count;
+    return result;
 }
 
-vfs_file_t* vfs_get_files(void) {
-    return files;
+// Iterate a directory: first child slot of dirname, or -1 if it is empty or missing
+int vfs_dir_first(const char* dirname) {
+    int dir = vfs_resolve(dirname);
+    if (dir < 0 || files[dir].type != VFS_TYPE_DIR) {
+        return -1;
+    }
+    vfs_populate(dir);
+    return files[dir].first_child;
 }
 
-void vfs_list_dir(const char* dirname) {
-    int dir_len = vfs_strlen(dirname);
-    
-    char normalized_dir[MAX_FILENAME];
-    vfs_strcpy(normalized_dir, dirname);
-    if (dir_len > 1 && normalized_dir[dir_len - 1] == '/') {
-        normalized_dir[dir_len - 1] = '\0';
-        dir_len--;
+int vfs_dir_next(int slot) {
+    return files[slot].next_sibling;
+}
+
+int vfs_open(const char* path, int flags) {
+    int slot = vfs_resolve(path);
+    if (slot < 0 && (flags & VFS_O_CREATE)) {
+        slot = vfs_create(path, NULL, 0);
     }
-    
-    for (int i = 0; i < MAX_FILES; i++) {
-        if (!files[i].used) continue;
-        
-        const char* name = files[i].name;
-        bool should_show = false;
-        const char* display_name = name;
-        
-        if (dir_len == 1 && normalized_dir[0] == '/') {
-            if (name[0] == '/' && name[1] != '\0') {
-                int slash_count = 0;
-                for (int j = 1; name[j] != '\0'; j++) {
-                    if (name[j] == '/') slash_count++;
-                }
-                if (slash_count == 0) {
-                    should_show = true;
-                    display_name = name + 1;
-                }
-            }
-        } else {
-            int name_len = vfs_strlen(name);
-            if (name_len > dir_len && 
-                name[dir_len] == '/' &&
-                vfs_strncmp(name, normalized_dir, dir_len) == 0) {
-                int slash_count = 0;
-                for (int j = dir_len + 1; name[j] != '\0'; j++) {
-                    if (name[j] == '/') slash_count++;
-                }
-                if (slash_count == 0) {
-                    should_show = true;
-                    display_name = name + dir_len + 1;
-                }
+    if (slot < 0 || files[slot].type == VFS_TYPE_DIR) {
+        return -1;
+    }
+
+    for (int h = 0; h < VFS_MAX_HANDLES; h++) {
+        if (handles[h].slot == VFS_NONE) {
+            if (flags & VFS_O_TRUNC) {
+                files[slot].store = VFS_NONE;
+                files[slot].size = 0;
+                vfs_touch(slot, VFS_DIRTY_DATA);
             }
+            handles[h].slot = slot;
+            handles[h].flags = flags;
+            handles[h].offset = 0;
+            files[slot].opens++;
+            return h;
         }
-        
-        if (should_show) {
-            // Use external print functions since we're in userspace
-            // This will be handled by ls command
-        }
     }
+
+    return -2; // No free handles
+}
+
+static vfs_handle_t* vfs_handle(int handle) {
+    if (handle < 0 || handle >= VFS_MAX_HANDLES || handles[handle].slot == VFS_NONE) {
+        return NULL;
+    }
+    return &handles[handle];
+}
+
+int vfs_close(int handle) {
+    vfs_handle_t* h = vfs_handle(handle);
+    if (!h) {
+        return -1;
+    }
+
+    files[h->slot].opens--;
+    h->slot = VFS_NONE;
+    return 0;
+}
+
+int vfs_fread(int handle, void* buffer, size_t count) {
+    vfs_handle_t* h = vfs_handle(handle);
+    if (!h || !(h->flags & VFS_O_READ)) {
+        return -1;
+    }
+
+    vfs_file_t* file = &files[h->slot];
+    if (h->offset >= file->size) {
+        return 0;
+    }
+    if (count > file->size - h->offset) {
+        count = file->size - h->offset;
+    }
+
+    if (file->store != VFS_NONE) {
+        count = pcache_read(file->store, file->store_file, file->size, h->offset, buffer, count);
+    } else {
+        vfs_memcpy(buffer, file->data + h->offset, count);
+    }
+    h->offset += count;
+    return count;
+}
+
+// Writing past the end zero-fills the gap
+int vfs_fwrite(int handle, const void* buffer, size_t count) {
+    vfs_handle_t* h = vfs_handle(handle);
+    if (!h || !(h->flags & (VFS_O_WRITE | VFS_O_APPEND))) {
+        return -1;
+    }
+
+    vfs_file_t* file = &files[h->slot];
+    size_t offset = (h->flags & VFS_O_APPEND) ? file->size : h->offset;
+    if (offset > MAX_FILE_SIZE || count > MAX_FILE_SIZE - offset ||
+        vfs_reserve(h->slot, offset + count) < 0) {
+        return -1;
+    }
+
+    for (size_t i = file->size; i < offset; i++) {
+        file->data[i] = 0;
+    }
+    vfs_memcpy(file->data + offset, buffer, count);
+    if (offset + count > file->size) {
+        file->size = offset + count;
+    }
+    h->offset = offset + count;
+    vfs_touch(h->slot, VFS_DIRTY_DATA);
+    return count;
+}
+
+int vfs_seek(int handle, int32_t offset, int whence) {
+    vfs_handle_t* h = vfs_handle(handle);
+    if (!h) {
+        return -1;
+    }
+
+    int32_t base = 0;
+    if (whence == VFS_SEEK_CUR) {
+        base = h->offset;
+    } else if (whence == VFS_SEEK_END) {
+        base = files[h->slot].size;
+    } else if (whence != VFS_SEEK_SET) {
+        return -1;
+    }
+
+    if (base + offset < 0 || base + offset > MAX_FILE_SIZE) {
+        return -1;
+    }
+    h->offset = base + offset;
+    return h->offset;
+}
+
+// Create the file if needed and add data at its end
+int vfs_append(const char* path, const char* data, size_t size) {
+    int h = vfs_open(path, VFS_O_APPEND | VFS_O_CREATE);
+    if (h < 0) {
+        return h;
+    }
+
+    int written = vfs_fwrite(h, data, size);
+    vfs_close(h);
+    return written;
 }
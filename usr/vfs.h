@@ -5,9 +5,32 @@
 #include <stdint.h>
 #include <lib/nc/stdbool.h>
 
-#define MAX_FILES 128
-#define MAX_FILENAME 64
-#define MAX_FILE_SIZE 4096
+#define MAX_FILES 1024
+#define MAX_FILENAME 64     // Per path component
+#define MAX_FILE_SIZE (16 * 1024 * 1024)
+
+#define VFS_NONE -1         // No dentry link
+#define VFS_ROOT 0          // Slot of the root directory
+
+#define VFS_MAX_HANDLES 64
+#define VFS_MAX_MOUNTS 8
+#define VFS_NEW_NODE 0xFFFFFFFFu   // Entry a writable mount has not stored yet
+
+// Changes a writable mount has not written back
+#define VFS_DIRTY_META 0x01     // Name or parent directory
+#define VFS_DIRTY_DATA 0x02     // File contents
+
+// vfs_open flags
+#define VFS_O_READ   0x01
+#define VFS_O_WRITE  0x02
+#define VFS_O_CREATE 0x04   // Create the file if it does not exist
+#define VFS_O_TRUNC  0x08   // Start from an empty file
+#define VFS_O_APPEND 0x10   // Every write goes to the end of the file
+
+// vfs_seek origins
+#define VFS_SEEK_SET 0
+#define VFS_SEEK_CUR 1
+#define VFS_SEEK_END 2
 
 typedef enum {
     VFS_TYPE_FILE,
@@ -15,22 +38,76 @@ typedef enum {
 } vfs_entry_type_t;
 
 typedef struct {
-    char name[MAX_FILENAME];
-    char data[MAX_FILE_SIZE];
+    char name[MAX_FILENAME];    // Entry name within its parent directory
+    char* data;                 // Heap extent, NULL while the file is empty
+    size_t capacity;            // Bytes allocated for data
     size_t size;
     bool used;
     vfs_entry_type_t type;
+    uint16_t opens;             // Open handles, the file cannot be deleted meanwhile
+
+    // Page cache store holding the contents in place of data (VFS_NONE if
+    // none); the first write copies them into a heap extent
+    int8_t store;
+    uint32_t store_file;
+
+    // Entries of a mounted filesystem. The driver lists a directory the
+    // first time it is looked into.
+    int8_t mount;               // Mount index or VFS_NONE
+    bool populated;
+    uint8_t dirty;              // VFS_DIRTY_* for writable mounts
+    uint32_t node;              // Driver's id for the entry
+
+    // Dentry links (slot numbers or VFS_NONE)
+    int16_t parent;
+    int16_t first_child;
+    int16_t next_sibling;
+    int16_t prev_sibling;
 } vfs_file_t;
 
+// Filesystem driver behind a mount point. populate adds the entries of one
+// directory with vfs_mount_add; it is called once per directory. Writable
+// filesystems also implement remove, called when a stored entry is deleted
+// or moved off the mount, and sync, which writes dirty entries back and
+// with wait set returns once they are on the device.
+typedef struct {
+    const char* name;
+    int (*populate)(int dir, uint32_t node);
+    void (*remove)(uint32_t node);
+    int (*sync)(bool wait);
+} vfs_driver_t;
+
 void vfs_init(void);
 int vfs_create(const char* filename, const char* data, size_t size);
+int vfs_create_backed(const char* filename, int store, uint32_t file, size_t size);
 int vfs_mkdir(const char* dirname);
 const char* vfs_read(const char* filename, size_t* size);
 int vfs_delete(const char* filename);
 bool vfs_exists(const char* filename);
 bool vfs_is_dir(const char* path);
+int vfs_rename(const char* from, const char* to);
 int vfs_count(void);
-void vfs_list_dir(const char* dirname);
+int vfs_dir_first(const char* dirname);
+int vfs_dir_next(int slot);
 vfs_file_t* vfs_get_files(void);
+int vfs_mount(const char* path, const vfs_driver_t* driver, int store, uint32_t root);
+int vfs_mount_add(int dir, const char* name, vfs_entry_type_t type, uint32_t node, size_t size);
+void vfs_memory_usage(size_t* table_bytes, size_t* data_bytes, size_t* backed_bytes);
+const vfs_driver_t* vfs_mount_driver(int mount);
+
+// Changes made to the mounts of driver so far; writable drivers compare it
+// with the count they last wrote back
+uint32_t vfs_mount_changes(const vfs_driver_t* driver);
+
+// Write back every writable mount and wait for it
+int vfs_sync(void);
+
+// Handle based access with a per-handle offset
+int vfs_open(const char* path, int flags);
+int vfs_close(int handle);
+int vfs_fread(int handle, void* buffer, size_t count);
+int vfs_fwrite(int handle, const void* buffer, size_t count);
+int vfs_seek(int handle, int32_t offset, int whence);
+int vfs_append(const char* path, const char* data, size_t size);
 
 #endif // USR_VFS_H